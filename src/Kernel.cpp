@@ -1,7 +1,9 @@
 #include "Kernel.hpp"
 #include "kernelreader.hpp"
+#include "taskpool.hpp"
 #include <iostream>
 #include <cassert>
+#include <chrono>
 #include "utils.h"
 
 #ifdef _DEBUG
@@ -13,6 +15,9 @@ FLT_NAMESPACE_BEGIN
 std::string Kernel::globalBuildOpts = "";
 void* Kernel::userPtr = nullptr;
 
+// Compile messages from worker threads
+static std::mutex logLock;
+
 // Check CL command success
 void Kernel::verify(int code, const std::string msg) {
     if (code != CL_SUCCESS)
@@ -23,18 +28,30 @@ void Kernel::verify(int code, const std::string msg) {
     }
 }
 
-void Kernel::build(std::string path, std::string entryPoint, cl::Context& context, cl::Device& device, cl::Platform& platform, bool setArgs)
+void Kernel::build(std::string path, std::string entryPoint, cl::Context& context, cl::Device& device, cl::Platform& platform, bool setArgs, TaskPool* pool)
 {
+    const std::string buildOpts = getBuildOptions(path);
+
+    {
+        std::unique_lock<std::mutex> lock(buildLock);
+        if (building && buildOpts == lastBuildOpts)
+        {
+            // Already being compiled with these options
+            argsPending = argsPending || setArgs;
+            return;
+        }
+        buildDone.wait(lock, [this] { return !building; });
+    }
+
     // No need to recompile, just update arguments
-    if (m_kernel() && !configHasChanged())
+    if (m_kernel() && buildOpts == lastBuildOpts)
     {
+        argsPending = false;
         if (setArgs)
             this->setArgs();
         return;
     }
 
-    const std::string filename = getFileName(path);
-
     this->context = &context;
     this->device = &device;
     this->platform = &platform;
@@ -42,68 +59,115 @@ void Kernel::build(std::string path, std::string entryPoint, cl::Context& contex
     this->entryPoint = entryPoint;
 
     if (m_kernel())
-        std::cout << "Rebuilding kernel " << filename << std::endl;
+        std::cout << "Rebuilding kernel " << getFileName(path) << std::endl;
 
-    // Define build options based on global + specialized options
-    std::string buildOpts = globalBuildOpts + getAdditionalBuildOptions();
-#ifdef CPU_DEBUGGING
-    buildOpts += " -g -s \"" + getAbsolutePath(srcPath) + "\"";
-#endif
+    // Default arguments are always set after (re)compilation
     this->lastBuildOpts = buildOpts;
+    this->argsPending = true;
+
+    if (!pool)
+    {
+        compile(buildOpts);
+        wait();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(buildLock);
+        building = true;
+    }
+
+    pool->submit([this, buildOpts]()
+    {
+        compile(buildOpts);
+        std::lock_guard<std::mutex> lock(buildLock);
+        building = false;
+        buildDone.notify_all();
+    });
+}
+
+void Kernel::compile(const std::string buildOpts)
+{
+    const std::string filename = getFileName(srcPath);
+    auto startTime = std::chrono::high_resolution_clock::now();
     cl::Program program;
+    bool cached = false;
 
     // CPU debugging segfaults if trying to use cached kernel!
     // Also need to let the driver do the include handling
     int err = 0;
 #ifdef CPU_DEBUGGING
-    kernelFromSource(srcPath, context, program, err);
-    cl::vector<cl::Device> devices = { device };
+    kernelFromSource(srcPath, *context, program, err);
+    cl::vector<cl::Device> devices = { *device };
     err = program.build(devices, buildOpts.c_str());
 
     // Check build log
-    std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+    std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*device);
     if (buildLog.length() > 2)
-        std::cout << "\n[" << path << " build log]:" << buildLog << std::endl;
+        std::cout << "\n[" << srcPath << " build log]:" << buildLog << std::endl;
 
     verify(err, "Kernel compilation failed");
 #else
     // Build program using cache or sources
-    program = kernelFromFile(path, buildOpts, platform, context, device, err);
+    program = kernelFromFile(srcPath, buildOpts, *platform, *context, *device, err, &cached);
     verify(err, "Failed to create kernel program");
 #endif
 
     // Creating compute kernel from program
-    m_kernel = cl::Kernel(program, entryPoint.c_str(), &err);
+    cl::Kernel kernel = cl::Kernel(program, entryPoint.c_str(), &err);
     verify(err, "Failed to create compute kernel!");
 
     // Get kernel argument names
     // NB: kernels built from binaries SHOULD NOT have arg info, but they do at least on Intel/NV!
-    argMap.clear();
-    cl_uint numArgs = m_kernel.getInfo<CL_KERNEL_NUM_ARGS>(&err);
+    std::map<std::string, cl_uint> args;
+    cl_uint numArgs = kernel.getInfo<CL_KERNEL_NUM_ARGS>(&err);
     verify(err, "Getting KERNEL_NUM_ARGS failed for " + filename);
     for (cl_uint i = 0; i < numArgs; i++)
     {
-        auto argname = m_kernel.getArgInfo<CL_KERNEL_ARG_NAME>(i, &err);
+        auto argname = kernel.getArgInfo<CL_KERNEL_ARG_NAME>(i, &err);
         verify(err, "Getting CL_KERNEL_ARG_NAME failed for " + filename);
-        argMap[argname] = i; // save to mapping
+        args[argname] = i; // save to mapping
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(buildLock);
+        m_kernel = kernel;
+        argMap.swap(args);
     }
 
-    // Set default arguments
-    this->setArgs();
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(logLock);
+    std::cout << "Kernel " << filename << ": " << std::chrono::duration<double, std::milli>(endTime - startTime).count()
+              << " ms (" << ((cached) ? "cache hit" : "cache miss") << ")" << std::endl;
+}
+
+void Kernel::wait()
+{
+    {
+        std::unique_lock<std::mutex> lock(buildLock);
+        buildDone.wait(lock, [this] { return !building; });
+    }
+
+    // Arguments reference current device buffers
+    if (argsPending)
+    {
+        argsPending = false;
+        this->setArgs();
+    }
 }
 
-void Kernel::rebuild(bool setArgs)
+void Kernel::rebuild(bool setArgs, TaskPool* pool)
 {
-    build(srcPath, entryPoint, *context, *device, *platform, setArgs);
+    build(srcPath, entryPoint, *context, *device, *platform, setArgs, pool);
 }
 
-bool Kernel::configHasChanged()
+std::string Kernel::getBuildOptions(const std::string path)
 {
     std::string buildOpts = globalBuildOpts + getAdditionalBuildOptions();
 #ifdef CPU_DEBUGGING
-    buildOpts += " -g -s \"" + getAbsolutePath(srcPath) + "\"";
+    buildOpts += " -g -s \"" + getAbsolutePath(path) + "\"";
 #endif
-    return (buildOpts.compare(lastBuildOpts) != 0);
+    return buildOpts;
 }
 
 
@@ -10,6 +10,10 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <condition_variable>
+
+class TaskPool;
 
 FLT_NAMESPACE_BEGIN
 
@@ -19,17 +23,22 @@ public:
     Kernel(void) = default;
     ~Kernel(void) = default;
 
-    explicit operator bool() const { return m_kernel() != nullptr; }
-    operator cl::Kernel&() { return m_kernel; }
+    explicit operator bool() { wait(); return m_kernel() != nullptr; }
+    operator cl::Kernel&() { wait(); return m_kernel; }
 
     // Build, but only if needed!
-    void build(std::string path, std::string entryPoint, cl::Context& context, cl::Device& device, cl::Platform& platform, bool setArgs = true);
-    void rebuild(bool setArgs);
+    // With a pool, compilation runs in the background and the kernel is finished on first use
+    void build(std::string path, std::string entryPoint, cl::Context& context, cl::Device& device, cl::Platform& platform, bool setArgs = true, TaskPool* pool = nullptr);
+    void rebuild(bool setArgs, TaskPool* pool = nullptr);
+
+    // Block until a pending compilation is done, then set arguments if needed
+    void wait();
 
     //cl::Kernel& getKernel() { return m_kernel; }
 
     template <typename T>
     cl_int setArg(const std::string name, const T& value) {
+        wait();
         auto it = argMap.find(name);
         if (it == argMap.end())
         {
@@ -42,15 +51,19 @@ public:
         }
     }
 
-    bool hasArg(const std::string name) { return argMap.find(name) != argMap.end(); }
+    bool hasArg(const std::string name) { wait(); return argMap.find(name) != argMap.end(); }
 
     // For accessing compilation settings and device buffers
     static void setUserPointer(void* p) { Kernel::userPtr = p; }
+    static void* getUserPointer() { return userPtr; }
     static void setBuildOptions(std::string s) { globalBuildOpts = s; }
 
 private:
-    // For checking if recompilation is necessary
-    bool configHasChanged();
+    // Global + specialized options
+    std::string getBuildOptions(const std::string path);
+
+    // Program creation and argument lookup, safe to run on a worker thread
+    void compile(const std::string buildOpts);
     
     // Cached for recompilation
     cl::Context* context;
@@ -64,6 +77,12 @@ private:
     std::string lastBuildOpts; // for detecting need to recompile
     std::map<std::string, cl_uint> argMap;
 
+    // Background compilation state
+    std::mutex buildLock;
+    std::condition_variable buildDone;
+    bool building = false;
+    bool argsPending = false; // set arguments once compiled
+
 protected:
     virtual std::string getAdditionalBuildOptions() { return ""; };
     virtual void setArgs() = 0;
@@ -7,9 +7,206 @@
 
 //#define USE_BITSTACK
 
-#ifdef USE_BITSTACK
+// Interpolated shading attributes of closest hit, imin is index into leaf order
+// Flat shaded triangles (zero vertex normals) use the geometric normal
+// uvFootprint is set per unit of ray cone width, scaled by the tracing kernel
+inline void setHitAttributes(Ray *r, Hit *hit, global Triangle *tris, global Vertex *verts, global LeafTriangle *leafTris, global uint *indices, int imin, float t, float u, float v)
+{
+    const uint ti = indices[imin];
+    const Triangle tri = tris[ti];
+    const Vertex v0 = verts[tri.v[0]];
+    const Vertex v1 = verts[tri.v[1]];
+    const Vertex v2 = verts[tri.v[2]];
+
+    const float3 Ng = cross(leafTris[imin].e1, leafTris[imin].e2);
+    float3 N = lerp(u, v, v0.n, v1.n, v2.n);
+    if (dot(N, N) == 0.0f)
+        N = Ng;
+
+    // Texture to world area ratio, projected onto ray
+    const float2 t1 = v1.t.xy - v0.t.xy;
+    const float2 t2 = v2.t.xy - v0.t.xy;
+    const float uvArea = fabs(t1.x * t2.y - t1.y * t2.x);
+    const float worldArea = length(Ng);
+    const float cosTh = max(fabs(dot(Ng, r->dir)) / worldArea, 1e-3f);
+    hit->uvFootprint = (worldArea > 0.0f) ? sqrt(uvArea / worldArea) / cosTh : 0.0f;
+
+    hit->i = ti;
+    hit->matId = tri.matId;
+    hit->t = t;
+    hit->P = r->orig + t * r->dir;
+    hit->N = normalize(N);
+    hit->uvTex = lerp(u, v, v0.t, v1.t, v2.t).xy;
+}
+
+#if defined(BVH_WIDTH)
+// Wide BVH traversal, all children of a node are tested at once
+#if BVH_WIDTH == 8
+#define floatW float8
+#define vloadW vload8
+#define vstoreW vstore8
+#define convert_floatW convert_float8
+#elif BVH_WIDTH == 4
+#define floatW float4
+#define vloadW vload4
+#define vstoreW vstore4
+#define convert_floatW convert_float4
+#else
+#define floatW float2
+#define vloadW vload2
+#define vstoreW vstore2
+#define convert_floatW convert_float2
+#endif
+
+#ifdef BVH_QUANTIZED
+// Dequantized child bounds along axis
+#define childMin(n, dim) (n->origin[dim] + convert_floatW(vloadW(0, n->qmin[dim])) * as_float((uint)n->exp[dim] << 23))
+#define childMax(n, dim) (n->origin[dim] + convert_floatW(vloadW(0, n->qmax[dim])) * as_float((uint)n->exp[dim] << 23))
+#else
+#define childMin(n, dim) vloadW(0, n->bmin[dim])
+#define childMax(n, dim) vloadW(0, n->bmax[dim])
+#endif
+
+// Each pop pushes at most W-1 more entries than it removes, per level of the hierarchy
+#define BVH_STACK_SIZE ((BVH_WIDTH - 1) * BVH_MAX_DEPTH + 1)
+
+// Slab test against all child boxes, writes entry distances (FLT_MAX on miss)
+inline void intersectChildren(Ray *r, const float3 dinv, global GPUWideNode *n, float tMaxPrev, float *tnear)
+{
+    const floatW tx0 = (childMin(n, 0) - r->orig.x) * dinv.x;
+    const floatW tx1 = (childMax(n, 0) - r->orig.x) * dinv.x;
+    const floatW ty0 = (childMin(n, 1) - r->orig.y) * dinv.y;
+    const floatW ty1 = (childMax(n, 1) - r->orig.y) * dinv.y;
+    const floatW tz0 = (childMin(n, 2) - r->orig.z) * dinv.z;
+    const floatW tz1 = (childMax(n, 2) - r->orig.z) * dinv.z;
+
+    const floatW tmin = fmax(fmax(fmin(tx0, tx1), fmin(ty0, ty1)), fmax(fmin(tz0, tz1), (floatW)(0.0f)));
+    const floatW tmax = fmin(fmin(fmax(tx0, tx1), fmax(ty0, ty1)), fmin(fmax(tz0, tz1), (floatW)(tMaxPrev)));
+
+    vstoreW(select((floatW)(FLT_MAX), tmin, tmin <= tmax), 0, tnear);
+}
+
+inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global Vertex *verts, global LeafTriangle *leafTris, global GPUNode *nodes, global uint *indices)
+{
+    global GPUWideNode *wnodes = (global GPUWideNode*)nodes;
+    const float3 dinv = native_recip(r->dir);
+
+    // Stack state
+    uint stack[BVH_STACK_SIZE];
+    int stackptr = 0;
+
+    // Root node
+    stack[stackptr] = 0;
+
+    while (stackptr >= 0)
+    {
+        global GPUWideNode *n = &wnodes[stack[stackptr]];
+        stackptr--;
+
+        float tnear[BVH_WIDTH];
+        intersectChildren(r, dinv, n, hit->t, tnear);
+
+        // Inner children sorted far to near
+        float dist[BVH_WIDTH];
+        uint child[BVH_WIDTH];
+        int count = 0;
+
+        for (uint c = 0; c < n->numChildren; c++)
+        {
+            if (tnear[c] >= hit->t)
+                continue;
+
+            if (n->nPrims[c] != 0) // Leaf child, intersected right away
+            {
+                float tmin = FLT_MAX, umin = 0.0f, vmin = 0.0f;
+                int imin = -1;
+                for (uint i = n->child[c]; i < n->child[c] + n->nPrims[c]; i++)
+                {
+                    float t, u, v;
+                    if (intersectLeafTriangle(r, &leafTris[i], &t, &u, &v))
+                    {
+                        if (t > 0.0f && t < tmin)
+                        {
+                            imin = i;
+                            tmin = t;
+                            umin = u;
+                            vmin = v;
+                        }
+                    }
+                }
+                if (imin != -1 && tmin < hit->t)
+                {
+                    setHitAttributes(r, hit, tris, verts, leafTris, indices, imin, tmin, umin, vmin);
+                }
+                continue;
+            }
+
+            int j = count++;
+            while (j > 0 && dist[j - 1] < tnear[c])
+            {
+                dist[j] = dist[j - 1];
+                child[j] = child[j - 1];
+                j--;
+            }
+            dist[j] = tnear[c];
+            child[j] = n->child[c];
+        }
+
+        // Farthest pushed first
+        for (int j = 0; j < count; j++)
+            stack[++stackptr] = child[j];
+    }
+}
+
+inline bool bvh_occluded(Ray *r, float *maxDist, global LeafTriangle *leafTris, global GPUNode *nodes)
+{
+    global GPUWideNode *wnodes = (global GPUWideNode*)nodes;
+    const float3 dinv = native_recip(r->dir);
+
+    // Stack state
+    uint stack[BVH_STACK_SIZE];
+    int stackptr = 0;
+
+    // Root node
+    stack[stackptr] = 0;
+
+    while (stackptr >= 0)
+    {
+        global GPUWideNode *n = &wnodes[stack[stackptr]];
+        stackptr--;
+
+        float tnear[BVH_WIDTH];
+        intersectChildren(r, dinv, n, *maxDist, tnear);
+
+        // Any hit will do => no sorting
+        for (uint c = 0; c < n->numChildren; c++)
+        {
+            if (tnear[c] >= *maxDist)
+                continue;
+
+            if (n->nPrims[c] == 0)
+            {
+                stack[++stackptr] = n->child[c];
+                continue;
+            }
+
+            for (uint i = n->child[c]; i < n->child[c] + n->nPrims[c]; i++)
+            {
+                float t, u, v;
+                if (intersectLeafTriangle(r, &leafTris[i], &t, &u, &v) && t > 0.0f && t < *maxDist)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+#elif defined(USE_BITSTACK)
 // Traversal with bitstacks - https://github.com/martinradev/BVH-algo-lib/blob/master/shaders/trace.glsl
-inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNode *nodes, global uint *indices)
+inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global Vertex *verts, global LeafTriangle *leafTris, global GPUNode *nodes, global uint *indices)
 {
     int top = 0;
     int lstack = 0;
@@ -27,7 +224,7 @@ inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNod
             for (uint i = n.iStart; i < n.iStart + n.nPrims; i++)
             {
                 float t, u, v;
-                if (intersectTriangle(r, &(tris[indices[i]]), &t, &u, &v))
+                if (intersectLeafTriangle(r, &leafTris[i], &t, &u, &v))
                 {
                     if (t > 0.0f && t < tmin)
                     {
@@ -40,12 +237,7 @@ inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNod
             }
             if (imin != -1 && tmin < hit->t)
             {
-                hit->i = indices[imin];
-                hit->matId = tris[indices[imin]].matId;
-                hit->t = tmin;
-                hit->P = r->orig + tmin * r->dir;
-                hit->N = normalize(lerp(umin, vmin, tris[indices[imin]].v0.n, tris[indices[imin]].v1.n, tris[indices[imin]].v2.n));
-                hit->uvTex = lerp(umin, vmin, tris[indices[imin]].v0.t, tris[indices[imin]].v1.t, tris[indices[imin]].v2.t).xy;
+                setHitAttributes(r, hit, tris, verts, leafTris, indices, imin, tmin, umin, vmin);
             }
 
             trackback = true;
@@ -127,7 +319,7 @@ inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNod
 }
 
 // Traversal with bitstacks - https://github.com/martinradev/BVH-algo-lib/blob/master/shaders/trace.glsl
-inline bool bvh_occluded(Ray *r, float *maxDist, global Triangle *tris, global GPUNode *nodes, global uint *indices)
+inline bool bvh_occluded(Ray *r, float *maxDist, global LeafTriangle *leafTris, global GPUNode *nodes)
 {
     int top = 0;
     int lstack = 0;
@@ -143,7 +335,7 @@ inline bool bvh_occluded(Ray *r, float *maxDist, global Triangle *tris, global G
             for (uint i = n.iStart; i < n.iStart + n.nPrims; i++)
             {
                 float t, u, v;
-                if (intersectTriangle(r, &(tris[indices[i]]), &t, &u, &v) && t > 0.0f && t < *maxDist)
+                if (intersectLeafTriangle(r, &leafTris[i], &t, &u, &v) && t > 0.0f && t < *maxDist)
                 {
                     return true;
                 }
@@ -231,7 +423,7 @@ inline bool bvh_occluded(Ray *r, float *maxDist, global Triangle *tris, global G
 
 #else
 // BVH traversal using simulated stack
-inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNode *nodes, global uint *indices)
+inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global Vertex *verts, global LeafTriangle *leafTris, global GPUNode *nodes, global uint *indices)
 {
     float lnear, lfar, rnear, rfar; // AABB limits
     uint closer, farther;
@@ -257,7 +449,7 @@ inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNod
             for (uint i = n.iStart; i < n.iStart + n.nPrims; i++)
             {
                 float t, u, v;
-                if (intersectTriangle(r, &(tris[indices[i]]), &t, &u, &v))
+                if (intersectLeafTriangle(r, &leafTris[i], &t, &u, &v))
                 {
                     if (t > 0.0f && t < tmin)
                     {
@@ -270,12 +462,7 @@ inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNod
             }
             if (imin != -1 && tmin < hit->t)
             {
-                hit->i = indices[imin];
-                hit->matId = tris[indices[imin]].matId;
-                hit->t = tmin;
-                hit->P = r->orig + tmin * r->dir;
-                hit->N = normalize(lerp(umin, vmin, tris[indices[imin]].v0.n, tris[indices[imin]].v1.n, tris[indices[imin]].v2.n));
-                hit->uvTex = lerp(umin, vmin, tris[indices[imin]].v0.t, tris[indices[imin]].v1.t, tris[indices[imin]].v2.t).xy;
+                setHitAttributes(r, hit, tris, verts, leafTris, indices, imin, tmin, umin, vmin);
             }
         }
         else // Internal node
@@ -309,7 +496,7 @@ inline void bvh_intersect(Ray *r, Hit *hit, global Triangle *tris, global GPUNod
     }
 }
 
-inline bool bvh_occluded(Ray *r, float *maxDist, global Triangle *tris, global GPUNode *nodes, global uint *indices)
+inline bool bvh_occluded(Ray *r, float *maxDist, global LeafTriangle *leafTris, global GPUNode *nodes)
 {
     float lnear, lfar, rnear, rfar; // AABB limits
     uint closer, farther;
@@ -333,7 +520,7 @@ inline bool bvh_occluded(Ray *r, float *maxDist, global Triangle *tris, global G
             for (uint i = n.iStart; i < n.iStart + n.nPrims; i++)
             {
                 float t, u, v;
-                if (intersectTriangle(r, &(tris[indices[i]]), &t, &u, &v) && t > 0.0f && t < *maxDist)
+                if (intersectLeafTriangle(r, &leafTris[i], &t, &u, &v) && t > 0.0f && t < *maxDist)
                 {
                     return true;
                 }
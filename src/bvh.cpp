@@ -1,28 +1,36 @@
 #include <iostream>
 #include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <cassert>
+#include <chrono>
 #include "bvh.hpp"
+#include "utils.h"
+#include "xxhash/xxhash.h"
 
-BVH::BVH(std::vector<RTTriangle>* tris, SplitMode mode)
+BVH::BVH(TriangleMesh *mesh, SplitMode mode, U32 sahBins)
 {
-    m_triangles = tris;
+    m_mesh = mesh;
     m_mode = mode;
+    m_sahBins = std::max(2u, std::min(sahBins, (U32)MaxSahBins));
 
 	// Setup references for building
-	m_refs.resize(m_triangles->size());
-	for (int i = 0; i < m_triangles->size(); i++)
+	m_refs.resize(m_mesh->size());
+	for (int i = 0; i < m_mesh->size(); i++)
 	{
-		m_refs[i] = TriRef(i, (*m_triangles)[i]);
+		m_refs[i] = TriRef(i, *m_mesh);
 	}
 
 	// Shared vector to avoid reallocations
-	rightBoxes.resize(m_triangles->size());
+	rightBoxes.resize(m_mesh->size());
 
-	BuildNode root(0, (U32)m_triangles->size() - 1, -1);
+	BuildNode root(0, (U32)m_mesh->size() - 1, -1);
 	m_build_nodes.push_back(root);
 	nodes++;
     
+	auto t0 = std::chrono::high_resolution_clock::now();
 	build(0, 0, 0.0f, 1.0f); // root, depth 0
+	auto t1 = std::chrono::high_resolution_clock::now();
 	printf("\rBVH builder: progress 100%%\n");
 	assert(m_build_nodes[0].rightChild != -1);
 	assert(metrics.depth <= MaxDepth);
@@ -36,19 +44,283 @@ BVH::BVH(std::vector<RTTriangle>* tris, SplitMode mode)
 
 	std::cout
 		<< "======================" << std::endl
-		<< ((m_mode == SplitMode_Sah) ? "SAH" : (m_mode == SplitMode_ObjectMedian) ? "Object Median" : (m_mode == SplitMode_SpatialMedian) ? "Spatial Median" : "Unknown") << std::endl
+		<< splitModeName() << std::endl
+		<< "Build time: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms" << std::endl
+		<< "SAH cost: " << treeSahCost() << std::endl
 		<< "Splits: " << metrics.splits << " (" << int(metrics.bad_splits / float(metrics.splits) * 100.0f) << "% bad)" << std::endl
 		<< "Depth: " << metrics.depth << std::endl
 		<< "Leaves: " << metrics.splits + 1 << std::endl
 		<< "======================" << std::endl;
 }
 
-BVH::BVH(std::vector<RTTriangle>* tris, const std::string filename)
+BVH::BVH(TriangleMesh *mesh, const std::string filename)
 {
-    m_triangles = tris;
-    importFrom(filename);
+    m_mesh = mesh;
+    if (!importFrom(filename))
+    {
+        m_indices.clear();
+        m_nodes.clear();
+    }
+}
+
+BVH::BVH(TriangleMesh *mesh, const char *data, size_t size)
+{
+    m_mesh = mesh;
+    if (!deserialize(data, size))
+    {
+        m_indices.clear();
+        m_nodes.clear();
+    }
+}
+
+const char *BVH::splitModeName() const
+{
+	switch (m_mode)
+	{
+	case SplitMode_Sah: return "SAH";
+	case SplitMode_BinnedSah: return "Binned SAH";
+	case SplitMode_ObjectMedian: return "Object Median";
+	case SplitMode_SpatialMedian: return "Spatial Median";
+	default: return "Unknown";
+	}
+}
+
+// SAH cost of finished tree, relative to root area
+F32 BVH::treeSahCost() const
+{
+	F32 rootArea = m_nodes[0].box.area();
+	F32 cost = 0.0f;
+	for (const Node &n : m_nodes)
+	{
+		F32 relArea = n.box.area() / rootArea;
+		cost += (n.nPrims > 0) ? sahParams.costTri * n.nPrims * relArea : sahParams.costBox * relArea;
+	}
+	return cost;
+}
+
+NodeLayout BVH::layoutFromName(const std::string &name)
+{
+	if (name == "surfaceArea")
+		return NodeLayout_SurfaceArea;
+	if (name != "depthFirst")
+		std::cout << "Unknown BVH layout '" << name << "', using depth first" << std::endl;
+	return NodeLayout_DepthFirst;
+}
+
+// Child with larger surface area is more likely to be visited => placed right after parent
+void BVH::relayout(NodeLayout layout)
+{
+	// Build order cannot be restored, depth first keeps current order
+	if (layout == m_layout || layout == NodeLayout_DepthFirst || m_nodes.empty())
+		return;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	std::vector<Node> nodes;
+	std::vector<U32> indices;
+	nodes.reserve(m_nodes.size());
+	indices.reserve(m_indices.size());
+
+	m_layout = layout;
+	relayoutNode(0, -1, nodes, indices);
+	m_nodes.swap(nodes);
+	m_indices.swap(indices);
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	std::cout << "BVH relayout: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms" << std::endl;
+}
+
+// Depth first, leaf indices appended in traversal order
+U32 BVH::relayoutNode(U32 ni, S32 parentId, std::vector<Node> &nodes, std::vector<U32> &indices) const
+{
+	U32 ind = nodes.size();
+	nodes.push_back(m_nodes[ni]);
+	nodes[ind].parent = parentId;
+
+	const Node &n = m_nodes[ni];
+	if (n.nPrims > 0)
+	{
+		nodes[ind].iStart = indices.size();
+		indices.insert(indices.end(), m_indices.begin() + n.iStart, m_indices.begin() + n.iStart + n.nPrims);
+		return ind;
+	}
+
+	U32 first = ni + 1;
+	U32 second = n.rightChild;
+	if (m_layout == NodeLayout_SurfaceArea && m_nodes[second].box.area() > m_nodes[first].box.area())
+		std::swap(first, second);
+
+	relayoutNode(first, ind, nodes, indices);
+	U32 right = relayoutNode(second, ind, nodes, indices);
+	nodes[ind].rightChild = right;
+	return ind;
+}
+
+template <int W>
+bool BVH::collapse(std::vector<WideNode<W>> &out) const
+{
+	out.clear();
+	out.reserve(m_nodes.size() / (W / 2) + 1);
+	U32 depth = 0;
+	collapseNode<W>(0, 1, depth, out);
+
+	std::cout << "Collapsed BVH" << W << ": " << m_nodes.size() << " => " << out.size() << " nodes, depth " << depth << std::endl;
+
+	// Greedy collapse does not guarantee a shallower tree, kernel stacks only cover MaxTraversalDepth levels
+	return depth <= MaxTraversalDepth;
+}
+
+// Greedily open the inner child with largest area until W children, returns index of created node
+template <int W>
+U32 BVH::collapseNode(U32 ni, U32 depth, U32 &maxDepth, std::vector<WideNode<W>> &out) const
+{
+	maxDepth = std::max(maxDepth, depth);
+	U32 ind = out.size();
+	out.push_back(WideNode<W>());
+
+	U32 children[W];
+	U32 count = 0;
+	if (m_nodes[ni].nPrims > 0)
+	{
+		children[count++] = ni; // leaf root
+	}
+	else
+	{
+		children[count++] = ni + 1;
+		children[count++] = m_nodes[ni].rightChild;
+	}
+
+	while (count < W)
+	{
+		S32 best = -1;
+		F32 bestArea = -1.0f;
+		for (U32 i = 0; i < count; i++)
+		{
+			const Node &c = m_nodes[children[i]];
+			if (c.nPrims == 0 && c.box.area() > bestArea)
+			{
+				bestArea = c.box.area();
+				best = i;
+			}
+		}
+
+		if (best == -1)
+			break; // only leaves left
+
+		U32 opened = children[best];
+		children[best] = opened + 1;
+		children[count++] = m_nodes[opened].rightChild;
+	}
+
+	// Built locally, recursion reallocates output
+	WideNode<W> wn;
+	wn.numChildren = count;
+	for (U32 i = 0; i < W; i++)
+	{
+		AABB_t box = (i < count) ? m_nodes[children[i]].box : AABB_t(); // empty slots inverted
+		for (U32 dim = 0; dim < 3; dim++)
+		{
+			wn.bmin[dim][i] = box.min[dim];
+			wn.bmax[dim][i] = box.max[dim];
+		}
+		wn.child[i] = 0;
+		wn.nPrims[i] = 0;
+	}
+
+	for (U32 i = 0; i < count; i++)
+	{
+		const Node &c = m_nodes[children[i]];
+		if (c.nPrims > 0)
+		{
+			wn.child[i] = c.iStart;
+			wn.nPrims[i] = c.nPrims;
+		}
+		else
+		{
+			wn.child[i] = collapseNode<W>(children[i], depth + 1, maxDepth, out);
+		}
+	}
+
+	out[ind] = wn;
+	return ind;
+}
+
+template bool BVH::collapse<2>(std::vector<WideNode<2>> &out) const;
+template bool BVH::collapse<4>(std::vector<WideNode<4>> &out) const;
+template bool BVH::collapse<8>(std::vector<WideNode<8>> &out) const;
+
+// Child bounds rounded outwards => dequantized boxes always contain the originals
+template <int W>
+void BVH::quantize(const std::vector<WideNode<W>> &in, std::vector<QuantizedNode<W>> &out)
+{
+	out.resize(in.size());
+	U32 clamped = 0;
+
+	for (size_t n = 0; n < in.size(); n++)
+	{
+		const WideNode<W> &wn = in[n];
+		QuantizedNode<W> &qn = out[n];
+		qn.numChildren = wn.numChildren;
+
+		for (U32 dim = 0; dim < 3; dim++)
+		{
+			F32 lo = FLT_MAX, hi = -FLT_MAX;
+			for (U32 i = 0; i < wn.numChildren; i++)
+			{
+				lo = std::min(lo, wn.bmin[dim][i]);
+				hi = std::max(hi, wn.bmax[dim][i]);
+			}
+
+			// Smallest power of two that spans the node in 255 steps
+			int e;
+			std::frexp((hi - lo) / 255.0f, &e);
+			e = std::max(-126, std::min(e, 127));
+			while (e < 127 && lo + 255.0f * std::ldexp(1.0f, e) < hi)
+				e++;
+
+			const F32 scale = std::ldexp(1.0f, e);
+			qn.origin[dim] = lo;
+			qn.exp[dim] = (U8)(e + 127);
+
+			for (U32 i = 0; i < W; i++)
+			{
+				qn.qmin[dim][i] = 0;
+				qn.qmax[dim][i] = 0;
+				if (i >= wn.numChildren)
+					continue;
+
+				S32 qlo = std::max(0, std::min((S32)std::floor((wn.bmin[dim][i] - lo) / scale), 255));
+				S32 qhi = std::max(0, std::min((S32)std::ceil((wn.bmax[dim][i] - lo) / scale), 255));
+				while (qlo > 0 && lo + qlo * scale > wn.bmin[dim][i])
+					qlo--;
+				while (qhi < 255 && lo + qhi * scale < wn.bmax[dim][i])
+					qhi++;
+
+				if (lo + qlo * scale > wn.bmin[dim][i] || lo + qhi * scale < wn.bmax[dim][i])
+					clamped++;
+
+				qn.qmin[dim][i] = (U8)qlo;
+				qn.qmax[dim][i] = (U8)qhi;
+			}
+		}
+
+		for (U32 i = 0; i < W; i++)
+		{
+			qn.child[i] = wn.child[i];
+			qn.nPrims[i] = wn.nPrims[i];
+		}
+	}
+
+	std::cout << "Quantized BVH" << W << ": " << in.size() * sizeof(WideNode<W>) / 1024 << " KiB => "
+		<< out.size() * sizeof(QuantizedNode<W>) / 1024 << " KiB" << std::endl;
+
+	if (clamped > 0)
+		std::cout << "WARN: " << clamped << " quantized bounds do not contain their children!" << std::endl;
 }
 
+template void BVH::quantize<2>(const std::vector<WideNode<2>> &in, std::vector<QuantizedNode<2>> &out);
+template void BVH::quantize<4>(const std::vector<WideNode<4>> &in, std::vector<QuantizedNode<4>> &out);
+template void BVH::quantize<8>(const std::vector<WideNode<8>> &in, std::vector<QuantizedNode<8>> &out);
+
 AABB_t BVH::getSceneBounds(void) const
 {
     if (m_nodes.size() == 0)
@@ -98,96 +370,135 @@ void BVH::createIndexList() {
 	m_refs.shrink_to_fit();
 }
 
-std::vector<U32> importIndices(std::ifstream &in)
+/*
+	Hierarchy file: 64B header, then index and node arrays at 64B aligned offsets.
+	Arrays are stored as in memory => loaded from a mapping with one copy each.
+*/
+static const U32 HierarchyMagic = 0x48564246; // 'FBVH'
+static const U32 HierarchyVersion = 2;
+static const size_t HierarchyAlignment = 64;
+
+struct HierarchyHeader
 {
-    U32 size;
-    read(in, size);
-    std::vector<U32> vec(size);
-    
-    for (U32 i = 0; i < size; i++)
+	U32 magic;
+	U32 version;
+	U32 nodeSize;		// sizeof(Node), catches struct changes
+	U32 numTris;		// scene triangle count, catches stale files
+	U32 splitMode;		// build parameters
+	U32 layout;
+	U32 sahBins;
+	U32 maxLeafSize;
+	F32 splitAlpha;
+	U32 pad;
+	U64 numIndices;
+	U64 numNodes;
+	U64 checksum;		// XXH64 of everything after header
+};
+static_assert(sizeof(HierarchyHeader) == HierarchyAlignment, "Hierarchy header must fill one alignment block");
+
+static inline size_t alignUp(size_t offset)
+{
+	return (offset + HierarchyAlignment - 1) & ~(HierarchyAlignment - 1);
+}
+
+bool BVH::importFrom(const std::string filename)
+{
+	MappedFile file(filename);
+	if (!file.valid())
 	{
-        U32 ind;
-        read(in, ind);
-        vec[i] = ind;
-    }
+		std::cout << "BVH file " << filename << " could not be mapped" << std::endl;
+		return false;
+	}
 
-    // Return value optimization!
-    return vec;
+	return deserialize(file.data(), file.size());
 }
 
-std::vector<Node> importNodes(std::ifstream &in)
+// Validates header and checksum before touching the arrays
+bool BVH::deserialize(const char *data, size_t size)
 {
-	U32 size;
-	read(in, size);
-	std::vector<Node> vec(size);
+	if (size < sizeof(HierarchyHeader))
+	{
+		std::cout << "BVH data truncated" << std::endl;
+		return false;
+	}
 
-	for (U32 i = 0; i < size; i++)
+	HierarchyHeader h;
+	memcpy(&h, data, sizeof(h));
+	if (h.magic != HierarchyMagic || h.version != HierarchyVersion || h.nodeSize != sizeof(Node))
 	{
-		Node n;
-		float3 bmin, bmax;
-		read(in, bmin.x);
-		read(in, bmin.y);
-		read(in, bmin.z);
-		read(in, bmax.x);
-		read(in, bmax.y);
-		read(in, bmax.z);
-		n.box = AABB_t(bmin, bmax);
-		read(in, n.iStart);
-        read(in, n.parent);
-		read(in, n.nPrims);
-		vec[i] = n;
+		std::cout << "BVH data has outdated format" << std::endl;
+		return false;
 	}
 
-	// Return value optimization!
-	return vec;
-}
+	if (h.numTris != m_mesh->size() || h.numNodes == 0)
+	{
+		std::cout << "BVH data does not match scene" << std::endl;
+		return false;
+	}
 
+	const size_t indexOffset = sizeof(HierarchyHeader);
+	const size_t nodeOffset = alignUp(indexOffset + h.numIndices * sizeof(U32));
+	const size_t totalSize = nodeOffset + h.numNodes * sizeof(Node);
+	if (size != totalSize || XXH64(data + indexOffset, totalSize - indexOffset, 0) != h.checksum)
+	{
+		std::cout << "BVH data is corrupt" << std::endl;
+		return false;
+	}
 
-void BVH::importFrom(const std::string filename)
-{
-    std::ifstream infile(filename, std::ios::binary);
-    m_indices = importIndices(infile);
-    m_nodes = importNodes(infile);
-}
+	const U32 *indices = reinterpret_cast<const U32*>(data + indexOffset);
+	const Node *nodes = reinterpret_cast<const Node*>(data + nodeOffset);
+	m_indices.assign(indices, indices + h.numIndices);
+	m_nodes.assign(nodes, nodes + h.numNodes);
 
+	m_mode = (SplitMode)h.splitMode;
+	m_layout = (NodeLayout)h.layout;
+	m_sahBins = h.sahBins;
+	m_maxLeafSize = h.maxLeafSize;
+	m_splitAlpha = h.splitAlpha;
+	return true;
+}
 
-void exportNode(std::ofstream &out, const Node &n)
+void BVH::serialize(std::vector<char> &out) const
 {
-	// AABB
-	float3 bmin = n.box.min;
-	float3 bmax = n.box.max;
-	write(out, bmin.x);
-	write(out, bmin.y);
-	write(out, bmin.z);
-	write(out, bmax.x);
-	write(out, bmax.y);
-	write(out, bmax.z);
-
-	// Parameters
-	write(out, n.iStart);
-    write(out, n.parent);
-	write(out, n.nPrims);
+	const size_t indexOffset = sizeof(HierarchyHeader);
+	const size_t nodeOffset = alignUp(indexOffset + m_indices.size() * sizeof(U32));
+	const size_t totalSize = nodeOffset + m_nodes.size() * sizeof(Node);
+
+	out.assign(totalSize, 0);
+	memcpy(out.data() + indexOffset, m_indices.data(), m_indices.size() * sizeof(U32));
+	memcpy(out.data() + nodeOffset, m_nodes.data(), m_nodes.size() * sizeof(Node));
+
+	HierarchyHeader h = {};
+	h.magic = HierarchyMagic;
+	h.version = HierarchyVersion;
+	h.nodeSize = sizeof(Node);
+	h.numTris = (U32)m_mesh->size();
+	h.splitMode = m_mode;
+	h.layout = m_layout;
+	h.sahBins = m_sahBins;
+	h.maxLeafSize = m_maxLeafSize;
+	h.splitAlpha = m_splitAlpha;
+	h.numIndices = m_indices.size();
+	h.numNodes = m_nodes.size();
+	h.checksum = XXH64(out.data() + indexOffset, totalSize - indexOffset, 0);
+	memcpy(out.data(), &h, sizeof(h));
 }
 
 /** Write BVH to file for later importing **/
 void BVH::exportTo(const std::string filename) const
 {
-    std::ofstream out(filename, std::ios::binary);
+	std::vector<char> data;
+	serialize(data);
 
-    if (out.good())
-    {
-		// Index list
-		write(out, (U32)m_indices.size());
-		for_each(m_indices.begin(), m_indices.end(), [&out](U32 index) { write(out, index); });
-
-		// Node list
-		write(out, (U32)m_indices.size());
-		for_each(m_nodes.begin(), m_nodes.end(), [&out](const Node &n) { exportNode(out, n); });
-    }
-    else
-    {
-        std::cout << "Could not create create file for BVH export!" << std::endl;
-    }
+	std::ofstream out(filename, std::ios::binary);
+	if (out.good())
+	{
+		out.write(data.data(), data.size());
+	}
+	else
+	{
+		std::cout << "Could not create create file for BVH export!" << std::endl;
+	}
 }
 
 // Too frequent printing is actually a bottleneck!
@@ -241,6 +552,9 @@ bool BVH::partition(BuildNode &n, SplitInfo &split)
 	case SplitMode_Sah:
 		return sahSplit(n, split);
 		break;
+	case SplitMode_BinnedSah:
+		return binnedSahSplit(n, split);
+		break;
 	case SplitMode_SpatialMedian:
 		return spatialMedianSplit(n, split);
 		break;
@@ -256,8 +570,13 @@ bool BVH::partition(BuildNode &n, SplitInfo &split)
 
 void BVH::sortReferences(U32 s, U32 e, U32 dim)
 {
-	auto start = m_refs.begin() + s;
-	auto end = m_refs.begin() + e + 1;
+	sortReferences(m_refs, s, e, dim);
+}
+
+void BVH::sortReferences(std::vector<TriRef> &refs, U32 s, U32 e, U32 dim)
+{
+	auto start = refs.begin() + s;
+	auto end = refs.begin() + e + 1;
 
 	// Sort the range [s, e[ by triangle centroid
 
@@ -317,6 +636,132 @@ bool BVH::spatialMedianSplit(BuildNode &n, SplitInfo &info)
 	return true;
 }
 
+// Centroid binning of refs [s, e] along all three axes, linear in the number of refs.
+// Cost is the unnormalized sum (areaLeft * nLeft + areaRight * nRight) * costTri.
+BVH::SplitInfo BVH::binnedSah(const std::vector<TriRef> &refs, U32 s, U32 e) const
+{
+	struct Bin
+	{
+		AABB_t bounds;
+		U32 count = 0;
+	};
+
+	// Doubled centroids, same as in sortReferences
+	float3 cmin(FLT_MAX), cmax(-FLT_MAX);
+	for (U32 i = s; i <= e; i++)
+	{
+		float3 c = refs[i].box.min + refs[i].box.max;
+		cmin = vmin(cmin, c);
+		cmax = vmax(cmax, c);
+	}
+
+	const U32 numBins = m_sahBins;
+	float3 extent = cmax - cmin;
+	float3 scale;
+	for (int dim = 0; dim < 3; dim++)
+		scale[dim] = (extent[dim] > 0.0f) ? numBins * (1.0f - 1e-5f) / extent[dim] : 0.0f;
+
+	Bin bins[3][MaxSahBins];
+	for (U32 i = s; i <= e; i++)
+	{
+		const TriRef &ref = refs[i];
+		float3 c = ref.box.min + ref.box.max;
+		for (int dim = 0; dim < 3; dim++)
+		{
+			U32 b = std::min(numBins - 1, (U32)((c[dim] - cmin[dim]) * scale[dim]));
+			bins[dim][b].bounds.expand(ref.box);
+			bins[dim][b].count++;
+		}
+	}
+
+	SplitInfo info;
+	U32 total = e - s + 1;
+	AABB_t rightBounds[MaxSahBins];
+	for (int dim = 0; dim < 3; dim++)
+	{
+		if (scale[dim] == 0.0f)
+			continue;
+
+		// Right-hand side lookup, per bin boundary
+		AABB_t rb;
+		for (U32 i = numBins - 1; i > 0; i--)
+		{
+			rb.expand(bins[dim][i].bounds);
+			rightBounds[i - 1] = rb;
+		}
+
+		// Sweep left to right
+		AABB_t lb;
+		U32 leftCount = 0;
+		for (U32 i = 1; i < numBins; i++)
+		{
+			lb.expand(bins[dim][i - 1].bounds);
+			leftCount += bins[dim][i - 1].count;
+			if (leftCount == 0 || leftCount == total)
+				continue;
+
+			F32 cost = sahParams.costTri * (lb.area() * leftCount + rightBounds[i - 1].area() * (total - leftCount));
+			if (cost < info.cost)
+			{
+				info.cost = cost;
+				info.i = leftCount;
+				info.dim = dim;
+				info.pos = cmin[dim] + i / scale[dim];
+				info.leftBounds = lb;
+				info.rightBounds = rightBounds[i - 1];
+				info.binned = true;
+			}
+		}
+	}
+
+	return info;
+}
+
+// Move refs of binned split to their sides, returns size of left group.
+// Bounds in split are estimates => recomputed by caller where needed.
+U32 BVH::partitionCentroids(std::vector<TriRef> &refs, U32 s, U32 e, const SplitInfo &split) const
+{
+	S32 dim = split.dim;
+	F32 pos = split.pos;
+	auto it = std::partition(refs.begin() + s, refs.begin() + e + 1, [dim, pos](const TriRef &r) {
+		return r.box.min[dim] + r.box.max[dim] < pos;
+	});
+	return (U32)(it - (refs.begin() + s));
+}
+
+bool BVH::binnedSahSplit(BuildNode &n, SplitInfo &info)
+{
+	F32 parentArea = n.box.area();
+	assert(parentArea > 0.0f);
+
+	F32 parentCost = sahParams.costBox + n.spannedTris() * sahParams.costTri;
+	info = binnedSah(m_refs, n.iStart, n.iEnd);
+
+	// All centroids in same spot
+	if (info.dim == -1)
+	{
+		metrics.bad_splits++;
+		return objectMedianSplit(n, info);
+	}
+
+	info.cost = 2 * sahParams.costBox + info.cost / parentArea;
+
+	// Worse than parent?
+	if (info.cost > parentCost && n.spannedTris() < MaxLeafElems)
+		return false;
+
+	// Index of last element in left group
+	U32 leftCount = partitionCentroids(m_refs, n.iStart, n.iEnd, info);
+	if (leftCount == 0 || leftCount == n.spannedTris())
+	{
+		metrics.bad_splits++;
+		return objectMedianSplit(n, info.dim, info);
+	}
+
+	info.i = n.iStart + leftCount - 1;
+	return true;
+}
+
 F32 BVH::sahCost(U32 N1, F32 area1, U32 N2, F32 area2, F32 area_root) const
 {
 	F32 lcost = N1 * area1 / area_root;
@@ -15,15 +15,37 @@ class BVH
 friend class CLContext;
 
 public:
-    BVH(std::vector<RTTriangle> *tris, SplitMode mode);
-    BVH(std::vector<RTTriangle> *tris, const std::string filename);
+    BVH(TriangleMesh *mesh, SplitMode mode, U32 sahBins = 32);
+    BVH(TriangleMesh *mesh, const std::string filename);
+    BVH(TriangleMesh *mesh, const char *data, size_t size); // serialized hierarchy
 	BVH(void) {}
 	~BVH() {}
 
     void exportTo(const std::string filename) const;
+    void serialize(std::vector<char> &out) const; // same format as exported files
+    bool isValid() const { return !m_nodes.empty(); } // false if import failed
+    SplitMode getSplitMode() const { return m_mode; }
+    U32 getSahBins() const { return m_sahBins; }
+
+    // Reorder nodes and leaf indices for better cache behavior
+    void relayout(NodeLayout layout);
+    NodeLayout getLayout() const { return m_layout; }
+    static NodeLayout layoutFromName(const std::string &name);
+
+    // Collapse binary hierarchy into W-wide nodes (W = 4 or 8)
+    // False if the result is deeper than MaxTraversalDepth
+    template <int W>
+    bool collapse(std::vector<WideNode<W>> &out) const;
+
+    // Compress collapsed nodes, child bounds stored as 8-bit offsets
+    template <int W>
+    static void quantize(const std::vector<WideNode<W>> &in, std::vector<QuantizedNode<W>> &out);
 
     AABB_t getSceneBounds(void) const;
 
+    // Deepest hierarchy covered by GPU traversal stacks, kernels built with -DBVH_MAX_DEPTH
+    static const U32 MaxTraversalDepth = 64;
+
 private:
 	void build(U32 nInd, U32 depth, F32 progressStart, F32 progressEnd);
 
@@ -31,7 +53,8 @@ protected:
 	struct SplitInfo;
 	
 	
-    void importFrom(const std::string filename);
+    bool importFrom(const std::string filename);
+    bool deserialize(const char *data, size_t size);
 	void lazyPrintBuildStatus(F32 percentage);
 
     // Convert build nodes to small nodes
@@ -46,25 +69,39 @@ protected:
 	bool objectMedianSplit(BuildNode &n, SplitInfo &split);
 	bool objectMedianSplit(BuildNode &n, U32 dim, SplitInfo &split);
 	bool sahSplit(BuildNode &n, SplitInfo &split);
+	bool binnedSahSplit(BuildNode &n, SplitInfo &split);
+	SplitInfo binnedSah(const std::vector<TriRef> &refs, U32 s, U32 e) const;
+	U32 partitionCentroids(std::vector<TriRef> &refs, U32 s, U32 e, const SplitInfo &split) const;
 	void sortReferences(U32 s, U32 e, U32 dim);
+	static void sortReferences(std::vector<TriRef> &refs, U32 s, U32 e, U32 dim);
 
 	F32 sahCost(U32 N1, F32 area1, U32 N2, F32 area2, F32 area_root) const;
+	F32 treeSahCost() const;
+	const char *splitModeName() const;
+	template <int W>
+	U32 collapseNode(U32 ni, U32 depth, U32 &maxDepth, std::vector<WideNode<W>> &out) const;
+	U32 relayoutNode(U32 ni, S32 parentId, std::vector<Node> &nodes, std::vector<U32> &indices) const;
 	void buildBoxLookup(BuildNode &n);
 	AABB_t centroudBounds(std::vector<TriRef>::const_iterator begin, std::vector<TriRef>::const_iterator end) const;
 
-	std::vector<RTTriangle>* m_triangles;
+	TriangleMesh* m_mesh;
 	std::vector<U32> m_indices;
 	std::vector<TriRef> m_refs;
 	std::vector<BuildNode> m_build_nodes;
 	std::vector<Node> m_nodes;
 	std::vector<AABB_t> rightBoxes; // SAH builder optimization
 	U32 nodes = 0;
-	SplitMode m_mode;
+	SplitMode m_mode = SplitMode_Sah;
+	NodeLayout m_layout = NodeLayout_DepthFirst;
+	U32 m_sahBins = 32; // SplitMode_BinnedSah
+	U32 m_maxLeafSize = MaxLeafElems;
+	F32 m_splitAlpha = 0.0f; // SBVH spatial split threshold, 0 => object splits only
 
 	enum
 	{
 		MaxLeafElems = 8,
-		MaxDepth = 64
+		MaxDepth = MaxTraversalDepth,
+		MaxSahBins = 256
 	};
 
 	struct
@@ -88,8 +125,9 @@ protected:
 		F32 cost;
 		AABB_t leftBounds;
 		AABB_t rightBounds;
+		bool binned; // found by centroid binning => refs not sorted
 
-		SplitInfo(void) : i(-1), dim(-1), cost(FLT_MAX) {}
+		SplitInfo(void) : i(-1), dim(-1), cost(FLT_MAX), binned(false) {}
 	};
 
 	S32 buildPercentage = -1; // for printing sparingly
@@ -6,13 +6,4 @@ void BuildNode::computeBB(std::vector<TriRef> &refs) {
 	for (U32 i = iStart; i <= iEnd; i++) {
 		box.expand(refs[i].box);
 	}
-}
-
-void SBVHNode::deleteTree() {
-	if (!this->isLeaf()) {
-		leftChild->deleteTree();
-		rightChild->deleteTree();
-	}
-
-	delete this;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+#include <algorithm>
+#include <utility>
 #include "rtutil.hpp"
 #include "math/float3.hpp"
 
@@ -11,7 +14,7 @@ struct TriRef
 
 	TriRef(void) {}
 	TriRef(const TriRef &other) : ind(other.ind), box(other.box), pos(other.pos) {}
-	TriRef(U32 i, RTTriangle &tri) : ind(i), box(tri.min(), tri.max()), pos(tri.centroid()) {}
+	TriRef(U32 i, const TriangleMesh &mesh) : ind(i), box(mesh.min(i), mesh.max(i)), pos(mesh.centroid(i)) {}
 };
 
 /* Fat node used in BVH construction */
@@ -38,12 +41,49 @@ struct SBVHNode
 	SBVHNode *rightChild = nullptr;
 	inline U32 spannedTris() const { return hi - lo; }
 	inline bool isLeaf() const { return !leftChild && !rightChild; }
-	void deleteTree();
 
 	SBVHNode(const AABB_t &b, SBVHNode* l, SBVHNode* r) : box(b), leftChild(l), rightChild(r) {} // inner node
 	SBVHNode(const AABB_t &b, int l, int h) : box(b), lo(l), hi(h) {} // leaf node
 };
 
+/* Bump allocator for SBVH build nodes, all nodes released at once */
+class SBVHNodeArena
+{
+public:
+	template <typename... Args>
+	SBVHNode* alloc(Args&&... args)
+	{
+		// Reserved blocks never reallocate => stable pointers
+		if (blocks.empty() || blocks.back().size() == blocks.back().capacity())
+		{
+			size_t size = MinBlockSize;
+			if (!blocks.empty())
+				size = std::min(2 * blocks.back().capacity(), size_t(MaxBlockSize)); // copy, no ODR-use before C++17
+			blocks.emplace_back();
+			blocks.back().reserve(size);
+		}
+
+		blocks.back().emplace_back(std::forward<Args>(args)...);
+		return &blocks.back().back();
+	}
+
+	// Take ownership of nodes allocated by other arena
+	void merge(SBVHNodeArena &other)
+	{
+		for (auto &b : other.blocks)
+			blocks.push_back(std::move(b));
+		other.blocks.clear();
+	}
+
+	void clear() { blocks.clear(); blocks.shrink_to_fit(); }
+
+private:
+	static constexpr size_t MinBlockSize = 64;
+	static constexpr size_t MaxBlockSize = 1 << 16;
+
+	std::vector<std::vector<SBVHNode>> blocks;
+};
+
 /* Small node used in BVH traversal */
 struct Node
 {
@@ -54,4 +94,29 @@ struct Node
 		U32 rightChild; // internal node, index into node vector (left child always current + 1)
 	};
 	U8 nPrims = 0;		// 0 for interior nodes
+};
+
+/* Wide node used in BVH4/BVH8 traversal, matches GPUWideNode */
+template <int W>
+struct WideNode
+{
+	F32 bmin[3][W];		// child bounds, SoA
+	F32 bmax[3][W];
+	U32 child[W];		// inner child: index into node vector, leaf child: index into index list
+	U8 nPrims[W];		// 0 for inner children
+	U32 numChildren = 0;
+};
+
+/* Wide node with child bounds quantized to 8 bits relative to node box, matches GPUWideNode (BVH_QUANTIZED) */
+template <int W>
+struct QuantizedNode
+{
+	F32 origin[3];		// min corner of node box
+	U8 exp[3];			// per-axis scale 2^(exp - 127), i.e. float exponent bits
+	U8 pad = 0;
+	U8 qmin[3][W];		// child bounds: origin + q * scale
+	U8 qmax[3][W];
+	U32 child[W];		// inner child: index into node vector, leaf child: index into index list
+	U8 nPrims[W];		// 0 for inner children
+	U32 numChildren = 0;
 };
\ No newline at end of file
@@ -9,11 +9,13 @@
 #include "texture.hpp"
 #include "window.hpp"
 #include "kernel_impl.hpp"
+#include "taskpool.hpp"
 #include "IL/ilu.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h> // texture conversion stuff
 #include <string>
 #include <vector>
+#include <chrono>
 
 #if defined(__APPLE__)
 #include <OpenCL/cl_gl_ext.h>
@@ -25,7 +27,9 @@
 #include <Windows.h>
 #endif
 
-CLContext::CLContext()
+CLContext::~CLContext() = default;
+
+CLContext::CLContext(bool headless) : headless(headless)
 {
     printDevices();
 
@@ -71,14 +75,20 @@ CLContext::CLContext()
         };
     #endif
 
+    // Headless: no GL context to share with
+    cl_context_properties plainProps[] = {
+        CL_CONTEXT_PLATFORM, (cl_context_properties)platform(),
+        0
+    };
+
     // Select correct device from context based on settings
     device = getDeviceByName(clDevices, Settings::getInstance().getDeviceName());
-    std::cout << "DEVICE: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+    std::cout << "DEVICE: " << device.getInfo<CL_DEVICE_NAME>() << (headless ? " (headless)" : "") << std::endl;
 
     // Restrict context to selected device
     clDevices = { device };
-    context = cl::Context(clDevices, props, NULL, NULL, &err);
-    verify("Failed to create shared context");
+    context = cl::Context(clDevices, headless ? plainProps : props, NULL, NULL, &err);
+    verify(headless ? "Failed to create context" : "Failed to create shared context");
 
     // Create command queue for context
     cmdQueue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
@@ -89,7 +99,7 @@ CLContext::CLContext()
     NUM_TASKS = bufferSize;
 }
 
-void CLContext::setup(PTWindow *window)
+void CLContext::setup(PTWindow *window, unsigned int width, unsigned int height)
 {
     this->window = window;
 
@@ -106,7 +116,10 @@ void CLContext::setup(PTWindow *window)
     setupStats();
 
     // Create OpenCL buffer from OpenGL PBO
-    setupPixelStorage(window);
+    if (headless)
+        setupPixelStorage(width, height);
+    else
+        setupPixelStorage(window);
 
     // Allocate device memory for scene
     setupScene();
@@ -118,16 +131,59 @@ void CLContext::setup(PTWindow *window)
 
 void CLContext::setupKernels()
 {
-    // Microkernels
-	setupResetKernel();
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    if (!kernelPool)
+        kernelPool.reset(new TaskPool());
+
+    // Compiled concurrently, workers run their newest tasks first
+    // => kernels of the current integrator are submitted last
+    if (useWavefront)
+    {
+        setupMicroKernels();
+        setupPickKernel();
+        setupWavefrontKernels();
+    }
+    else
+    {
+        setupWavefrontKernels();
+        setupPickKernel();
+        setupMicroKernels();
+    }
+    setupPostprocessKernel();
+
+    // Rendering can start when these are done, the rest finish in the background
+    std::vector<flt::Kernel*> needed = (useWavefront) ?
+        std::vector<flt::Kernel*>{ wf_reset, wf_advance, wf_extension, wf_raygen, wf_logic, wf_shadow } :
+        std::vector<flt::Kernel*>{ mk_reset, mk_raygen, mk_next_vertex, mk_sample_bsdf, mk_splat, mk_splat_preview };
+    if (useWavefront)
+        appendWfMaterialKernels(needed);
+    needed.push_back(mk_postprocess);
+
+    if (window)
+        window->showMessage("Building kernels");
+    for (flt::Kernel *kernel : needed)
+        kernel->wait();
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::cout << ((useWavefront) ? "Wavefront" : "Microkernel") << " kernels ready after "
+              << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+}
+
+void CLContext::setupMicroKernels()
+{
+    setupResetKernel();
     setupRayGenKernel();
     setupNextVertexKernel();
     setupBsdfSampleKernel();
     setupSplatKernel();
     setupSplatPreviewKernel();
+}
 
-    // Wavefront kernels
+void CLContext::setupWavefrontKernels()
+{
     setupWfResetKernel();
+    setupWfAdvanceKernel();
     setupWfExtKernel();
     setupWfRaygenKernel();
     setupWfLogicKernel();
@@ -138,10 +194,31 @@ void CLContext::setupKernels()
     setupWfGGXRefrKernel();
     setupWfDeltaKernel();
     setupWfAllMaterialsKernel();
+    setupWfRaySortKernels();
+    setupWfMatSortKernels();
+}
 
-    // Other
-    setupPickKernel();
-    setupPostprocessKernel();
+// Material kernels enqueued by enqueueWfMaterialKernels() in current mode and scene
+void CLContext::appendWfMaterialKernels(std::vector<flt::Kernel*> &kernels)
+{
+    Tracer *tracer = static_cast<Tracer*>(flt::Kernel::getUserPointer());
+    if (!tracer->getParams().wfSeparateQueues)
+    {
+        kernels.push_back(wf_mat_all);
+        return;
+    }
+
+    if (materialTypes & BXDF_DIFFUSE) kernels.push_back(wf_diffuse);
+    if (materialTypes & BXDF_GLOSSY) kernels.push_back(wf_glossy);
+    if (materialTypes & BXDF_GGX_ROUGH_REFLECTION) kernels.push_back(wf_ggx_refl);
+    if (materialTypes & BXDF_GGX_ROUGH_DIELECTRIC) kernels.push_back(wf_ggx_refr);
+    if (materialTypes & (BXDF_IDEAL_REFLECTION | BXDF_IDEAL_DIELECTRIC)) kernels.push_back(wf_delta);
+}
+
+// Global size of kernels compacting queues per work-group
+inline cl_uint roundUpToGroup(cl_uint n)
+{
+    return ((n + WF_COMPACT_GROUP_SIZE - 1) / WF_COMPACT_GROUP_SIZE) * WF_COMPACT_GROUP_SIZE;
 }
 
 // For copying SoA data to host
@@ -174,8 +251,16 @@ void CLContext::initMCBuffers()
     // TODO: CL_MEM_USE_HOST_PTR for seeing queues on host
     deviceBuffers.currentPixelIdx = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, 1 * sizeof(cl_uint), (void*)&pixelIndex, &err);
     deviceBuffers.queueCounters = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(QueueCounters), (void*)&hostCounters, &err);
+    deviceBuffers.wfStatsRing = cl::Buffer(context, CL_MEM_READ_WRITE, WF_STATS_RING_SIZE * sizeof(RenderStats), NULL, &err);
+    deviceBuffers.wfStatsHead = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, 1 * sizeof(cl_uint), (void*)&wfStatsTail, &err);
     deviceBuffers.raygenQueue = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
     deviceBuffers.extensionQueue = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
+    deviceBuffers.sortedExtensionQueue = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
+    deviceBuffers.rayKeys = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
+    deviceBuffers.rayBins = cl::Buffer(context, CL_MEM_READ_WRITE, WF_RAY_SORT_BINS * sizeof(cl_uint), NULL, &err);
+    deviceBuffers.matSortPaths = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
+    deviceBuffers.matSortKeys = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
+    deviceBuffers.matBins = cl::Buffer(context, CL_MEM_READ_WRITE, WF_MAT_SORT_BINS * sizeof(cl_uint), NULL, &err);
     deviceBuffers.shadowQueue = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
     deviceBuffers.diffuseMatQueue = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
     deviceBuffers.glossyMatQueue = cl::Buffer(context, CL_MEM_READ_WRITE, NUM_TASKS * sizeof(cl_uint), NULL, &err);
@@ -194,8 +279,16 @@ void CLContext::setKernelBuildSettings()
     Settings &s = Settings::getInstance();
     if (s.getUseBitstack()) buildOpts += " -DUSE_BITSTACK";
     if (s.getUseSoA()) buildOpts += " -DUSE_SOA";
+    const bool wideBvh = (s.getBvhWidth() > 2 || s.getBvhQuantized()) && !wideBvhFallback;
+    if (wideBvh) buildOpts += " -DBVH_WIDTH=" + std::to_string(s.getBvhWidth());
+    buildOpts += " -DBVH_MAX_DEPTH=" + std::to_string(BVH::MaxTraversalDepth);
+    if (wideBvh && s.getBvhQuantized()) buildOpts += " -DBVH_QUANTIZED";
+    if (s.getEnvMapTableScale() > 1) buildOpts += " -DENV_MAP_TABLE_SCALE=" + std::to_string(s.getEnvMapTableScale());
     if (platformIsNvidia(platform)) buildOpts += " -DNVIDIA -cl-nv-verbose";
 
+    // Without warp intrinsics queues are compacted per work-group of fixed size
+    groupCompaction = !platformIsNvidia(platform);
+
     // Static, shared by all kernels
     flt::Kernel::setBuildOptions(buildOpts);
 }
@@ -205,8 +298,7 @@ void CLContext::setupPickKernel()
     if (!kernel_pick)
         kernel_pick = new PickKernel();
 
-    window->showMessage("Building kernel", "kernel_pick");
-    kernel_pick->build("src/kernel_pick.cl", "pick", context, device, platform);
+    kernel_pick->build("src/kernel_pick.cl", "pick", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfExtKernel()
@@ -214,8 +306,7 @@ void CLContext::setupWfExtKernel()
     if (!wf_extension)
         wf_extension = new WFExtensionKernel();
 
-    window->showMessage("Building kernel", "wf_extrays");
-    wf_extension->build("src/wf_extrays.cl", "traceExtension", context, device, platform);
+    wf_extension->build("src/wf_extrays.cl", "traceExtension", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfLogicKernel()
@@ -223,8 +314,7 @@ void CLContext::setupWfLogicKernel()
     if (!wf_logic)
         wf_logic = new WFLogicKernel();
 
-    window->showMessage("Building kernel", "wf_logic");
-    wf_logic->build("src/wf_logic.cl", "logic", context, device, platform);
+    wf_logic->build("src/wf_logic.cl", "logic", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfShadowKernel()
@@ -232,8 +322,7 @@ void CLContext::setupWfShadowKernel()
     if (!wf_shadow)
         wf_shadow = new WFShadowKernel();
 
-    window->showMessage("Building kernel", "wf_shadowrays");
-    wf_shadow->build("src/wf_shadowrays.cl", "traceShadow", context, device, platform);
+    wf_shadow->build("src/wf_shadowrays.cl", "traceShadow", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfRaygenKernel()
@@ -241,8 +330,7 @@ void CLContext::setupWfRaygenKernel()
     if (!wf_raygen)
         wf_raygen = new WFRaygenKernel();
 
-    window->showMessage("Building kernel", "wf_raygen");
-    wf_raygen->build("src/wf_raygen.cl", "genRays", context, device, platform);
+    wf_raygen->build("src/wf_raygen.cl", "genRays", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfDiffuseKernel()
@@ -250,8 +338,7 @@ void CLContext::setupWfDiffuseKernel()
     if (!wf_diffuse)
         wf_diffuse = new WFDiffuseKernel();
 
-    window->showMessage("Building kernel", "wf_mat_diffuse");
-    wf_diffuse->build("src/wf_mat_diffuse.cl", "wavefrontDiffuse", context, device, platform);
+    wf_diffuse->build("src/wf_mat_diffuse.cl", "wavefrontDiffuse", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfGlossyKernel()
@@ -259,8 +346,7 @@ void CLContext::setupWfGlossyKernel()
     if (!wf_glossy)
         wf_glossy = new WFGlossyKernel();
 
-    window->showMessage("Building kernel", "wf_mat_glossy");
-    wf_glossy->build("src/wf_mat_glossy.cl", "wavefrontGlossy", context, device, platform);
+    wf_glossy->build("src/wf_mat_glossy.cl", "wavefrontGlossy", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfGGXReflKernel()
@@ -268,8 +354,7 @@ void CLContext::setupWfGGXReflKernel()
     if (!wf_ggx_refl)
         wf_ggx_refl = new WFGGXReflKernel();
 
-    window->showMessage("Building kernel", "wf_mat_ggx_reflection");
-    wf_ggx_refl->build("src/wf_mat_ggx_reflection.cl", "wavefrontGGXReflection", context, device, platform);
+    wf_ggx_refl->build("src/wf_mat_ggx_reflection.cl", "wavefrontGGXReflection", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfGGXRefrKernel()
@@ -277,8 +362,7 @@ void CLContext::setupWfGGXRefrKernel()
     if (!wf_ggx_refr)
         wf_ggx_refr = new WFGGXRefrKernel();
 
-    window->showMessage("Building kernel", "wf_mat_ggx_refraction");
-    wf_ggx_refr->build("src/wf_mat_ggx_refraction.cl", "wavefrontGGXRefraction", context, device, platform);
+    wf_ggx_refr->build("src/wf_mat_ggx_refraction.cl", "wavefrontGGXRefraction", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfDeltaKernel()
@@ -286,8 +370,7 @@ void CLContext::setupWfDeltaKernel()
     if (!wf_delta)
         wf_delta = new WFDeltaKernel();
 
-    window->showMessage("Building kernel", "wf_mat_delta");
-    wf_delta->build("src/wf_mat_delta.cl", "wavefrontDelta", context, device, platform);
+    wf_delta->build("src/wf_mat_delta.cl", "wavefrontDelta", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfAllMaterialsKernel()
@@ -295,8 +378,7 @@ void CLContext::setupWfAllMaterialsKernel()
     if (!wf_mat_all)
         wf_mat_all = new WFAllMaterialsKernel();
 
-    window->showMessage("Building kernel", "wf_mat_all");
-    wf_mat_all->build("src/wf_mat_all.cl", "wavefrontAllMaterials", context, device, platform);
+    wf_mat_all->build("src/wf_mat_all.cl", "wavefrontAllMaterials", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupWfResetKernel()
@@ -304,8 +386,43 @@ void CLContext::setupWfResetKernel()
     if (!wf_reset)
         wf_reset = new WFResetKernel();
     
-    window->showMessage("Building kernel", "wf_reset");
-    wf_reset->build("src/wf_reset.cl", "reset", context, device, platform);
+    wf_reset->build("src/wf_reset.cl", "reset", context, device, platform, true, kernelPool.get());
+}
+
+void CLContext::setupWfAdvanceKernel()
+{
+    if (!wf_advance)
+        wf_advance = new WFAdvanceKernel();
+
+    wf_advance->build("src/wf_advance.cl", "advance", context, device, platform, true, kernelPool.get());
+}
+
+void CLContext::setupWfRaySortKernels()
+{
+    if (!wf_ray_keys)
+        wf_ray_keys = new WFRayKeysKernel();
+    if (!wf_ray_scan)
+        wf_ray_scan = new WFRayScanKernel();
+    if (!wf_ray_scatter)
+        wf_ray_scatter = new WFRayScatterKernel();
+
+    wf_ray_keys->build("src/wf_raysort.cl", "rayKeys", context, device, platform, true, kernelPool.get());
+    wf_ray_scan->build("src/wf_raysort.cl", "scanRayBins", context, device, platform, true, kernelPool.get());
+    wf_ray_scatter->build("src/wf_raysort.cl", "scatterRays", context, device, platform, true, kernelPool.get());
+}
+
+void CLContext::setupWfMatSortKernels()
+{
+    if (!wf_mat_keys)
+        wf_mat_keys = new WFMatKeysKernel();
+    if (!wf_mat_scan)
+        wf_mat_scan = new WFMatScanKernel();
+    if (!wf_mat_scatter)
+        wf_mat_scatter = new WFMatScatterKernel();
+
+    wf_mat_keys->build("src/wf_matsort.cl", "materialKeys", context, device, platform, true, kernelPool.get());
+    wf_mat_scan->build("src/wf_matsort.cl", "scanMaterialBins", context, device, platform, true, kernelPool.get());
+    wf_mat_scatter->build("src/wf_matsort.cl", "scatterMaterials", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupResetKernel()
@@ -313,8 +430,7 @@ void CLContext::setupResetKernel()
     if (!mk_reset)
         mk_reset = new MKResetKernel();
 
-    window->showMessage("Building kernel", "mk_reset");
-    mk_reset->build("src/mk_reset.cl", "reset", context, device, platform);
+    mk_reset->build("src/mk_reset.cl", "reset", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupRayGenKernel()
@@ -322,8 +438,7 @@ void CLContext::setupRayGenKernel()
     if (!mk_raygen)
         mk_raygen = new MKRaygenKernel();
 
-    window->showMessage("Building kernel", "mk_raygen");
-    mk_raygen->build("src/mk_raygen.cl", "genCameraRays", context, device, platform);
+    mk_raygen->build("src/mk_raygen.cl", "genCameraRays", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupNextVertexKernel()
@@ -331,8 +446,7 @@ void CLContext::setupNextVertexKernel()
     if (!mk_next_vertex)
         mk_next_vertex = new MKNextVertexKernel();
 
-    window->showMessage("Building kernel", "mk_next_vertex");
-    mk_next_vertex->build("src/mk_next_vertex.cl", "nextVertex", context, device, platform);
+    mk_next_vertex->build("src/mk_next_vertex.cl", "nextVertex", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupBsdfSampleKernel()
@@ -340,8 +454,7 @@ void CLContext::setupBsdfSampleKernel()
     if (!mk_sample_bsdf)
         mk_sample_bsdf = new MKSampleBSDFKernel();
 
-    window->showMessage("Building kernel", "mk_sample_bsdf");
-    mk_sample_bsdf->build("src/mk_sample_bsdf.cl", "sampleBsdf", context, device, platform);
+    mk_sample_bsdf->build("src/mk_sample_bsdf.cl", "sampleBsdf", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupSplatKernel()
@@ -349,8 +462,7 @@ void CLContext::setupSplatKernel()
     if (!mk_splat)
         mk_splat = new MKSplatKernel();
 
-    window->showMessage("Building kernel", "mk_splat");
-    mk_splat->build("src/mk_splat.cl", "splat", context, device, platform);
+    mk_splat->build("src/mk_splat.cl", "splat", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupSplatPreviewKernel()
@@ -358,8 +470,7 @@ void CLContext::setupSplatPreviewKernel()
     if (!mk_splat_preview)
         mk_splat_preview = new MKSplatPreviewKernel();
 
-    window->showMessage("Building kernel", "mk_splat_preview");
-    mk_splat_preview->build("src/mk_splat_preview.cl", "splatPreview", context, device, platform);
+    mk_splat_preview->build("src/mk_splat_preview.cl", "splatPreview", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupPostprocessKernel()
@@ -367,8 +478,7 @@ void CLContext::setupPostprocessKernel()
     if (!mk_postprocess)
         mk_postprocess = new MKPostprocessKernel();
 
-    window->showMessage("Building kernel", "mk_postprocess");
-    mk_postprocess->build("src/mk_postprocess.cl", "process", context, device, platform);
+    mk_postprocess->build("src/mk_postprocess.cl", "process", context, device, platform, true, kernelPool.get());
 }
 
 void CLContext::setupPixelStorage(PTWindow *window)
@@ -378,7 +488,6 @@ void CLContext::setupPixelStorage(PTWindow *window)
         sharedMemory.clear(); // memory freed by cl-cpp-wrapper
     }
 
-    GLuint *tex_arr = window->getTexPtr();
     unsigned int numPixels = window->getTexWidth() * window->getTexHeight();
 
     deviceBuffers.pixelBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numPixels * sizeof(cl_float) * 4, NULL, &err); // microkernel pixel buffer
@@ -390,6 +499,28 @@ void CLContext::setupPixelStorage(PTWindow *window)
     sharedMemory = { deviceBuffers.previewBuffer, deviceBuffers.denoiserAlbedoBufferGL, deviceBuffers.denoiserNormalBufferGL };
     verify("CL pixel storage creation failed!");
 
+    updatePixelStorageArgs();
+}
+
+// Headless: preview and denoiser outputs are plain device buffers
+void CLContext::setupPixelStorage(unsigned int width, unsigned int height)
+{
+    sharedMemory.clear();
+    size_t numBytes = (size_t)width * height * sizeof(cl_float) * 4;
+
+    deviceBuffers.pixelBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numBytes, NULL, &err);
+    deviceBuffers.denoiserAlbedoBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numBytes, NULL, &err);
+    deviceBuffers.denoiserNormalBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numBytes, NULL, &err);
+    deviceBuffers.previewBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, numBytes, NULL, &err);
+    deviceBuffers.denoiserAlbedoBufferGL = cl::Buffer(context, CL_MEM_READ_WRITE, numBytes, NULL, &err);
+    deviceBuffers.denoiserNormalBufferGL = cl::Buffer(context, CL_MEM_READ_WRITE, numBytes, NULL, &err);
+    verify("CL pixel storage creation failed!");
+
+    updatePixelStorageArgs();
+}
+
+void CLContext::updatePixelStorageArgs()
+{
 	// Set new kernel args (pointers might have changed)
 	err = 0;
 	if (mk_splat)
@@ -440,15 +571,18 @@ void CLContext::saveImage(std::string filename, const RenderParams &params)
 
     bool hdr = endsWith(filename, ".hdr") || endsWith(filename, ".HDR");
 
-    glFinish();
+    if (!headless)
+        glFinish();
 
     // Copy data to host
     err = 0;
-    err |= cmdQueue.enqueueAcquireGLObjects(&sharedMemory);
+    if (!sharedMemory.empty())
+        err |= cmdQueue.enqueueAcquireGLObjects(&sharedMemory);
 
     cl::Buffer &pixels = (hdr) ? deviceBuffers.pixelBuffer : deviceBuffers.previewBuffer;
     err |= cmdQueue.enqueueReadBuffer(pixels, CL_TRUE, 0, numFloats * sizeof(float), dataFloats.get());
-    err |= cmdQueue.enqueueReleaseGLObjects(&sharedMemory);
+    if (!sharedMemory.empty())
+        err |= cmdQueue.enqueueReleaseGLObjects(&sharedMemory);
     err |= cmdQueue.finish();
     verify("Failed to copy pixel buffer to host!");
     
@@ -517,30 +651,30 @@ void CLContext::createEnvMap(EnvironmentMap *map)
 	int width = map->getWidth(), height = map->getHeight();
 	float *data = map->getData();
 
-    // Convert rgb to rgba (OpenCL doesn't support floats for RGB-images)
-    float *rgba = new float[width * height * 4];
-    for (int h = 0; h < height; h++)
-    {
-        for (int w = 0; w < width; w++)
-        {
-            // RGB
-            for (int c = 0; c < 3; c++) // color channels
-            {
-                rgba[(h * width + w) * 4 + c] = data[(h * width + w) * 3 + c];
-            }
-            // Alpha
-            rgba[(h * width + w) * 4 + 3] = 1.0f;
-        }
-    }
-
-	// Upload rgb colors
-    const cl::ImageFormat format(CL_RGBA, CL_FLOAT);
-    deviceBuffers.environmentMap = cl::Image2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, format, width, height, 0, rgba, &err);
+	// Upload colors, already RGBA (OpenCL doesn't support floats for RGB-images)
+	const bool halfFloat = Settings::getInstance().getEnvMapHalfFloat();
+	std::vector<cl_half> halfData;
+	if (halfFloat)
+	{
+		halfData.resize((size_t)width * height * 4);
+		TaskPool pool;
+		pool.parallelFor(height, [&](size_t y)
+		{
+			const size_t begin = y * width * 4, end = begin + width * 4;
+			for (size_t i = begin; i < end; i++)
+				halfData[i] = floatToHalf(data[i]);
+		});
+	}
+
+    const cl::ImageFormat format(CL_RGBA, (halfFloat) ? CL_HALF_FLOAT : CL_FLOAT);
+    void *pixels = (halfFloat) ? (void*)halfData.data() : (void*)data;
+    deviceBuffers.environmentMap = cl::Image2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, format, width, height, 0, pixels, &err);
     verify("Environment map creation failed!");
 
-	// Upload probability and alias tables for importance sampling
-	size_t pBytes = width * height * sizeof(float);
-	size_t aBytes = width * height * sizeof(int);
+	// Upload probability and alias tables for importance sampling, built at table resolution
+	const size_t tableSize = (size_t)map->getTableWidth() * map->getTableHeight();
+	size_t pBytes = tableSize * sizeof(float);
+	size_t aBytes = tableSize * sizeof(int);
     deviceBuffers.probTable = cl::Buffer(context, CL_MEM_READ_ONLY, pBytes, NULL, &err);
     deviceBuffers.aliasTable = cl::Buffer(context, CL_MEM_READ_ONLY, aBytes, NULL, &err);
     deviceBuffers.pdfTable = cl::Buffer(context, CL_MEM_READ_ONLY, pBytes, NULL, &err);
@@ -551,8 +685,10 @@ void CLContext::createEnvMap(EnvironmentMap *map)
 	err |= cmdQueue.enqueueWriteBuffer(deviceBuffers.pdfTable, CL_TRUE, 0, pBytes, map->getPdfTable());
 	verify("Env map IS table writing failed");
 
-	// Cleanup
-    delete[] rgba;
+	const size_t colorBytes = (size_t)width * height * 4 * ((halfFloat) ? sizeof(cl_half) : sizeof(cl_float));
+	std::cout << "Environment map: " << colorBytes / (1 << 20) << " MiB " << ((halfFloat) ? "half" : "float")
+	          << " image, " << (2 * pBytes + aBytes) / (1 << 20) << " MiB sampling tables ["
+	          << map->getTableWidth() << ", " << map->getTableHeight() << "]" << std::endl;
 
     // Update env map references
     setupKernels();
@@ -569,92 +705,171 @@ void CLContext::setupScene()
 // Upload BVH data, geometry and materials to GPU
 void CLContext::uploadSceneData(BVH *bvh, Scene *scene)
 {
-    std::vector<RTTriangle> *tris = bvh->m_triangles;
-    std::vector<cl_uint> *indices = &bvh->m_indices; 
-    std::vector<Node> *nodes = &bvh->m_nodes;
+    TriangleMesh *mesh = bvh->m_mesh;
     std::vector<Material> *materials = &scene->getMaterials();
+    materialTypes = scene->getMaterialTypes();
+    numMaterials = materials->size();
 
-    size_t t_bytes = tris->size() * sizeof(RTTriangle);
-    size_t i_bytes = indices->size() * sizeof(cl_uint);
-    size_t n_bytes = nodes->size() * sizeof(Node);
+    size_t v_bytes = mesh->vertices.size() * sizeof(VertexPNT);
+    size_t t_bytes = mesh->triangles.size() * sizeof(RTTriangle);
     size_t m_bytes = materials->size() * sizeof(Material);
 
     // Allocate memory for buffers
+    deviceBuffers.vertexBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, v_bytes, NULL, &err);
+    verify("Vertex buffer creation failed!");
+
     deviceBuffers.triangleBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, t_bytes, NULL, &err);
     verify("Triangle buffer creation failed!");
 
-    deviceBuffers.indexBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, i_bytes, NULL, &err);
-    verify("Index buffer creation failed!");
-
-    deviceBuffers.nodeBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, n_bytes, NULL, &err);
-    verify("Node buffer creation failed!");
-
     if(m_bytes > 0) deviceBuffers.materialBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, m_bytes, NULL, &err);
     verify("Material buffer creation failed!");
 
 
     // Write data to buffers
-    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.triangleBuffer, CL_TRUE, 0, t_bytes, tris->data());
-    verify("Triangle buffer writing failed!");
-
-    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.indexBuffer, CL_TRUE, 0, i_bytes, indices->data());
-    verify("Index buffer writing failed!");
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.vertexBuffer, CL_TRUE, 0, v_bytes, mesh->vertices.data());
+    verify("Vertex buffer writing failed!");
 
-    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.nodeBuffer, CL_TRUE, 0, n_bytes, nodes->data());
-    verify("Node buffer writing failed!");
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.triangleBuffer, CL_TRUE, 0, t_bytes, mesh->triangles.data());
+    verify("Triangle buffer writing failed!");
 
     if(m_bytes > 0) err = cmdQueue.enqueueWriteBuffer(deviceBuffers.materialBuffer, CL_TRUE, 0, m_bytes, materials->data());
     verify("Material buffer writing failed!");
 
+    std::cout << "Geometry: " << mesh->vertices.size() << " vertices (" << v_bytes / (1024.0 * 1024.0) << " MB), "
+              << mesh->triangles.size() << " triangles (" << t_bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+
     // Pack texture data into aggregate array
     packTextures(scene);
 
+    // Sets up kernel arguments
+    uploadHierarchy(bvh);
+}
+
+// Collapsed (and optionally quantized) node data
+template <int W>
+static bool packWideNodes(const BVH *bvh, bool quantized, std::vector<char> &data)
+{
+    std::vector<WideNode<W>> nodes;
+    if (!bvh->collapse(nodes))
+        return false;
+
+    if (quantized)
+    {
+        std::vector<QuantizedNode<W>> qnodes;
+        BVH::quantize(nodes, qnodes);
+        data.assign((const char*)qnodes.data(), (const char*)(qnodes.data() + qnodes.size()));
+    }
+    else
+    {
+        data.assign((const char*)nodes.data(), (const char*)(nodes.data() + nodes.size()));
+    }
+
+    return true;
+}
+
+// Replace node and index buffers, e.g. when a better hierarchy has been built
+void CLContext::uploadHierarchy(BVH *bvh)
+{
+    std::vector<cl_uint> *indices = &bvh->m_indices; 
+    std::vector<Node> *nodes = &bvh->m_nodes;
+
+    size_t i_bytes = indices->size() * sizeof(cl_uint);
+    size_t n_bytes = nodes->size() * sizeof(Node);
+    const void *n_data = nodes->data();
+
+    // Cached hierarchies stay binary, collapsed on upload
+    std::vector<char> wideNodes;
+    Settings &s = Settings::getInstance();
+    bool fallback = false;
+    if (s.getBvhWidth() > 2 || s.getBvhQuantized())
+    {
+        bool packed = false;
+        switch (s.getBvhWidth())
+        {
+        case 2: packed = packWideNodes<2>(bvh, s.getBvhQuantized(), wideNodes); break;
+        case 4: packed = packWideNodes<4>(bvh, s.getBvhQuantized(), wideNodes); break;
+        case 8: packed = packWideNodes<8>(bvh, s.getBvhQuantized(), wideNodes); break;
+        }
+
+        if (packed)
+        {
+            n_bytes = wideNodes.size();
+            n_data = wideNodes.data();
+        }
+        else
+        {
+            std::cout << "WARN: Collapsed BVH deeper than " << BVH::MaxTraversalDepth << " levels, falling back to binary nodes" << std::endl;
+            fallback = true;
+        }
+    }
+
+    // Node layout changed, kernels rebuilt by setupKernels() below
+    if (fallback != wideBvhFallback)
+    {
+        wideBvhFallback = fallback;
+        setKernelBuildSettings();
+    }
+
+    // Positions in leaf order, no index indirection during traversal
+    const TriangleMesh *mesh = bvh->m_mesh;
+    std::vector<LeafTriangle> leafTris(indices->size());
+    for (size_t i = 0; i < indices->size(); i++)
+    {
+        const U32 t = (*indices)[i];
+        leafTris[i].v0 = mesh->pos(t, 0);
+        leafTris[i].e1 = mesh->pos(t, 1) - mesh->pos(t, 0);
+        leafTris[i].e2 = mesh->pos(t, 2) - mesh->pos(t, 0);
+    }
+    size_t l_bytes = leafTris.size() * sizeof(LeafTriangle);
+
+    deviceBuffers.indexBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, i_bytes, NULL, &err);
+    verify("Index buffer creation failed!");
+
+    deviceBuffers.leafTriangleBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, l_bytes, NULL, &err);
+    verify("Leaf triangle buffer creation failed!");
+
+    deviceBuffers.nodeBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, n_bytes, NULL, &err);
+    verify("Node buffer creation failed!");
+
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.indexBuffer, CL_TRUE, 0, i_bytes, indices->data());
+    verify("Index buffer writing failed!");
+
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.leafTriangleBuffer, CL_TRUE, 0, l_bytes, leafTris.data());
+    verify("Leaf triangle buffer writing failed!");
+
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.nodeBuffer, CL_TRUE, 0, n_bytes, n_data);
+    verify("Node buffer writing failed!");
+
+    std::cout << "Hierarchy: " << n_bytes / (1024.0 * 1024.0) << " MB nodes, " << i_bytes / (1024.0 * 1024.0)
+              << " MB indices, " << l_bytes / (1024.0 * 1024.0) << " MB leaf triangles" << std::endl;
+
     // Ensures that the kernels have the correct arguments
     setupKernels();
 }
 
-// Upload texture data to GPU
-// Avoids intermediate buffers to keep RAM usage low
+// Upload texture mip chains to GPU, packed by the scene
 void CLContext::packTextures(Scene *scene)
 {
-    std::vector<Texture*> textures = scene->getTextures();
+    const TexturePack &pack = scene->getTexturePack();
 
-    if (textures.size() == 0) return;
-    
-    // Calculate total size required for texture data
-    size_t t_bytes = 0;
-    for (Texture *tex : textures)
-    {
-        t_bytes += tex->getWidth() * tex->getHeight() * 4 * 1; // RGBA
-    }
+    if (pack.empty()) return;
 
     // Create buffers for texture data & descriptors
-    size_t d_bytes = textures.size() * sizeof(TexDescriptor);
+    size_t d_bytes = pack.descriptors.size() * sizeof(TexDescriptor);
+    size_t t_bytes = pack.data.size();
     deviceBuffers.texDescriptorBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, d_bytes, NULL, &err);
     verify("Texture descriptor buffer creation failed!");
     deviceBuffers.texDataBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, t_bytes, NULL, &err);
     verify("Texture data buffer creation failed!");
-    
-    // Upload data, create descriptors
-    std::vector<TexDescriptor> descs;
-    cl_uint offset = 0;
-    for (Texture *tex : textures)
-    {
-        TexDescriptor desc;
-        desc.offset = offset;
-        desc.width = tex->getWidth();
-        desc.height = tex->getHeight();
-        descs.push_back(desc);
 
-        cl_uint len = tex->getWidth() * tex->getHeight() * 4 * 1; // RGBA
-        err = cmdQueue.enqueueWriteBuffer(deviceBuffers.texDataBuffer, CL_TRUE, offset, len, tex->getData());
-        verify("Texture data buffer writing failed!");
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.texDataBuffer, CL_TRUE, 0, t_bytes, pack.data.data());
+    verify("Texture data buffer writing failed!");
 
-        offset += len;
-    }
+    std::cout << "Textures: " << pack.descriptors.size() << " (" << t_bytes / (1024.0 * 1024.0) << " MB on device, "
+              << pack.uncompressedSize() / (1024.0 * 1024.0) << " MB as RGBA8)" << std::endl;
 
     // Upload descriptors
-    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.texDescriptorBuffer, CL_TRUE, 0, d_bytes, descs.data());
+    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.texDescriptorBuffer, CL_TRUE, 0, d_bytes, pack.descriptors.data());
     verify("Texture descriptor buffer writing failed!");
 }
 
@@ -684,6 +899,10 @@ void CLContext::resetStats()
     RenderStats s = { 0, 0, 0, 0 };
     statsAsync = s;
     err = cmdQueue.enqueueWriteBuffer(deviceBuffers.renderStats, CL_TRUE, 0, sizeof(RenderStats), &s);
+
+    // Skip unread wavefront iterations
+    if (deviceBuffers.wfStatsHead())
+        err |= cmdQueue.enqueueReadBuffer(deviceBuffers.wfStatsHead, CL_TRUE, 0, sizeof(cl_uint), &wfStatsTail);
     verify("Stats buffer reset failed!");
 }
 
@@ -693,6 +912,30 @@ void CLContext::fetchStatsAsync()
     verify("Failed to enqueue async stat transfer!");
 }
 
+// Sum up wavefront iterations recorded since last call
+// Blocks until queued work is done, call sparingly
+void CLContext::fetchWfStats()
+{
+    cl_uint head = 0;
+    std::vector<RenderStats> ring(WF_STATS_RING_SIZE);
+    err = cmdQueue.enqueueReadBuffer(deviceBuffers.wfStatsHead, CL_FALSE, 0, sizeof(cl_uint), &head);
+    err |= cmdQueue.enqueueReadBuffer(deviceBuffers.wfStatsRing, CL_TRUE, 0, WF_STATS_RING_SIZE * sizeof(RenderStats), ring.data());
+    verify("Failed to read wavefront stats!");
+
+    // Oldest entries overwritten if not read in time
+    if (head - wfStatsTail > WF_STATS_RING_SIZE)
+        wfStatsTail = head - WF_STATS_RING_SIZE;
+
+    for (; wfStatsTail != head; wfStatsTail++)
+    {
+        const RenderStats &s = ring[wfStatsTail % WF_STATS_RING_SIZE];
+        statsAsync.primaryRays += s.primaryRays;
+        statsAsync.extensionRays += s.extensionRays;
+        statsAsync.shadowRays += s.shadowRays;
+        statsAsync.samples += s.samples;
+    }
+}
+
 void CLContext::updateRenderPerf(float deltaT)
 {
     double scale = 1e6 * deltaT;
@@ -701,6 +944,38 @@ void CLContext::updateRenderPerf(float deltaT)
     renderPerf.shadow = statsAsync.shadowRays / scale;
     renderPerf.samples = statsAsync.samples / scale;
     renderPerf.total = renderPerf.primary + renderPerf.extension + renderPerf.shadow;
+
+    // Duration of latest ray sort
+    renderPerf.raySort = 0.0f;
+    if (raySortTimed)
+    {
+        cl_ulong t0, t1;
+        raySortStartEvent.wait();
+        raySortEndEvent.wait();
+        raySortStartEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &t0);
+        raySortEndEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &t1);
+        renderPerf.raySort = (float)((t1 - t0) / 1e6);
+        raySortTimed = false;
+    }
+
+    // Duration of latest material stage
+    renderPerf.shading = 0.0f;
+    renderPerf.matSort = 0.0f;
+    if (shadingTimed)
+    {
+        cl_ulong t0, t1, t2;
+        shadingStartEvent.wait();
+        shadingEndEvent.wait();
+        shadingStartEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &t0);
+        shadingEndEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &t2);
+        renderPerf.shading = (float)((t2 - t0) / 1e6);
+        if (matSortTimed)
+        {
+            matSortEndEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &t1);
+            renderPerf.matSort = (float)((t1 - t0) / 1e6);
+        }
+        shadingTimed = matSortTimed = false;
+    }
 }
 
 const PerfNumbers CLContext::getRenderPerf()
@@ -713,11 +988,6 @@ const RenderStats CLContext::getStats()
     return statsAsync;
 }
 
-void CLContext::enqueueGetCounters(QueueCounters *cnt)
-{
-    err = cmdQueue.enqueueReadBuffer(deviceBuffers.queueCounters, CL_FALSE, 0, 1 * sizeof(QueueCounters), cnt);
-}
-
 void CLContext::checkTracingPerf()
 {
     // Check ray tracing perf without overhead
@@ -799,15 +1069,24 @@ void CLContext::enqueueSplatPreviewKernel(const RenderParams &params)
 
 void CLContext::enqueuePostprocessKernel(const RenderParams & params)
 {   
-    err = cmdQueue.enqueueAcquireGLObjects(&sharedMemory);
-    verify("Failed to enqueue GL object acquisition!");
+    // Headless => nothing to sync with GL
+    bool shared = !sharedMemory.empty();
+
+    if (shared)
+    {
+        err = cmdQueue.enqueueAcquireGLObjects(&sharedMemory);
+        verify("Failed to enqueue GL object acquisition!");
+    }
 
     // 1D range
     err = cmdQueue.enqueueNDRangeKernel(*mk_postprocess, cl::NullRange, cl::NDRange(params.width * params.height), cl::NullRange);
     verify("Failed to enqueue postprocess kernel!");
 
-    err = cmdQueue.enqueueReleaseGLObjects(&sharedMemory);
-    verify("Failed to enqueue GL object release!");
+    if (shared)
+    {
+        err = cmdQueue.enqueueReleaseGLObjects(&sharedMemory);
+        verify("Failed to enqueue GL object release!");
+    }
 }
 
 void CLContext::enqueueWfResetKernel(const RenderParams & params)
@@ -819,16 +1098,36 @@ void CLContext::enqueueWfResetKernel(const RenderParams & params)
 
 void CLContext::enqueueWfRaygenKernel(const RenderParams & params)
 {
-    err = cmdQueue.enqueueNDRangeKernel(*wf_raygen, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange);
+    cl::NDRange local = groupCompaction ? cl::NDRange(WF_COMPACT_GROUP_SIZE) : cl::NullRange;
+    cl_uint numElems = groupCompaction ? roundUpToGroup(NUM_TASKS) : NUM_TASKS;
+    err = cmdQueue.enqueueNDRangeKernel(*wf_raygen, cl::NullRange, cl::NDRange(numElems), local);
     verify("Failed to enqueue wf_raygen");
 }
 
 void CLContext::enqueueWfExtRayKernel(const RenderParams & params)
 {
-    err = cmdQueue.enqueueNDRangeKernel(*wf_extension, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange, 0, &extRayEvent);
+    // Optional binning stage, traced from sorted copy of queue
+    if (params.wfSortRays)
+        enqueueWfRaySortKernels(params);
+
+    cl::Buffer &queue = (params.wfSortRays) ? deviceBuffers.sortedExtensionQueue : deviceBuffers.extensionQueue;
+    err = wf_extension->setArg("extensionQueue", queue);
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_extension, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange, 0, &extRayEvent);
     verify("Failed to enqueue wf_extension");
 }
 
+// Counting sort of extension queue by ray key, see wf_raysort.cl
+void CLContext::enqueueWfRaySortKernels(const RenderParams & params)
+{
+    const cl_uint zero = 0;
+    err = cmdQueue.enqueueFillBuffer(deviceBuffers.rayBins, zero, 0, WF_RAY_SORT_BINS * sizeof(cl_uint), NULL, &raySortStartEvent);
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_ray_keys, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange);
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_ray_scan, cl::NullRange, cl::NDRange(WF_COMPACT_GROUP_SIZE), cl::NDRange(WF_COMPACT_GROUP_SIZE));
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_ray_scatter, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange, 0, &raySortEndEvent);
+    verify("Failed to enqueue ray sort");
+    raySortTimed = true;
+}
+
 void CLContext::enqueueWfShadowRayKernel(const RenderParams & params)
 {
     err = cmdQueue.enqueueNDRangeKernel(*wf_shadow, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange, 0, &shdwRayEvent);
@@ -837,26 +1136,64 @@ void CLContext::enqueueWfShadowRayKernel(const RenderParams & params)
 
 void CLContext::enqueueWfLogicKernel(const RenderParams& params, const bool firstIteration)
 {
-    cl_uint numElems = ((NUM_TASKS - 1) / 32 + 1) * 32;
+    cl::NDRange local = groupCompaction ? cl::NDRange(WF_COMPACT_GROUP_SIZE) : cl::NullRange;
+    cl_uint numElems = groupCompaction ? roundUpToGroup(NUM_TASKS) : ((NUM_TASKS - 1) / 32 + 1) * 32;
     err |= wf_logic->setArg("firstIteration", (cl_uint)firstIteration);
-    err |= cmdQueue.enqueueNDRangeKernel(*wf_logic, cl::NullRange, cl::NDRange(numElems), cl::NullRange);
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_logic, cl::NullRange, cl::NDRange(numElems), local);
     verify("Failed to enqueue wf_logic");
 }
 
+// Single work-item, replaces host readback of queue counters
+void CLContext::enqueueWfAdvanceKernel(const RenderParams & params, const bool countSamples)
+{
+    err = wf_advance->setArg("countSamples", (cl_uint)countSamples);
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_advance, cl::NullRange, cl::NDRange(1), cl::NullRange);
+    verify("Failed to enqueue wf_advance");
+}
+
 void CLContext::enqueueWfMaterialKernels(const RenderParams & params)
 {
+    // Markers around the stage for profiling
+    err = cmdQueue.enqueueMarkerWithWaitList(NULL, &shadingStartEvent);
+    verify("Failed to enqueue shading start marker");
+
+    if (params.wfSortMaterials)
+        enqueueWfMatSortKernels(params);
+
     if (params.wfSeparateQueues)
     {
-        enqueueWfDiffuseKernel(params);
-        enqueueWfGlossyKernel(params);
-        enqueueWfGGXReflKernel(params);
-        enqueueWfGGXRefrKernel(params);
-        enqueueWfDeltaKernel(params);
+        // Skip queues that are always empty in this scene
+        if (materialTypes & BXDF_DIFFUSE)
+            enqueueWfDiffuseKernel(params);
+        if (materialTypes & BXDF_GLOSSY)
+            enqueueWfGlossyKernel(params);
+        if (materialTypes & BXDF_GGX_ROUGH_REFLECTION)
+            enqueueWfGGXReflKernel(params);
+        if (materialTypes & BXDF_GGX_ROUGH_DIELECTRIC)
+            enqueueWfGGXRefrKernel(params);
+        if (materialTypes & (BXDF_IDEAL_REFLECTION | BXDF_IDEAL_DIELECTRIC))
+            enqueueWfDeltaKernel(params);
     }
     else
     {
         enqueueWfAllMaterialsKernel(params);
     }
+
+    err = cmdQueue.enqueueMarkerWithWaitList(NULL, &shadingEndEvent);
+    verify("Failed to enqueue shading end marker");
+    shadingTimed = true;
+    matSortTimed = (params.wfSortMaterials != 0);
+}
+
+// Counting sort of material queues by matId, see wf_matsort.cl
+void CLContext::enqueueWfMatSortKernels(const RenderParams & params)
+{
+    const cl_uint zero = 0;
+    err = cmdQueue.enqueueFillBuffer(deviceBuffers.matBins, zero, 0, WF_NUM_MAT_QUEUES * getMatSortBinsPerQueue() * sizeof(cl_uint));
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_mat_keys, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange);
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_mat_scan, cl::NullRange, cl::NDRange(WF_COMPACT_GROUP_SIZE), cl::NDRange(WF_COMPACT_GROUP_SIZE));
+    err |= cmdQueue.enqueueNDRangeKernel(*wf_mat_scatter, cl::NullRange, cl::NDRange(NUM_TASKS), cl::NullRange, 0, &matSortEndEvent);
+    verify("Failed to enqueue material sort");
 }
 
 void CLContext::enqueueWfDiffuseKernel(const RenderParams & params)
@@ -897,28 +1234,36 @@ void CLContext::enqueueWfAllMaterialsKernel(const RenderParams & params)
 
 // Only recompiles kernels that need recompiling
 // Param setArgs defines if kernel arguments are set even if kernel isn't recompiled
+// Compiled in the background, each kernel is finished on first use
 void CLContext::recompileKernels(bool setArgs)
 {
-    kernel_pick->rebuild(setArgs);
-    mk_postprocess->rebuild(setArgs);
+    kernel_pick->rebuild(setArgs, kernelPool.get());
+    mk_postprocess->rebuild(setArgs, kernelPool.get());
     
-    wf_reset->rebuild(setArgs);
-    wf_extension->rebuild(setArgs);
-    wf_raygen->rebuild(setArgs);
-    wf_logic->rebuild(setArgs);
-    wf_shadow->rebuild(setArgs);
-    wf_diffuse->rebuild(setArgs);
-    wf_glossy->rebuild(setArgs);
-    wf_ggx_refl->rebuild(setArgs);
-    wf_ggx_refr->rebuild(setArgs);
-    wf_delta->rebuild(setArgs);
-
-    mk_reset->rebuild(setArgs);
-    mk_raygen->rebuild(setArgs);
-    mk_next_vertex->rebuild(setArgs);
-    mk_sample_bsdf->rebuild(setArgs);
-    mk_splat->rebuild(setArgs);
-    mk_splat_preview->rebuild(setArgs);
+    wf_reset->rebuild(setArgs, kernelPool.get());
+    wf_advance->rebuild(setArgs, kernelPool.get());
+    wf_ray_keys->rebuild(setArgs, kernelPool.get());
+    wf_ray_scan->rebuild(setArgs, kernelPool.get());
+    wf_ray_scatter->rebuild(setArgs, kernelPool.get());
+    wf_mat_keys->rebuild(setArgs, kernelPool.get());
+    wf_mat_scan->rebuild(setArgs, kernelPool.get());
+    wf_mat_scatter->rebuild(setArgs, kernelPool.get());
+    wf_extension->rebuild(setArgs, kernelPool.get());
+    wf_raygen->rebuild(setArgs, kernelPool.get());
+    wf_logic->rebuild(setArgs, kernelPool.get());
+    wf_shadow->rebuild(setArgs, kernelPool.get());
+    wf_diffuse->rebuild(setArgs, kernelPool.get());
+    wf_glossy->rebuild(setArgs, kernelPool.get());
+    wf_ggx_refl->rebuild(setArgs, kernelPool.get());
+    wf_ggx_refr->rebuild(setArgs, kernelPool.get());
+    wf_delta->rebuild(setArgs, kernelPool.get());
+
+    mk_reset->rebuild(setArgs, kernelPool.get());
+    mk_raygen->rebuild(setArgs, kernelPool.get());
+    mk_next_vertex->rebuild(setArgs, kernelPool.get());
+    mk_sample_bsdf->rebuild(setArgs, kernelPool.get());
+    mk_splat->rebuild(setArgs, kernelPool.get());
+    mk_splat_preview->rebuild(setArgs, kernelPool.get());
 }
 
 // Clear wavefront queues by setting counters to zero
@@ -936,12 +1281,6 @@ void CLContext::finishQueue()
     verify("Failed to finish command queue!");
 }
 
-void CLContext::updatePixelIndex(cl_uint numPixels, cl_uint numNewPaths)
-{
-    pixelIdx = (pixelIdx + numNewPaths) % numPixels;
-    err = cmdQueue.enqueueWriteBuffer(deviceBuffers.currentPixelIdx, CL_FALSE, 0, sizeof(cl_uint), &pixelIdx); // will be available when raygen runs
-}
-
 void CLContext::resetPixelIndex()
 {
     pixelIdx = 0;
@@ -953,6 +1292,13 @@ cl_uint CLContext::getNumTasks() const
     return NUM_TASKS;
 }
 
+// One bin per material if the local histogram allows, see geom.h
+cl_uint CLContext::getMatSortBinsPerQueue() const
+{
+    size_t bins = (numMaterials + WF_COMPACT_GROUP_SIZE - 1) / WF_COMPACT_GROUP_SIZE * WF_COMPACT_GROUP_SIZE;
+    return (cl_uint)std::max((size_t)WF_COMPACT_GROUP_SIZE, std::min(bins, (size_t)WF_MAT_SORT_MAX_BINS_PER_QUEUE));
+}
+
 Hit CLContext::pickSingle(float NDCx, float NDCy)
 {
     err = 0;
@@ -8,6 +8,7 @@
 #include "geom.h"
 #include "Kernel.hpp"
 #include <string>
+#include <memory>
 
 typedef struct
 {
@@ -16,12 +17,16 @@ typedef struct
     float shadow = 0.0f;
     float samples = 0.0f;
     float total = 0.0f;
+    float raySort = 0.0f; // ms per iteration, 0 if not sorting
+    float shading = 0.0f; // ms per iteration in material kernels, including optional sort
+    float matSort = 0.0f; // ms per iteration, 0 if not sorting
 } PerfNumbers;
 
 class EnvironmentMap;
 class BVH;
 class Scene;
 class PTWindow;
+class TaskPool;
 
 class CLContext
 {
@@ -29,8 +34,8 @@ class CLContext
 friend class Tracer;
 
 public:
-    CLContext();
-    ~CLContext() = default;
+    CLContext(bool headless = false);
+    ~CLContext();
 
 	void enqueueResetKernel(const RenderParams &params);
 	void enqueueRayGenKernel(const RenderParams &params);
@@ -46,34 +51,40 @@ public:
     void enqueueWfShadowRayKernel(const RenderParams &params);
     void enqueueWfLogicKernel(const RenderParams &params, const bool firstIteration);
     void enqueueWfMaterialKernels(const RenderParams &params);
+    void enqueueWfAdvanceKernel(const RenderParams &params, const bool countSamples);
+    void enqueueWfRaySortKernels(const RenderParams &params);
+    void enqueueWfMatSortKernels(const RenderParams &params);
 
     // Done conservatively
     void recompileKernels(bool setArgs);
    
     void enqueueClearWfQueues();
     void finishQueue();
-    void updatePixelIndex(cl_uint numPixels, cl_uint numNewPaths);
     void resetPixelIndex();
     cl_uint getNumTasks() const;
+    cl_uint getMatSortBinsPerQueue() const;
 
     Hit pickSingle(float NDCx, float NDCy);
 
-    void setup(PTWindow *window);
+    void setup(PTWindow *window, unsigned int width, unsigned int height); // size used if headless
     void setupParams();
     void setupPickResult();
     void setupStats();
     void resetStats();
     void fetchStatsAsync();
+    void fetchWfStats();
     void updateRenderPerf(float deltaT);
     const PerfNumbers getRenderPerf();
     const RenderStats getStats();
-    void enqueueGetCounters(QueueCounters *cnt);
 
     void checkTracingPerf();
 
     void updateParams(const RenderParams &params);
     void uploadSceneData(BVH *bvh, Scene *scene);
+    void uploadHierarchy(BVH *bvh);
     void setupPixelStorage(PTWindow *window);
+    void setupPixelStorage(unsigned int width, unsigned int height);
+    void updatePixelStorageArgs();
 	void saveImage(std::string filename, const RenderParams &params);
     void createEnvMap(EnvironmentMap *map);
 private:
@@ -90,6 +101,8 @@ private:
     void enqueueWfAllMaterialsKernel(const RenderParams &params);
     
     void setupKernels();
+    void setupMicroKernels();
+    void setupWavefrontKernels();
 	void setupResetKernel();
     void setupRayGenKernel();
     void setupNextVertexKernel();
@@ -100,6 +113,10 @@ private:
     void setupPickKernel();
     void setupWfExtKernel();
     void setupWfResetKernel();
+    void setupWfAdvanceKernel();
+    void setupWfRaySortKernels();
+    void setupWfMatSortKernels();
+    void appendWfMaterialKernels(std::vector<flt::Kernel*> &kernels);
     void setupWfLogicKernel();
     void setupWfShadowKernel();
     void setupWfRaygenKernel();
@@ -118,9 +135,16 @@ private:
 
     int err;                // error code returned from api calls
     cl_uint NUM_TASKS = 0;  // the amount of paths in flight simultaneously, limited by VRAM, defined in settings
+    bool groupCompaction = false; // wf_logic/wf_raygen use fixed work-groups for queue compaction
+    bool wideBvhFallback = false; // collapsed hierarchy too deep for kernel stacks, binary nodes uploaded
+    unsigned int materialTypes = 0; // BXDF bits of uploaded scene, separate queues of other types are skipped
+    size_t numMaterials = 0;
 
-    // For showing progress
-    PTWindow *window;
+    // For showing progress, null if headless
+    PTWindow *window = nullptr;
+
+    // Plain context without GL sharing, no window required
+    const bool headless;
     
     std::vector<cl::Device> clDevices;
     cl::Device device;
@@ -142,6 +166,13 @@ private:
     
     // Aila-style wavefront kernels
     flt::Kernel* wf_reset = nullptr;
+    flt::Kernel* wf_advance = nullptr;
+    flt::Kernel* wf_ray_keys = nullptr;
+    flt::Kernel* wf_ray_scan = nullptr;
+    flt::Kernel* wf_ray_scatter = nullptr;
+    flt::Kernel* wf_mat_keys = nullptr;
+    flt::Kernel* wf_mat_scan = nullptr;
+    flt::Kernel* wf_mat_scatter = nullptr;
     flt::Kernel* wf_extension = nullptr;
     flt::Kernel* wf_raygen = nullptr;
     flt::Kernel* wf_logic = nullptr;
@@ -154,7 +185,7 @@ private:
     flt::Kernel* wf_mat_all = nullptr;
 
     
-    // Device memory shared with GL
+    // Device memory shared with GL, empty if headless
     std::vector<cl::Memory> sharedMemory;
     
     // Performance statistics
@@ -162,8 +193,17 @@ private:
     PerfNumbers renderPerf;
     cl::Event extRayEvent;
     cl::Event shdwRayEvent;
-    QueueCounters hostCounters = {}; // synced from queueCounters
+    cl::Event raySortStartEvent;
+    cl::Event raySortEndEvent;
+    bool raySortTimed = false; // events above belong to unreported sort
+    cl::Event shadingStartEvent;
+    cl::Event matSortEndEvent;
+    cl::Event shadingEndEvent;
+    bool shadingTimed = false;
+    bool matSortTimed = false;
+    QueueCounters hostCounters = {}; // initial value of queueCounters
     cl_uint pixelIdx = 0;
+    cl_uint wfStatsTail = 0; // next unread entry of wfStatsRing
 
 public:
 
@@ -174,6 +214,12 @@ public:
         cl::Buffer tasksBuffer;
         cl::Buffer raygenQueue;     // indices of paths to regenerate
         cl::Buffer extensionQueue;  // indices of paths to extend
+        cl::Buffer sortedExtensionQueue; // extensionQueue binned by ray key, traced instead if sorting
+        cl::Buffer rayKeys;         // bin of each extensionQueue entry
+        cl::Buffer rayBins;         // WF_RAY_SORT_BINS counts, then offsets
+        cl::Buffer matSortPaths;    // material queues concatenated
+        cl::Buffer matSortKeys;     // bin of each matSortPaths entry
+        cl::Buffer matBins;         // WF_MAT_SORT_BINS counts, then offsets
         cl::Buffer shadowQueue;     // indices of shadow ray casts
         cl::Buffer diffuseMatQueue;
         cl::Buffer glossyMatQueue;
@@ -182,9 +228,13 @@ public:
         cl::Buffer deltaMatQueue;
         cl::Buffer currentPixelIdx; // points to next pixel, since NUM_TASKS != #pixels
         cl::Buffer queueCounters;   // atomic counters keeping track of queue lengths
+        cl::Buffer wfStatsRing;     // RenderStats per iteration, WF_STATS_RING_SIZE entries
+        cl::Buffer wfStatsHead;     // total number of entries written
 
         // Variables from BVH
-        cl::Buffer triangleBuffer;
+        cl::Buffer vertexBuffer;       // shared vertices, read once per hit
+        cl::Buffer triangleBuffer;     // vertex indices and material
+        cl::Buffer leafTriangleBuffer; // positions in leaf order, read in traversal
         cl::Buffer nodeBuffer;
         cl::Buffer indexBuffer;
         cl::Buffer materialBuffer;
@@ -204,12 +254,17 @@ public:
         cl::Buffer pixelBuffer;     // raw (linear) pixel data, not used by OpenGL
         cl::Buffer denoiserAlbedoBuffer;
         cl::Buffer denoiserNormalBuffer;
-        cl::BufferGL previewBuffer; // post-processed buffer, shown on screen
-        cl::BufferGL denoiserAlbedoBufferGL;
-        cl::BufferGL denoiserNormalBufferGL;
+        cl::Buffer previewBuffer; // post-processed buffer, shown on screen (GL PBO unless headless)
+        cl::Buffer denoiserAlbedoBufferGL;
+        cl::Buffer denoiserNormalBufferGL;
 
         // Single element buffers
         cl::Buffer pickResult;
         cl::Buffer renderParams;
     } deviceBuffers;
+
+private:
+    // Background kernel compilation, declared last => destroyed first,
+    // joining in-flight builds before the CL objects they use
+    std::unique_ptr<TaskPool> kernelPool;
 };
@@ -9,13 +9,13 @@
 float3 sampleDiffuse(Hit *hit, Material *mat, global TexDescriptor *textures, global uchar *texData, float3 *dirOut, float *pdfW, uint *randSeed)
 {
 	*dirOut = cosSampleHemisphere(hit->N, randSeed, pdfW);
-	float3 Kd = matGetAlbedo(mat->Kd, hit->uvTex, mat->map_Kd, textures, texData);
+	float3 Kd = matGetAlbedo(mat->Kd, hit->uvTex, hit->uvFootprint, mat->map_Kd, textures, texData);
 	return Kd * M_INV_PI;
 }
 
 float3 evalDiffuse(Hit *hit, Material *mat, global TexDescriptor *textures, global uchar *texData, float3 dirIn, float3 dirOut)
 {
-	float3 Kd = matGetAlbedo(mat->Kd, hit->uvTex, mat->map_Kd, textures, texData);
+	float3 Kd = matGetAlbedo(mat->Kd, hit->uvTex, hit->uvFootprint, mat->map_Kd, textures, texData);
 	return Kd * M_INV_PI;
 }
 
@@ -52,17 +52,29 @@ inline float3 evalEnvMapUVint(read_only image2d_t envMap, int u, int v)
     return read_imagef(envMap, samplerInt, (int2)(u, v)).xyz;
 }
 
+// Sampling tables are built on the env map downsampled by this factor
+#ifndef ENV_MAP_TABLE_SCALE
+#define ENV_MAP_TABLE_SCALE 1
+#endif
+
+// Dimensions of the importance sampling tables, same rounding as on the host
+inline int2 envMapTableDims(read_only image2d_t envMap)
+{
+    return max(get_image_dim(envMap) / ENV_MAP_TABLE_SCALE, (int2)(1, 1));
+}
+
 typedef struct
 {
-    const int width;
+    const int width;  // table dimensions
+
     const int height;
 	global const float *pdfTable;
     global const float *probTable;
     global const int *aliasTable;
 } EnvMapContext;
 
-// Uses the Alias Method
-inline void sampleEnvMapAlias(float rnd, float3 *L, float *pdfW, EnvMapContext ctx)
+// Uses the Alias Method to pick a table cell, then samples uniformly within it
+inline void sampleEnvMapAlias(float rnd, float2 rndCell, float3 *L, float *pdfW, EnvMapContext ctx)
 {
     const int width = ctx.width;
     const int height = ctx.height;
@@ -77,11 +89,11 @@ inline void sampleEnvMapAlias(float rnd, float3 *L, float *pdfW, EnvMapContext c
     // Compute outgoing dir
 	int uInd = uvInd % width;
 	int vInd = uvInd / width;
-    float u = (float)(uInd + 0.5f) / width;
-    float v = (float)(vInd + 0.5f) / height;
+    float u = (float)(uInd + rndCell.x) / width;
+    float v = (float)(vInd + rndCell.y) / height;
     *L = UVToDirection(u, v);
 
-    // Compute pdf
+    // Compute pdf, piecewise constant in uv
     const float lightPickProb = 1.0f;
     float sinTh = sin(M_PI_F * v);
     float directPdfUV = pdf_uv * lightPickProb;
@@ -91,7 +103,7 @@ inline void sampleEnvMapAlias(float rnd, float3 *L, float *pdfW, EnvMapContext c
         *pdfW = 0.0f;
 }
 
-// Get pdf of sampling 'direction', used in MIS
+// Get pdf of sampling 'direction', used in MIS. Width and height are table dimensions.
 float envMapPdf(int width, int height, global float *pdfTable, float3 direction)
 {
     float2 uv = directionToUV(direction);
@@ -2,112 +2,234 @@
 #include "rgbe/rgbe.hpp"
 #include "utils.h"
 #include "geom.h"
+#include "taskpool.hpp"
+#include "settings.hpp"
 #include <iostream>
-#include <stack>
+#include <fstream>
+#include <cstring>
+#include <chrono>
+#include <atomic>
+#include <vector>
 
-EnvironmentMap::EnvironmentMap(const std::string &filename) : scale(1.0f)
+EnvironmentMap::EnvironmentMap(const std::string &filename) : tableWidth(0), tableHeight(0), scale(1.0f), data(NULL), pdfTable(NULL), probTable(NULL), aliasTable(NULL)
 {
-	FILE * f = fopen(filename.c_str(), "rb");
+	auto startTime = std::chrono::high_resolution_clock::now();
 
-	if(!f)
+	MappedFile file(filename);
+	if (!file.valid())
 	{
 		std::cout << "Cannot open file '" << filename << "'" << std::endl;
         waitExit();
 	}
+	name = filename;
+
+	// Locate scanlines serially, then decode them in parallel straight into RGBA
+	size_t offset = 0;
+	int firstFlat = 0;
+	std::vector<size_t> offsets;
+	bool ok = RGBE_ReadHeader_Mem(file.data(), file.size(), &width, &height, &offset) == RGBE_RETURN_SUCCESS;
+	if (ok)
+	{
+		offsets.resize(height);
+		ok = RGBE_ScanlineOffsets(file.data(), file.size(), offset, width, height, offsets.data(), &firstFlat) == RGBE_RETURN_SUCCESS;
+	}
+
+	if (ok)
+	{
+		TaskPool pool;
+		std::atomic<int> failed(0);
+		data = new float[(size_t)width * height * 4];
+		pool.parallelFor(height, [&](size_t y)
+		{
+			std::vector<unsigned char> scratch((size_t)width * 4);
+			const size_t avail = file.size() - offsets[y];
+			if (RGBE_DecodeScanline_RGBA(file.data() + offsets[y], avail, (int)y < firstFlat, data + y * width * 4, width, scratch.data()) != RGBE_RETURN_SUCCESS)
+				failed++;
+		});
+		ok = (failed == 0);
+	}
+
+	if (!ok)
+	{
+		std::cout << "Could not decode environment map '" << filename << "'" << std::endl;
+		delete[] data;
+		data = NULL;
+		width = height = 0;
+		return;
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	std::cout << "Decoded environment map in " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
 
-	RGBE_ReadHeader(f, &width, &height, NULL);
-	data = new float [width * height * 3];
-	RGBE_ReadPixels_RLE(f, data, width, height);
-	fclose(f);
-    name = filename;
+	// Same rounding as envMapTableDims() in env_map.cl
+	const int tableScale = (int)Settings::getInstance().getEnvMapTableScale();
+	tableWidth = std::max(1, width / tableScale);
+	tableHeight = std::max(1, height / tableScale);
 
 	computeProbabilities();
 	std::cout << "Read environment map of size [" << width << ", " << height << "]" << std::endl;
 }
 
+// Sampling tables cached next to the HDR, keyed by content hash of the decoded image
+struct EnvMapTableHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;  // table dimensions
+	uint32_t height;
+	uint64_t hash;
+};
+
+static const uint32_t EnvMapTableMagic = 0x54534945; // 'EIST'
+static const uint32_t EnvMapTableVersion = 2;
+
+bool EnvironmentMap::loadTables(const std::string &path, size_t hash)
+{
+	MappedFile file(path);
+	const size_t n = (size_t)tableWidth * tableHeight;
+	if (!file.valid() || file.size() != sizeof(EnvMapTableHeader) + n * (2 * sizeof(float) + sizeof(int)))
+		return false;
+
+	EnvMapTableHeader h;
+	memcpy(&h, file.data(), sizeof(h));
+	if (h.magic != EnvMapTableMagic || h.version != EnvMapTableVersion ||
+		h.width != (uint32_t)tableWidth || h.height != (uint32_t)tableHeight || h.hash != (uint64_t)hash)
+		return false;
+
+	const char *ptr = file.data() + sizeof(h);
+	pdfTable = new float[n];
+	probTable = new float[n];
+	aliasTable = new int[n];
+	memcpy(pdfTable, ptr, n * sizeof(float));
+	memcpy(probTable, ptr + n * sizeof(float), n * sizeof(float));
+	memcpy(aliasTable, ptr + 2 * n * sizeof(float), n * sizeof(int));
+	return true;
+}
+
+void EnvironmentMap::saveTables(const std::string &path, size_t hash)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out.good())
+		return; // e.g. read-only asset directory
+
+	const size_t n = (size_t)tableWidth * tableHeight;
+	EnvMapTableHeader h = { EnvMapTableMagic, EnvMapTableVersion, (uint32_t)tableWidth, (uint32_t)tableHeight, (uint64_t)hash };
+	out.write((const char*)&h, sizeof(h));
+	out.write((const char*)pdfTable, n * sizeof(float));
+	out.write((const char*)probTable, n * sizeof(float));
+	out.write((const char*)aliasTable, n * sizeof(int));
+}
+
 // Prepares environment map for importance sampling (using the alias method)
 // PBRT chapters 14.2, 13.3
 void EnvironmentMap::computeProbabilities()
 {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	const size_t hash = computeHash(data, (size_t)width * height * 4 * sizeof(float));
+	const size_t n = (size_t)tableWidth * tableHeight;
+	const std::string tablePath = name + ".istable";
+	if (loadTables(tablePath, hash))
+	{
+		auto endTime = std::chrono::high_resolution_clock::now();
+		std::cout << "Environment map tables loaded in " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+		return;
+	}
+
 	std::cout << "Processing environment map" << std::endl;
 
-	/* Create scalar representaiton of map (using luminance) */
-	std::unique_ptr<float[]> scalars(new float[width * height]);
-	
-	#pragma omp parallel for
-	for (int v = 0; v < height; v++)
+	/* Create scalar representaiton of map (using mean luminance of each table cell), row sums for integral */
+	TaskPool pool;
+	pdfTable = new float[n];
+	std::vector<double> rowSums(tableHeight);
+	pool.parallelFor(tableHeight, [&](size_t v)
 	{
-		float sinTh = std::sin(PI * float(v + 0.5f) / float(height));
-		for (int u = 0; u < width; u++)
+		const float sinTh = std::sin(PI * float(v + 0.5f) / float(tableHeight));
+		const size_t y0 = v * height / tableHeight, y1 = (v + 1) * height / tableHeight;
+		float *scalars = pdfTable + v * tableWidth;
+		double sum = 0.0;
+		for (int u = 0; u < tableWidth; u++)
 		{
-			float r = data[3 * (v * width + u) + 0];
-			float g = data[3 * (v * width + u) + 1];
-			float b = data[3 * (v * width + u) + 2];
-			float lum = 0.212671f * r + 0.715160f * g + 0.072169f * b; // sRGB luminance
-			
+			const size_t x0 = (size_t)u * width / tableWidth, x1 = (size_t)(u + 1) * width / tableWidth;
+			float lum = 0.0f;
+			for (size_t y = y0; y < y1; y++)
+			{
+				const float *rgba = data + 4 * (y * width + x0);
+				for (size_t x = x0; x < x1; x++, rgba += 4)
+					lum += 0.212671f * rgba[0] + 0.715160f * rgba[1] + 0.072169f * rgba[2]; // sRGB luminance
+			}
+			lum /= float((y1 - y0) * (x1 - x0));
+
 			// SinTh from jacobian of (u,v)->(x,y,z) baked in for IS
-            scalars[v * width + u] = lum * sinTh;
+			scalars[u] = lum * sinTh;
+			sum += scalars[u];
 		}
-	}
+		rowSums[v] = sum;
+	});
 
 	/* Compute 1D flat pdf over whole image */
-	pdfTable = new float[width * height];
-
-	// Get integral over whole image
-	float I = 0.0f;
-	for (int i = 1; i < width*height + 1; i++) I += scalars[i - 1] / (width*height);
+	double I = 0.0;
+	for (double s : rowSums) I += s;
+	I /= (double)n;
 
-	// Calculate pdf
-	if (I == 0)
-		for (int i = 0; i < width*height; i++) pdfTable[i] = 1.0f / float(width*height); // make integral one
-	else
-		for (int i = 0; i < width*height; i++) pdfTable[i] = scalars[i] / I;
+	// Calculate pdf in place
+	const float invI = (I == 0.0) ? 0.0f : float(1.0 / I);
+	pool.parallelFor(tableHeight, [&](size_t v)
+	{
+		float *pdf = pdfTable + v * tableWidth;
+		if (invI == 0.0f)
+			for (int u = 0; u < tableWidth; u++) pdf[u] = 1.0f / float(n); // make integral one
+		else
+			for (int u = 0; u < tableWidth; u++) pdf[u] *= invI;
+	});
 
 	/* Compute probability and alias tables */
 	/* Stable Vose's algorithm, see http://www.keithschwarz.com/darts-dice-coins/ */
-	probTable = new float[width * height];
-	aliasTable = new int[width * height];
+	probTable = new float[n];
+	aliasTable = new int[n];
 
-	// 1D pdf over whole image
-	std::stack<std::pair<float, int>> small, large;
-
-	// Distribute probabilities
-	for (int i = 0; i < width * height; i++)
+	// Worklists share one array: small grows from the front, large from the back
+	std::unique_ptr<int[]> work(new int[n]);
+	size_t numSmall = 0, largeStart = n;
+	for (size_t i = 0; i < n; i++)
 	{
-		float p = pdfTable[i]; // n pre-divided (stepfunction pdf)
-		if (p < 1.0f)
-			small.push(std::make_pair(p, i));
+		probTable[i] = pdfTable[i]; // n pre-divided (stepfunction pdf), residual while building
+		if (probTable[i] < 1.0f)
+			work[numSmall++] = (int)i;
 		else
-			large.push(std::make_pair(p, i));
+			work[--largeStart] = (int)i;
 	}
 
-	while (!small.empty() && !large.empty())
+	while (numSmall > 0 && largeStart < n)
 	{
-		std::pair<float, int> l = small.top(), g = large.top();
-		small.pop();
-		large.pop();
-
-		probTable[l.second] = l.first;
-		aliasTable[l.second] = g.second;
+		const int l = work[--numSmall];
+		const int g = work[largeStart++];
 
-		float pg = (g.first + l.first) - 1.0f;
-		if (pg < 1.0f)
-			small.push(std::make_pair(pg, g.second));
+		aliasTable[l] = g;
+		probTable[g] = (probTable[g] + probTable[l]) - 1.0f;
+		if (probTable[g] < 1.0f)
+			work[numSmall++] = g;
 		else
-			large.push(std::make_pair(pg, g.second));
+			work[--largeStart] = g;
 	}
 
-	while (!large.empty())
+	while (largeStart < n)
 	{
-		std::pair<float, int> g = large.top();
-		large.pop();
-		probTable[g.second] = 1.0f;
+		const int g = work[largeStart++];
+		probTable[g] = 1.0f;
+		aliasTable[g] = g;
 	}
 
-	while (!small.empty())
+	while (numSmall > 0)
 	{
-		std::pair<float, int> l = small.top();
-		small.pop();
-		probTable[l.second] = 1.0f;
+		const int l = work[--numSmall];
+		probTable[l] = 1.0f;
+		aliasTable[l] = l;
 	}
+
+	saveTables(tablePath, hash);
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	std::cout << "Environment map tables [" << tableWidth << ", " << tableHeight << "] built in " << std::chrono::duration<double, std::milli>(endTime - startTime).count()
+		<< " ms (" << pool.numThreads() << " threads)" << std::endl;
 }
@@ -12,6 +12,8 @@ public:
 	EnvironmentMap() :
 		width(0),
 		height(0),
+		tableWidth(0),
+		tableHeight(0),
 		scale(1.0f),
 		data(NULL),
         name(""),
@@ -37,15 +39,20 @@ public:
 	float *getPdfTable() { return pdfTable; }
 	int getWidth() { return width; }
 	int getHeight() { return height; }
+	int getTableWidth() { return tableWidth; }
+	int getTableHeight() { return tableHeight; }
 
 	bool valid() { return data != NULL && probTable != NULL && aliasTable != NULL && pdfTable != NULL && width * height > 0; }
 
 private:
 	void computeProbabilities();
+	bool loadTables(const std::string &path, size_t hash);
+	void saveTables(const std::string &path, size_t hash);
 	
 	int width, height;
+	int tableWidth, tableHeight; // downsampled by Settings::getEnvMapTableScale()
 	float scale;
-	float *data; // used by clcontext to create cl::Image2D
+	float *data; // RGBA, used by clcontext to create cl::Image2D
     std::string name;
 	
 	// For importance sampling (alias method)
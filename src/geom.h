@@ -77,18 +77,52 @@ typedef struct
     cl_uchar nPrims;        // 0 for interior nodes
 } GPUNode;
 
+// Collapsed wide node, see BVH::collapse
+#if defined(GPU) && defined(BVH_WIDTH)
+#ifdef BVH_QUANTIZED
+// Child bounds relative to node box, see BVH::quantize
+// Plain uchar: cl_uchar is signed on device
+typedef struct
+{
+    cl_float origin[3];           // min corner of node box
+    uchar exp[3];                 // per-axis scale as float exponent bits
+    uchar pad;
+    uchar qmin[3][BVH_WIDTH];     // child bounds: origin + q * scale
+    uchar qmax[3][BVH_WIDTH];
+    cl_uint child[BVH_WIDTH];     // inner child: index into node vector, leaf child: index into index list
+    uchar nPrims[BVH_WIDTH];      // 0 for inner children
+    cl_uint numChildren;          // valid children packed to front
+} GPUWideNode;
+#else
+typedef struct
+{
+    cl_float bmin[3][BVH_WIDTH]; // child bounds, SoA
+    cl_float bmax[3][BVH_WIDTH];
+    cl_uint child[BVH_WIDTH];    // inner child: index into node vector, leaf child: index into index list
+    cl_uchar nPrims[BVH_WIDTH];  // 0 for inner children
+    cl_uint numChildren;         // valid children packed to front
+} GPUWideNode;
+#endif
+#endif
+
 typedef struct
 {
     float3 p; // 16B
-    float3 n; // 16B
+    float3 n; // 16B, zero for flat shaded triangles
     float3 t; // 16B
-} Vertex; // >= 48B
+} Vertex; // >= 48B, used interchangeably with VertexPNT
 
+// Positions only, stored in BVH leaf order (see CLContext::uploadHierarchy)
 typedef struct
 {
-    Vertex v0;
-    Vertex v1;
-    Vertex v2;
+    float3 v0;
+    float3 e1; // v1 - v0
+    float3 e2; // v2 - v0
+} LeafTriangle;
+
+typedef struct
+{
+    cl_uint v[3]; // indices into vertex buffer
     cl_int matId;
 } Triangle; // this struct is used interchangeably with RTTriangle...sizes must match!
 
@@ -126,20 +160,26 @@ typedef struct
     cl_uint offset; // start of texture data in global array
     cl_uint width;
     cl_uint height;
+    cl_uint levels; // mip levels, stored consecutively from offset
+    cl_uint format; // TEX_FORMAT_*
 } TexDescriptor;
 
+#define TEX_FORMAT_RGBA8 0
+#define TEX_FORMAT_BC1 1 // 4x4 blocks: two RGB565 endpoints, 2-bit indices
+
 typedef struct
 {
     float3 P;
     float3 N;
     float2 uvTex;
+    cl_float uvFootprint; // ray cone width in uv units, selects mip level
     cl_float t;
     cl_int i; // index of hit triangle, -1 by default
     cl_int areaLightHit;
     cl_int matId; // index of hit material
 } Hit;
 
-#define EMPTY_HIT(tmax) { (float3)(0.0f), (float3)(0.0f), (float2)(0.0f), tmax, -1, 0, -1 }
+#define EMPTY_HIT(tmax) { (float3)(0.0f), (float3)(0.0f), (float2)(0.0f), 0.0f, tmax, -1, 0, -1 }
 
 typedef struct
 {
@@ -175,7 +215,11 @@ typedef struct
     cl_uint sampleExpl;    // use next event estimation
     cl_uint useRoulette;   // Luminance-based russian roulette
     cl_uint wfSeparateQueues;
+    cl_uint wfSortRays;    // bin extension rays by direction and origin before tracing
+    cl_uint wfSortMaterials; // bin material queues by matId before shading
     cl_float worldRadius;
+    float3 worldMin;       // scene bounds
+    float3 worldMax;
 } RenderParams;
 
 
@@ -227,7 +271,9 @@ typedef struct
     cl_float lastCosTh;
     cl_float lastLightPickProb;
     cl_float shadowRayLen;
+    cl_float coneWidth; // ray cone width at last path vertex
     // Last hit:
+    cl_float uvFootprint;
     cl_float t;
     cl_int i;        // index of hit triangle, -1 by default
     cl_int areaLightHit;
@@ -256,4 +302,24 @@ typedef struct
     cl_uint extensionRays;
     cl_uint shadowRays;
     cl_uint samples;
-} RenderStats;
\ No newline at end of file
+} RenderStats;
+
+// Per-iteration wavefront stats, written on device by wf_advance
+#define WF_STATS_RING_SIZE 1024
+
+// Work-group size of queue-filling kernels without warp atomics (non-NVIDIA)
+#define WF_COMPACT_GROUP_SIZE 64
+
+// Extension ray bins: direction octant + Morton code of origin cell
+#define WF_RAY_SORT_GRID_BITS 3 // per axis
+#define WF_RAY_SORT_BINS (8 << (3 * WF_RAY_SORT_GRID_BITS))
+
+// Material queue bins: queue index (QueueCounters order) + matId modulo bins per queue.
+// Bins per queue follow the scene's material count (build option, multiple of WF_COMPACT_GROUP_SIZE),
+// capped by the local histogram size: scenes with more materials share bins and lose some coherence.
+#define WF_NUM_MAT_QUEUES 5
+#define WF_MAT_SORT_MAX_BINS_PER_QUEUE 1536
+#ifndef WF_MAT_SORT_BINS_PER_QUEUE
+#define WF_MAT_SORT_BINS_PER_QUEUE WF_MAT_SORT_MAX_BINS_PER_QUEUE // host: buffer size
+#endif
+#define WF_MAT_SORT_BINS (WF_NUM_MAT_QUEUES * WF_MAT_SORT_BINS_PER_QUEUE)
\ No newline at end of file
@@ -104,7 +104,7 @@ float3 sampleGGXReflect(Hit *hit, Material *mat, global TexDescriptor *textures,
 	float F = (mat->Ni > 1.0f) ? fresnelDielectric(iDotN, 1.0f, mat->Ni) : 1.0f;
 
 	// Evaluate BSDF (eq. 20)
-	float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+	float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 	float D = ggxD(alpha, hit->N, H);
 	float G = ggxG(alpha, dirIn, *dirOut, hit->N, H);
 	float den = (4.0f * iDotN * oDotN);
@@ -126,7 +126,7 @@ float3 evalGGXReflect(Hit *hit, Material *mat, global TexDescriptor *textures, g
 	float F = (mat->Ni > 1.0f) ? fresnelDielectric(iDotN, 1.0f, mat->Ni) : 1.0f;
 
 	// Evaluate BSDF (eq. 20)
-	float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+	float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 	float D = ggxD(alpha, hit->N, H);
 	float G = ggxG(alpha, dirIn, dirOut, hit->N, H);
 	float den = (4.0f * iDotN * oDotN);
@@ -195,7 +195,7 @@ float3 sampleGGXRefract(Hit *hit, Material *mat, bool backface, global TexDescri
 		float3 bsdf = (lightTracing) ? (float3)(1.0f) : (float3)(eta * eta);
 		
 		// Simulate absorption
-		float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+		float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 		bsdf *= Ks;
 
 		float iDotH = fabs(dot(normalize(dirIn), H));
@@ -250,7 +250,7 @@ float3 evalGGXRefract(Hit *hit, Material *mat, bool backface, global TexDescript
 		float3 bsdf = (lightTracing) ? (float3)(1.0f) : (float3)(eta * eta);
 		
 		// Simulate absorption
-		float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+		float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 		bsdf *= Ks;
 
 		float iDotH = fabs(dot(normalize(dirIn), H));
@@ -30,7 +30,7 @@ float3 sampleGlossy(Hit *hit, Material *mat, bool backface, global TexDescriptor
 	// Check Ks and Ni
 	// TODO: ok to just modify? (yes, not a global variable...)
 	Material m = *mat;
-	m.Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+	m.Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 	m.Ni = (mat->Ni > 0.0f) ? mat->Ni : ksToEta(m.Ks);
 	if (isZero(m.Ks)) m.Ks = etaToKs(m.Ni);
 
@@ -71,7 +71,7 @@ float3 evalGlossy(Hit *hit, Material *mat, bool backface, global TexDescriptor *
 	// Check Ks and Ni
 	// TODO: ok to just modify? (yes, not a global variable...)
 	Material m = *mat;
-	m.Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+	m.Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 	m.Ni = (mat->Ni > 0.0f) ? mat->Ni : ksToEta(m.Ks);
 	if (length(m.Ks) == 0.0f) m.Ks = etaToKs(m.Ni);
 
@@ -89,7 +89,7 @@ float pdfGlossy(Hit *hit, Material *mat, global TexDescriptor *textures, global
 	//if (backface)
 	//	return pdfDiffuse(hit, dirOut);
 
-	float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, mat->map_Ks, textures, texData);
+	float3 Ks = matGetFloat3(mat->Ks, hit->uvTex, hit->uvFootprint, mat->map_Ks, textures, texData);
 	float Ni = (mat->Ni > 0.0f) ? mat->Ni : ksToEta(Ks);
 
 	float basePdf = pdfDiffuse(hit, dirOut);
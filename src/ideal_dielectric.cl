@@ -31,7 +31,7 @@ float3 sampleIdealDielectric(Hit *hit, Material *material, bool backface, global
 		bsdf *= eta * eta; // eta^2 applied in case of radiance transport (16.1.3)
 		
 		// Simulate absorption
-		float3 Ks = matGetFloat3(material->Ks, hit->uvTex, material->map_Ks, textures, texData);
+		float3 Ks = matGetFloat3(material->Ks, hit->uvTex, hit->uvFootprint, material->map_Ks, textures, texData);
 		bsdf *= Ks;
 	}
 
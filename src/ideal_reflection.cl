@@ -16,7 +16,7 @@ float3 sampleIdealReflection(Hit *hit, Material *material, bool backface, global
 
 	// PBRT eq. 8.8
 	// cosTh of geometry term needs to be cancelled out
-	float3 ks = matGetFloat3(material->Ks, hit->uvTex, material->map_Ks, textures, texData);
+	float3 ks = matGetFloat3(material->Ks, hit->uvTex, hit->uvFootprint, material->map_Ks, textures, texData);
 	float cosO = dot(normalize(*dirOut), hit->N);
 	return (cosO != 0.0f) ? ks / cosO : 0.0f;
 }
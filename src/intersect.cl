@@ -61,10 +61,11 @@ inline bool intersectAABB(Ray *r, global AABB *box, float *tminRet, float *tMaxR
 
 // Möller-Trumbore
 #define EPSILON 1e-12f
-inline bool intersectTriangle(Ray *r, global Triangle *tri, float *tret, float *uret, float *vret)
+inline bool intersectTriangle(Ray *r, global Triangle *tri, global Vertex *verts, float *tret, float *uret, float *vret)
 {
-    float3 s1 = tri->v1.p - tri->v0.p;
-    float3 s2 = tri->v2.p - tri->v0.p;
+    const float3 p0 = verts[tri->v[0]].p;
+    float3 s1 = verts[tri->v[1]].p - p0;
+    float3 s2 = verts[tri->v[2]].p - p0;
     float3 pvec = cross(r->dir, s2); // order matters!
     float det = dot(s1, pvec);
 
@@ -72,7 +73,7 @@ inline bool intersectTriangle(Ray *r, global Triangle *tri, float *tret, float *
     if (fabs(det) < EPSILON) return false;
     float iDet = 1.0f / det;
 
-    float3 tvec = r->orig - tri->v0.p;
+    float3 tvec = r->orig - p0;
     float u = dot(tvec, pvec) * iDet;
     if (u < 0.0f || u > 1.0f) return false;
 
@@ -92,11 +93,40 @@ inline bool intersectTriangle(Ray *r, global Triangle *tri, float *tret, float *
     return true;
 }
 
+// Möller-Trumbore with precomputed edges, used in BVH leaves
+inline bool intersectLeafTriangle(Ray *r, global LeafTriangle *tri, float *tret, float *uret, float *vret)
+{
+    float3 pvec = cross(r->dir, tri->e2);
+    float det = dot(tri->e1, pvec);
+
+    // miss if det close to 0
+    if (fabs(det) < EPSILON) return false;
+    float iDet = 1.0f / det;
+
+    float3 tvec = r->orig - tri->v0;
+    float u = dot(tvec, pvec) * iDet;
+    if (u < 0.0f || u > 1.0f) return false;
+
+    float3 qvec = cross(tvec, tri->e1);
+    float v = dot(r->dir, qvec) * iDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    float t = dot(tri->e2, qvec) * iDet;
+
+    if(t < 0.0f) return false;
+
+    *tret = t;
+    *uret = u;
+    *vret = v;
+
+    return true;
+}
+
 // For drawing the test area light
-inline bool intersectTriangleLocal(Ray *r, Triangle *tri, float *tres)
+inline bool intersectTriangleLocal(Ray *r, float3 v0, float3 v1, float3 v2, float *tres)
 {
-    float3 s1 = tri->v1.p - tri->v0.p;
-    float3 s2 = tri->v2.p - tri->v0.p;
+    float3 s1 = v1 - v0;
+    float3 s2 = v2 - v0;
     float3 pvec = cross(r->dir, s2);
     float det = dot(s1, pvec);
 
@@ -104,7 +134,7 @@ inline bool intersectTriangleLocal(Ray *r, Triangle *tri, float *tres)
     if (fabs(det) < EPSILON) return false;
     float iDet = 1.0f / det;
 
-    float3 tvec = r->orig - tri->v0.p;
+    float3 tvec = r->orig - v0;
     float u = dot(tvec, pvec) * iDet;
     if (u < 0.0f || u > 1.0f) return false;
 
@@ -131,18 +161,8 @@ inline void intersectLight(Hit *hit, Ray *r, global RenderParams *params)
     float3 bl = (float3)(params->areaLight.pos + params->areaLight.size.x * params->areaLight.right - params->areaLight.size.y * params->areaLight.up);
     float3 br = (float3)(params->areaLight.pos - params->areaLight.size.x * params->areaLight.right - params->areaLight.size.y * params->areaLight.up);
 
-    Triangle T1;
-    T1.v0.p = tl;
-    T1.v1.p = bl;
-    T1.v2.p = br;
-    
-    Triangle T2;
-    T2.v0.p = tl;
-    T2.v1.p = br;
-    T2.v2.p = tr;
-
-    bool first = intersectTriangleLocal(r, &T1, &hit->t);
-    bool second = intersectTriangleLocal(r, &T2, &hit->t);
+    bool first = intersectTriangleLocal(r, tl, bl, br, &hit->t);
+    bool second = intersectTriangleLocal(r, tl, br, tr, &hit->t);
     
     if (first || second)
     {
@@ -31,6 +31,7 @@ private:
         err |= setArg("ggxRefrQueue",   ctx->deviceBuffers.ggxRefrMatQueue);
         err |= setArg("deltaQueue",     ctx->deviceBuffers.deltaMatQueue);
         err |= setArg("tris",           ctx->deviceBuffers.triangleBuffer);
+        err |= setArg("verts",           ctx->deviceBuffers.vertexBuffer);
         err |= setArg("nodes",          ctx->deviceBuffers.nodeBuffer);
         err |= setArg("indices",        ctx->deviceBuffers.indexBuffer);
         err |= setArg("envMap",         ctx->deviceBuffers.environmentMap);
@@ -68,6 +69,8 @@ private:
         int err = 0;
         err |= setArg("params", ctx->deviceBuffers.renderParams);
         err |= setArg("tris", ctx->deviceBuffers.triangleBuffer);
+        err |= setArg("verts", ctx->deviceBuffers.vertexBuffer);
+        err |= setArg("leafTris", ctx->deviceBuffers.leafTriangleBuffer);
         err |= setArg("nodes", ctx->deviceBuffers.nodeBuffer);
         err |= setArg("indices", ctx->deviceBuffers.indexBuffer);
         err |= setArg("pickResult", ctx->deviceBuffers.pickResult);
@@ -85,6 +88,8 @@ private:
         err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
         err |= setArg("extensionQueue", ctx->deviceBuffers.extensionQueue);
         err |= setArg("tris", ctx->deviceBuffers.triangleBuffer);
+        err |= setArg("verts", ctx->deviceBuffers.vertexBuffer);
+        err |= setArg("leafTris", ctx->deviceBuffers.leafTriangleBuffer);
         err |= setArg("nodes", ctx->deviceBuffers.nodeBuffer);
         err |= setArg("indices", ctx->deviceBuffers.indexBuffer);
         err |= setArg("params", ctx->deviceBuffers.renderParams);
@@ -102,9 +107,8 @@ private:
         err |= setArg("tasks", ctx->deviceBuffers.tasksBuffer);
         err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
         err |= setArg("shadowQueue", ctx->deviceBuffers.shadowQueue);
-        err |= setArg("tris", ctx->deviceBuffers.triangleBuffer);
+        err |= setArg("leafTris", ctx->deviceBuffers.leafTriangleBuffer);
         err |= setArg("nodes", ctx->deviceBuffers.nodeBuffer);
-        err |= setArg("indices", ctx->deviceBuffers.indexBuffer);
         err |= setArg("params", ctx->deviceBuffers.renderParams);
         err |= setArg("numTasks", ctx->getNumTasks());
         verify(err, "Failed to set wf_shadow arguments!");
@@ -221,6 +225,13 @@ private:
         err |= setArg("numTasks", ctx->getNumTasks());
         verify(err, "Failed to set wf_delta arguments!");
     }
+
+    std::string getAdditionalBuildOptions() override {
+        // Ideal reflection and/or dielectric, whichever exist in scene
+        Tracer* tracer = static_cast<Tracer*>(userPtr);
+        unsigned int typeBits = tracer->getScene()->getMaterialTypes();
+        return getBxdfDefines(typeBits & (BXDF_IDEAL_REFLECTION | BXDF_IDEAL_DIELECTRIC));
+    }
 };
 
 class WFAllMaterialsKernel : public flt::Kernel
@@ -267,6 +278,131 @@ private:
     }
 };
 
+class WFRayKeysKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("tasks", ctx->deviceBuffers.tasksBuffer);
+        err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
+        err |= setArg("extensionQueue", ctx->deviceBuffers.extensionQueue);
+        err |= setArg("rayKeys", ctx->deviceBuffers.rayKeys);
+        err |= setArg("rayBins", ctx->deviceBuffers.rayBins);
+        err |= setArg("params", ctx->deviceBuffers.renderParams);
+        err |= setArg("numTasks", ctx->getNumTasks());
+        verify(err, "Failed to set wf_ray_keys arguments!");
+    }
+};
+
+class WFRayScanKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("rayBins", ctx->deviceBuffers.rayBins);
+        verify(err, "Failed to set wf_ray_scan arguments!");
+    }
+};
+
+class WFRayScatterKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
+        err |= setArg("extensionQueue", ctx->deviceBuffers.extensionQueue);
+        err |= setArg("rayKeys", ctx->deviceBuffers.rayKeys);
+        err |= setArg("rayBins", ctx->deviceBuffers.rayBins);
+        err |= setArg("sortedQueue", ctx->deviceBuffers.sortedExtensionQueue);
+        verify(err, "Failed to set wf_ray_scatter arguments!");
+    }
+};
+
+class WFMatKeysKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("tasks", ctx->deviceBuffers.tasksBuffer);
+        err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
+        err |= setArg("diffuseQueue", ctx->deviceBuffers.diffuseMatQueue);
+        err |= setArg("glossyQueue", ctx->deviceBuffers.glossyMatQueue);
+        err |= setArg("ggxReflQueue", ctx->deviceBuffers.ggxReflMatQueue);
+        err |= setArg("ggxRefrQueue", ctx->deviceBuffers.ggxRefrMatQueue);
+        err |= setArg("deltaQueue", ctx->deviceBuffers.deltaMatQueue);
+        err |= setArg("matSortPaths", ctx->deviceBuffers.matSortPaths);
+        err |= setArg("matSortKeys", ctx->deviceBuffers.matSortKeys);
+        err |= setArg("matBins", ctx->deviceBuffers.matBins);
+        err |= setArg("numTasks", ctx->getNumTasks());
+        verify(err, "Failed to set wf_mat_keys arguments!");
+    }
+
+    std::string getAdditionalBuildOptions() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        return " -DWF_MAT_SORT_BINS_PER_QUEUE=" + std::to_string(ctx->getMatSortBinsPerQueue());
+    }
+};
+
+class WFMatScanKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("matBins", ctx->deviceBuffers.matBins);
+        verify(err, "Failed to set wf_mat_scan arguments!");
+    }
+
+    std::string getAdditionalBuildOptions() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        return " -DWF_MAT_SORT_BINS_PER_QUEUE=" + std::to_string(ctx->getMatSortBinsPerQueue());
+    }
+};
+
+class WFMatScatterKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
+        err |= setArg("diffuseQueue", ctx->deviceBuffers.diffuseMatQueue);
+        err |= setArg("glossyQueue", ctx->deviceBuffers.glossyMatQueue);
+        err |= setArg("ggxReflQueue", ctx->deviceBuffers.ggxReflMatQueue);
+        err |= setArg("ggxRefrQueue", ctx->deviceBuffers.ggxRefrMatQueue);
+        err |= setArg("deltaQueue", ctx->deviceBuffers.deltaMatQueue);
+        err |= setArg("matSortPaths", ctx->deviceBuffers.matSortPaths);
+        err |= setArg("matSortKeys", ctx->deviceBuffers.matSortKeys);
+        err |= setArg("matBins", ctx->deviceBuffers.matBins);
+        verify(err, "Failed to set wf_mat_scatter arguments!");
+    }
+
+    std::string getAdditionalBuildOptions() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        return " -DWF_MAT_SORT_BINS_PER_QUEUE=" + std::to_string(ctx->getMatSortBinsPerQueue());
+    }
+};
+
+class WFAdvanceKernel : public flt::Kernel
+{
+private:
+    void setArgs() override {
+        CLContext *ctx = getCtxPtr(userPtr);
+        int err = 0;
+        err |= setArg("queueLens", ctx->deviceBuffers.queueCounters);
+        err |= setArg("currPixelIdx", ctx->deviceBuffers.currentPixelIdx);
+        err |= setArg("statsRing", ctx->deviceBuffers.wfStatsRing);
+        err |= setArg("statsHead", ctx->deviceBuffers.wfStatsHead);
+        err |= setArg("params", ctx->deviceBuffers.renderParams);
+        err |= setArg("countSamples", (cl_uint)false);
+        verify(err, "Failed to set wf_advance arguments!");
+    }
+};
+
 class MKResetKernel : public flt::Kernel
 {
 private:
@@ -308,6 +444,8 @@ private:
         err |= setArg("textures", ctx->deviceBuffers.texDescriptorBuffer);
         err |= setArg("denoiserNormal", ctx->deviceBuffers.denoiserNormalBuffer);
         err |= setArg("tris", ctx->deviceBuffers.triangleBuffer);
+        err |= setArg("verts", ctx->deviceBuffers.vertexBuffer);
+        err |= setArg("leafTris", ctx->deviceBuffers.leafTriangleBuffer);
         err |= setArg("nodes", ctx->deviceBuffers.nodeBuffer);
         err |= setArg("indices", ctx->deviceBuffers.indexBuffer);
         err |= setArg("params", ctx->deviceBuffers.renderParams);
@@ -343,8 +481,9 @@ private:
         err |= setArg("aliasTable", ctx->deviceBuffers.aliasTable);
         err |= setArg("pdfTable", ctx->deviceBuffers.pdfTable);
         err |= setArg("tris", ctx->deviceBuffers.triangleBuffer);
+        err |= setArg("verts", ctx->deviceBuffers.vertexBuffer);
+        err |= setArg("leafTris", ctx->deviceBuffers.leafTriangleBuffer);
         err |= setArg("nodes", ctx->deviceBuffers.nodeBuffer);
-        err |= setArg("indices", ctx->deviceBuffers.indexBuffer);
         err |= setArg("params", ctx->deviceBuffers.renderParams);
         err |= setArg("stats", ctx->deviceBuffers.renderStats);
         err |= setArg("numTasks", ctx->getNumTasks());
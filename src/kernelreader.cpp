@@ -65,7 +65,8 @@ void verify(const char* msg, int err)
 }
 
 // Checks kernel cache for match, otherwise loads from source
-cl::Program kernelFromFile(const std::string path, const std::string buildOpts, cl::Platform & platform, cl::Context & context, cl::Device & device, int & err)
+// Called concurrently for different kernels
+cl::Program kernelFromFile(const std::string path, const std::string buildOpts, cl::Platform & platform, cl::Context & context, cl::Device & device, int & err, bool *cacheHit)
 {
     std::string filename = getFileName(path);
 
@@ -84,10 +85,11 @@ cl::Program kernelFromFile(const std::string path, const std::string buildOpts,
 
     // Try to open cached kernel binary
     std::ifstream binaryFile(binaryPath, std::ios::binary | std::ios::ate);
+    if (cacheHit)
+        *cacheHit = (bool)binaryFile;
+
     if (binaryFile)
     {
-        std::cout << "Loading hashed kernel " << binaryPath << std::endl;
-
         std::ifstream::pos_type pos = binaryFile.tellg();
         cl::vector<unsigned char> binary(pos);
         binaryFile.seekg(0, std::ios::beg);
@@ -109,8 +111,6 @@ cl::Program kernelFromFile(const std::string path, const std::string buildOpts,
     }
     else
     {
-        std::cout << "Building kernel " << filename << std::endl;
-
         kernelFromSourceExpanded(path, context, program, err);
         cl::vector<cl::Device> devices = { device };
         err = program.build(devices, buildOpts.c_str());
@@ -118,7 +118,7 @@ cl::Program kernelFromFile(const std::string path, const std::string buildOpts,
         // Check build log
         std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
         if (buildLog.length() > 2)
-            std::cout << "\n[" << filename << " build log]:" << buildLog << std::endl;
+            std::cout << "\n[" + filename + " build log]:" + buildLog + "\n" << std::flush;
 
         verify("Kernel compilation failed", err);
         
@@ -144,7 +144,6 @@ cl::Program kernelFromFile(const std::string path, const std::string buildOpts,
         }
         
         stream.close();
-        std::cout << "Created cached kernel " << binaryPath << std::endl;
     }
 
     return program;
@@ -0,0 +1,384 @@
+#include <chrono>
+#include "lbvh.hpp"
+#include "taskpool.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Count leading zeros, x != 0
+static inline int clz64(U64 x)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanReverse64(&idx, x);
+	return 63 - (int)idx;
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+// Insert two zero bits between each of the lowest 21 bits
+static inline U64 expandBits(U64 v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+LBVH::LBVH(TriangleMesh *mesh, bool sahTopLevels)
+{
+	m_mesh = mesh;
+	m_sahTopLevels = sahTopLevels;
+	m_maxLeafSize = LeafSize;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	U32 numThreads;
+	{
+		TaskPool pool;
+		numThreads = pool.numThreads();
+
+		std::vector<U32> order;
+		computeMortonCodes(pool, m_codes, order);
+		radixSort(pool, m_codes, order);
+
+		// Permute references into Morton order
+		std::vector<TriRef> sorted(m_refs.size());
+		pool.parallelFor(numThreads, [&](size_t c)
+		{
+			size_t s = sorted.size() * c / numThreads;
+			size_t e = sorted.size() * (c + 1) / numThreads;
+			for (size_t i = s; i < e; i++)
+				sorted[i] = m_refs[order[i]];
+		});
+		m_refs.swap(sorted);
+	}
+
+	// Emit nodes depth first, boxes computed bottom-up
+	m_nodes.reserve(2 * m_refs.size() / LeafSize + 1);
+	if (m_sahTopLevels)
+	{
+		createClusters();
+		emitClusters(0, (U32)m_clusters.size() - 1, -1, 0);
+		m_clusters.clear();
+	}
+	else
+	{
+		emit(0, (U32)m_refs.size() - 1, -1, 0);
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	createIndexList();
+	m_codes.clear();
+	m_codes.shrink_to_fit();
+
+	if (metrics.depth > MaxDepth)
+		std::cout << "WARN: LBVH might not fit traversal stack! (" << metrics.depth << " > " << MaxDepth << ")" << std::endl;
+
+	std::cout
+		<< "======================" << std::endl
+		<< (m_sahTopLevels ? "HLBVH" : "LBVH") << std::endl
+		<< "Build time: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms (" << numThreads << " threads)" << std::endl
+		<< "SAH cost: " << treeSahCost() << std::endl
+		<< "Splits: " << metrics.splits << " (" << int(metrics.bad_splits / float(metrics.splits) * 100.0f) << "% bad)" << std::endl
+		<< "Depth: " << metrics.depth << std::endl
+		<< "Leaves: " << metrics.splits + 1 << std::endl
+		<< "======================" << std::endl;
+}
+
+// Create references, quantize centroids to 21 bits per axis
+void LBVH::computeMortonCodes(TaskPool &pool, std::vector<U64> &codes, std::vector<U32> &order)
+{
+	const size_t N = m_mesh->size();
+	const U32 numChunks = pool.numThreads();
+	m_refs.resize(N);
+	codes.resize(N);
+	order.resize(N);
+
+	std::vector<AABB_t> chunkBounds(numChunks);
+	pool.parallelFor(numChunks, [&](size_t c)
+	{
+		size_t s = N * c / numChunks;
+		size_t e = N * (c + 1) / numChunks;
+		AABB_t bounds;
+		for (size_t i = s; i < e; i++)
+		{
+			m_refs[i] = TriRef((U32)i, *m_mesh);
+			bounds.min = vmin(bounds.min, m_refs[i].pos);
+			bounds.max = vmax(bounds.max, m_refs[i].pos);
+		}
+		chunkBounds[c] = bounds;
+	});
+
+	AABB_t centroidBounds;
+	for (const AABB_t &b : chunkBounds)
+		centroidBounds.expand(b);
+
+	const F32 maxCoord = (F32)((1 << MortonBits) - 1);
+	float3 extent = centroidBounds.max - centroidBounds.min;
+	float3 scale;
+	for (int dim = 0; dim < 3; dim++)
+		scale[dim] = (extent[dim] > 0.0f) ? maxCoord / extent[dim] : 0.0f;
+
+	pool.parallelFor(numChunks, [&](size_t c)
+	{
+		size_t s = N * c / numChunks;
+		size_t e = N * (c + 1) / numChunks;
+		for (size_t i = s; i < e; i++)
+		{
+			float3 q = (m_refs[i].pos - centroidBounds.min) * scale;
+			U64 x = (U64)std::min(std::max(q.x, 0.0f), maxCoord);
+			U64 y = (U64)std::min(std::max(q.y, 0.0f), maxCoord);
+			U64 z = (U64)std::min(std::max(q.z, 0.0f), maxCoord);
+			codes[i] = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+			order[i] = (U32)i;
+		}
+	});
+}
+
+// LSD radix sort, 8 bits per pass. Each chunk histograms and scatters its own range.
+void LBVH::radixSort(TaskPool &pool, std::vector<U64> &keys, std::vector<U32> &values)
+{
+	const size_t N = keys.size();
+	const U32 numChunks = pool.numThreads();
+	std::vector<U64> keysTmp(N);
+	std::vector<U32> valuesTmp(N);
+	std::vector<size_t> hist(numChunks * 256);
+
+	for (U32 shift = 0; shift < 3 * MortonBits; shift += 8)
+	{
+		std::fill(hist.begin(), hist.end(), 0);
+		pool.parallelFor(numChunks, [&](size_t c)
+		{
+			size_t s = N * c / numChunks;
+			size_t e = N * (c + 1) / numChunks;
+			size_t *h = &hist[c * 256];
+			for (size_t i = s; i < e; i++)
+				h[(keys[i] >> shift) & 0xFF]++;
+		});
+
+		// Digit shared by all keys => pass would not change order
+		bool trivial = false;
+		for (U32 d = 0; d < 256 && !trivial; d++)
+		{
+			size_t sum = 0;
+			for (U32 c = 0; c < numChunks; c++)
+				sum += hist[c * 256 + d];
+			trivial = (sum == N);
+		}
+		if (trivial)
+			continue;
+
+		// Exclusive prefix sum in (digit, chunk) order => stable scatter
+		size_t offset = 0;
+		for (U32 d = 0; d < 256; d++)
+		{
+			for (U32 c = 0; c < numChunks; c++)
+			{
+				size_t count = hist[c * 256 + d];
+				hist[c * 256 + d] = offset;
+				offset += count;
+			}
+		}
+
+		pool.parallelFor(numChunks, [&](size_t c)
+		{
+			size_t s = N * c / numChunks;
+			size_t e = N * (c + 1) / numChunks;
+			size_t *h = &hist[c * 256];
+			for (size_t i = s; i < e; i++)
+			{
+				size_t dst = h[(keys[i] >> shift) & 0xFF]++;
+				keysTmp[dst] = keys[i];
+				valuesTmp[dst] = values[i];
+			}
+		});
+
+		keys.swap(keysTmp);
+		values.swap(valuesTmp);
+	}
+}
+
+// Emit subtree over sorted refs [s, e], returns index of created node
+U32 LBVH::emit(U32 s, U32 e, S32 parentId, U32 depth)
+{
+	metrics.depth = std::max(metrics.depth, depth);
+
+	U32 ind = m_nodes.size();
+	m_nodes.push_back(Node());
+	m_nodes[ind].parent = parentId;
+
+	U32 count = e - s + 1;
+	if (count <= LeafSize)
+	{
+		AABB_t box;
+		for (U32 i = s; i <= e; i++)
+			box.expand(m_refs[i].box);
+
+		m_nodes[ind].box = box;
+		m_nodes[ind].iStart = s;
+		m_nodes[ind].nPrims = (U8)count;
+		return ind;
+	}
+
+	// Median splits once the depth budget runs out, subtree then fits within MaxDepth
+	U32 split = (depth + 1 + medianLevels(count) > MaxDepth) ? (s + e) / 2 : mortonSplit(s, e); // last index of left child
+	metrics.splits++;
+	U32 left = emit(s, split, ind, depth + 1);
+	U32 right = emit(split + 1, e, ind, depth + 1);
+
+	AABB_t box = m_nodes[left].box;
+	box.expand(m_nodes[right].box);
+	m_nodes[ind].box = box;
+	m_nodes[ind].rightChild = right;
+	return ind;
+}
+
+// Levels of median splits needed until ranges fit into leaves
+U32 LBVH::medianLevels(U32 count)
+{
+	U32 levels = 0;
+	for (U32 n = (count + LeafSize - 1) / LeafSize; n > 1; n = (n + 1) / 2)
+		levels++;
+	return levels;
+}
+
+// Binary search for highest differing bit (Karras 12)
+U32 LBVH::mortonSplit(U32 s, U32 e) const
+{
+	U64 first = m_codes[s];
+	U64 last = m_codes[e];
+
+	// Identical codes => median
+	if (first == last)
+		return (s + e) / 2;
+
+	int commonPrefix = clz64(first ^ last);
+	U32 split = s;
+	U32 step = e - s;
+
+	do
+	{
+		step = (step + 1) >> 1;
+		U32 newSplit = split + step;
+		if (newSplit < e && clz64(first ^ m_codes[newSplit]) > commonPrefix)
+			split = newSplit;
+	} while (step > 1);
+
+	return split;
+}
+
+// Runs of refs sharing the top Morton bits
+void LBVH::createClusters()
+{
+	const U32 shift = 3 * MortonBits - ClusterBits;
+	U32 s = 0;
+	for (U32 i = 1; i <= m_refs.size(); i++)
+	{
+		if (i < m_refs.size() && (m_codes[i] >> shift) == (m_codes[s] >> shift))
+			continue;
+
+		Cluster c;
+		c.s = s;
+		c.e = i - 1;
+		for (U32 j = c.s; j <= c.e; j++)
+			c.box.expand(m_refs[j].box);
+		m_clusters.push_back(c);
+		s = i;
+	}
+}
+
+// Full SAH sweep over clusters [s, e], single clusters are built as LBVH subtrees
+U32 LBVH::emitClusters(U32 s, U32 e, S32 parentId, U32 depth)
+{
+	if (s == e)
+		return emit(m_clusters[s].s, m_clusters[s].e, parentId, depth);
+
+	metrics.depth = std::max(metrics.depth, depth);
+	U32 ind = m_nodes.size();
+	m_nodes.push_back(Node());
+	m_nodes[ind].parent = parentId;
+
+	auto first = m_clusters.begin() + s;
+	auto last = m_clusters.begin() + e + 1;
+	auto sortClusters = [&](U32 dim)
+	{
+		// Ties broken by ref range => same order when re-sorting the winning axis
+		std::sort(first, last, [dim](const Cluster &a, const Cluster &b) {
+			const F32 ca = a.box.min[dim] + a.box.max[dim];
+			const F32 cb = b.box.min[dim] + b.box.max[dim];
+			return ca < cb || (ca == cb && a.s < b.s);
+		});
+	};
+
+	// Right-hand side lookup: bounds and ref counts
+	U32 n = e - s + 1;
+	std::vector<AABB_t> rightBoxes(n);
+	std::vector<U32> rightCounts(n);
+
+	F32 bestCost = FLT_MAX;
+	U32 bestDim = 0, bestSplit = 0;
+	for (U32 dim = 0; dim < 3; dim++)
+	{
+		sortClusters(dim);
+
+		AABB_t rb;
+		U32 rc = 0;
+		for (U32 i = n - 1; i > 0; i--)
+		{
+			const Cluster &c = m_clusters[s + i];
+			rb.expand(c.box);
+			rc += c.e - c.s + 1;
+			rightBoxes[i] = rb;
+			rightCounts[i] = rc;
+		}
+
+		AABB_t lb;
+		U32 lc = 0;
+		for (U32 i = 1; i < n; i++) // first cluster of right side
+		{
+			const Cluster &c = m_clusters[s + i - 1];
+			lb.expand(c.box);
+			lc += c.e - c.s + 1;
+			F32 cost = lb.area() * lc + rightBoxes[i].area() * rightCounts[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestDim = dim;
+				bestSplit = s + i - 1; // last cluster of left side
+			}
+		}
+	}
+
+	if (bestDim != 2)
+		sortClusters(bestDim);
+
+	// Out of depth budget: split at the ref count median instead
+	U32 refCount = 0;
+	for (U32 i = s; i <= e; i++)
+		refCount += m_clusters[i].e - m_clusters[i].s + 1;
+	if (depth + 1 + medianLevels(refCount) > MaxDepth)
+	{
+		U32 lc = 0;
+		for (bestSplit = s; bestSplit < e - 1; bestSplit++)
+		{
+			lc += m_clusters[bestSplit].e - m_clusters[bestSplit].s + 1;
+			if (2 * lc >= refCount)
+				break;
+		}
+	}
+
+	metrics.splits++;
+	U32 left = emitClusters(s, bestSplit, ind, depth + 1);
+	U32 right = emitClusters(bestSplit + 1, e, ind, depth + 1);
+
+	AABB_t box = m_nodes[left].box;
+	box.expand(m_nodes[right].box);
+	m_nodes[ind].box = box;
+	m_nodes[ind].rightChild = right;
+	return ind;
+}
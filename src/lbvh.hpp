@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include "bvh.hpp"
+
+class TaskPool;
+
+/*
+	Linear BVH, based on "Fast BVH Construction on GPUs" by Lauterbach et al. and Karras 12.
+	References sorted by 63-bit Morton codes of their centroids (parallel radix sort),
+	hierarchy emitted by splitting ranges at the highest differing bit.
+	HLBVH mode builds the top levels with SAH over clusters of refs that share
+	the top Morton bits (Pantaleoni & Luebke 10).
+	Much faster to build than the SBVH, at the cost of tree quality.
+*/
+class LBVH : public BVH
+{
+public:
+	LBVH(TriangleMesh *mesh, bool sahTopLevels);
+	~LBVH() {}
+
+private:
+	void computeMortonCodes(TaskPool &pool, std::vector<U64> &codes, std::vector<U32> &order);
+	void radixSort(TaskPool &pool, std::vector<U64> &keys, std::vector<U32> &values);
+	U32 emit(U32 s, U32 e, S32 parentId, U32 depth);
+	U32 emitClusters(U32 s, U32 e, S32 parentId, U32 depth);
+	U32 mortonSplit(U32 s, U32 e) const;
+	static U32 medianLevels(U32 count);
+	void createClusters();
+
+	enum
+	{
+		LeafSize = 4,
+		MortonBits = 21, // per axis
+		ClusterBits = 15 // HLBVH: 32^3 grid of top-level clusters
+	};
+
+	// HLBVH: range of refs with equal top Morton bits
+	struct Cluster
+	{
+		U32 s, e;
+		AABB_t box;
+	};
+
+	std::vector<U64> m_codes;
+	std::vector<Cluster> m_clusters;
+	bool m_sahTopLevels;
+};
@@ -15,6 +15,7 @@ int main(int argc, char* argv[])
     int height;
     int spp;
     bool interactiveMode;
+    bool headless;
     std::vector<std::string> scenes;
 
     // Parse command line arguments
@@ -38,6 +39,8 @@ int main(int argc, char* argv[])
 
         TCLAP::SwitchArg aBatch("b", "batch", "Batch mode", cmd, false);
 
+        TCLAP::SwitchArg aHeadless("", "headless", "Batch mode without window or GL interop", cmd, false);
+
         TCLAP::UnlabeledMultiArg<std::string> aScenes("Scene", "Scene(s) to render, file selector used if empty", false, "string");
         cmd.add(aScenes);
 
@@ -46,7 +49,8 @@ int main(int argc, char* argv[])
         width = aWidth.getValue();
         height = aHeight.getValue();
         spp = aSpp.getValue();
-        interactiveMode = !aBatch.getValue();
+        headless = aHeadless.getValue();
+        interactiveMode = !aBatch.getValue() && !headless;
         scenes = aScenes.getValue();
 
         if (width < 0)
@@ -70,13 +74,14 @@ int main(int argc, char* argv[])
     ilEnable(IL_FILE_OVERWRITE);
     ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
 
-    if (!glfwInit())
+    // Headless: no display needed
+    if (!headless && !glfwInit())
     {
         std::cout << "Could not initialize GLFW" << std::endl;
         waitExit();
     }
 
-    Tracer tracer(width, height);
+    Tracer tracer(width, height, headless);
 
     if (interactiveMode)
     {
@@ -91,7 +96,7 @@ int main(int argc, char* argv[])
         
     else
     {
-        std::cout << "Starting in batch mode" << std::endl;
+        std::cout << "Starting in " << (headless ? "headless " : "") << "batch mode" << std::endl;
         for (std::string &scene : scenes)
         {
             tracer.init(width, height, scene);
@@ -106,7 +111,8 @@ int main(int argc, char* argv[])
     }
         
 
-    glfwTerminate();
+    if (!headless)
+        glfwTerminate();
 
     return 0;
 }
@@ -11,6 +11,8 @@ kernel void nextVertex(
     global TexDescriptor *textures,
     global float *denoiserNormal, // for Optix denoiser
     global Triangle *tris,
+    global Vertex *verts,
+    global LeafTriangle *leafTris,
     global GPUNode *nodes,
     global uint *indices,
     global RenderParams *params,
@@ -36,9 +38,17 @@ kernel void nextVertex(
 
     // Trace ray
     Hit hit = EMPTY_HIT(FLT_MAX); // TODO: Max distance?
-    bvh_intersect(&r, &hit, tris, nodes, indices);
+    bvh_intersect(&r, &hit, tris, verts, leafTris, nodes, indices);
     if (params->sampleImpl && params->useAreaLight) intersectLight(&hit, &r, params);
 
+    // Ray cone width at hit, texture footprint scaled accordingly
+    if (hit.i > -1)
+    {
+        const float coneWidth = ReadF32(coneWidth, tasks) + pixelSpreadAngle(params) * hit.t;
+        WriteF32(coneWidth, tasks, coneWidth);
+        hit.uvFootprint *= coneWidth;
+    }
+
     // Write hit to path state
     writeHitSoA(hit, tasks, gid, numTasks);
 
@@ -82,7 +92,7 @@ kernel void nextVertex(
         if (params->sampleImpl && params->sampleExpl && params->useEnvMap && *len > 1 && !lastSpecular)
         {
             const float lightPickProb = 1.0f;
-            int2 dims = get_image_dim(envMap);
+            int2 dims = envMapTableDims(envMap);
             float directPdfW = envMapPdf(dims.x, dims.y, pdfTable, rayDir);
             float actualPdfW = ReadF32(lastPdfW, tasks);
             weight = (actualPdfW * lightPickProb) / (actualPdfW * lightPickProb + directPdfW);
@@ -56,6 +56,7 @@ kernel void genCameraRays(global GPUTaskState *tasks, global RenderParams *param
     // Construct camera ray
     WriteFloat3(orig, tasks, rayOrig);
     WriteFloat3(dir, tasks, rayDirection);
+    WriteF32(coneWidth, tasks, 0.0f);
 
     // Update path state
     WriteU32(seed, tasks, seed);
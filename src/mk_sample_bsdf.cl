@@ -19,8 +19,9 @@ kernel void sampleBsdf(
     global int *aliasTable,
     global float *pdfTable,
     global Triangle *tris,
+    global Vertex *verts,
+    global LeafTriangle *leafTris,
     global GPUNode *nodes,
-    global uint *indices,
     global RenderParams *params,
     global RenderStats *stats,
     uint numTasks)
@@ -46,7 +47,7 @@ kernel void sampleBsdf(
     Material mat = materials[hit.matId];
 
     // Apply potential normal map
-    hit.N = tangentSpaceNormal(hit, tris, mat, textures, texData);
+    hit.N = tangentSpaceNormal(hit, tris, verts, mat, textures, texData);
 
     // Fix backside hits
     bool backface = dot(hit.N, r.dir) > 0.0f;
@@ -60,7 +61,7 @@ kernel void sampleBsdf(
     if (isDiffuse && !(*diffuseHit))
     {
         *diffuseHit = 1;
-        float3 albedo = matGetFloat3(mat.Kd, hit.uvTex, mat.map_Kd, textures, texData); // not gamma-corrected
+        float3 albedo = matGetFloat3(mat.Kd, hit.uvTex, hit.uvFootprint, mat.map_Kd, textures, texData); // not gamma-corrected
         add_float4(denoiserAlbedo + gid * 4, (float4)(albedo, 1.0f));
     }
 #endif
@@ -73,13 +74,13 @@ kernel void sampleBsdf(
         // Importance sample env map (using alias method)
         if (params->useEnvMap)
         {
-            int2 envMapDims = get_image_dim(envMap);
+            int2 envMapDims = envMapTableDims(envMap);
             const int width = envMapDims.x, height = envMapDims.y;
 
             float3 L;
             float directPdfW = 0.0f;
             EnvMapContext ctx = { width, height, pdfTable, probTable, aliasTable };
-            sampleEnvMapAlias(rand(&seed), &L, &directPdfW, ctx);
+            sampleEnvMapAlias(rand(&seed), (float2)(rand(&seed), rand(&seed)), &L, &directPdfW, ctx);
 
             // Shadow ray
             float lenL = 2.0f * params->worldRadius;
@@ -89,7 +90,7 @@ kernel void sampleBsdf(
             // TODO: BAD! Collect all shadow ray casts together (in queue, i.e. buffer of gids + atomic counter)!
             Hit hitL = EMPTY_HIT(lenL);
             if (params->useAreaLight) intersectLight(&hitL, &rLight, params);
-            bool occluded = (hitL.i > -1) || bvh_occluded(&rLight, &lenL, tris, nodes, indices);
+            bool occluded = (hitL.i > -1) || bvh_occluded(&rLight, &lenL, leafTris, nodes);
             atomic_inc(&stats->shadowRays);
 
             // Compute contribution
@@ -128,7 +129,7 @@ kernel void sampleBsdf(
             Ray rLight = { orig, L };
 
             // TODO: BAD! Collect all shadow ray casts together (in queue, i.e. buffer of gids + atomic counter)!
-            bool occluded = bvh_occluded(&rLight, &lenL, tris, nodes, indices);
+            bool occluded = bvh_occluded(&rLight, &lenL, leafTris, nodes);
             atomic_inc(&stats->shadowRays);
 
             // Calculate direct lighting
@@ -0,0 +1,360 @@
+#include "objparser.hpp"
+#include "taskpool.hpp"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+struct ObjParser::Event
+{
+    size_t tri;       // first affected triangle, chunk-local
+    bool library;     // mtllib, otherwise usemtl
+    std::string name; // material name or file list
+};
+
+struct ObjParser::Chunk
+{
+    const char *begin, *end;
+    std::vector<float> v, vn, vt;
+    std::vector<Index> indices;
+    std::vector<size_t> relative[3]; // entries of indices relative to chunk start (v, vt, vn)
+    std::vector<Event> events;
+
+    // Filled in by serial merge step
+    size_t offsets[3]; // first global v, vt, vn
+    size_t firstTri;
+    int startMaterial;
+    std::vector<int> eventMaterials;
+};
+
+static const size_t MinChunkSize = 1 << 20;
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+static inline bool isDigit(char c) { return (unsigned)(c - '0') < 10u; }
+static inline bool isDelimiter(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+static inline void skipSpace(const char *&p, const char *end)
+{
+    while (p < end && isSpace(*p)) p++;
+}
+
+static inline float parseFloat(const char *&p, const char *end)
+{
+    skipSpace(p, end);
+    const char *s = p;
+    while (p < end && !isDelimiter(*p)) p++;
+    return stringToFloat(s, p);
+}
+
+static inline int parseInt(const char *&p, const char *end)
+{
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
+        negative = (*p++ == '-');
+
+    int value = 0;
+    for (; p < end && isDigit(*p); p++)
+        value = value * 10 + (*p - '0');
+
+    while (p < end && *p != '/' && !isDelimiter(*p)) p++; // skip garbage
+    return (negative) ? -value : value;
+}
+
+static inline bool startsWith(const char *p, const char *end, const char *keyword, size_t len)
+{
+    return (size_t)(end - p) > len && strncmp(p, keyword, len) == 0 && isSpace(p[len]);
+}
+
+ObjParser::ObjParser(const std::string filePath, const std::string mtlBaseDir)
+    : filePath(filePath), mtlBaseDir(mtlBaseDir)
+{
+}
+
+void ObjParser::parseChunk(Chunk &chunk)
+{
+    struct FaceVertex
+    {
+        Index ind;
+        bool relative[3];
+    };
+
+    std::vector<FaceVertex> face;
+    face.reserve(8);
+
+    // Same semantics as tinyobj's fixIndex, relative indices resolved against chunk start
+    auto fixIndex = [](int idx, size_t count, bool &relative) -> int
+    {
+        relative = (idx < 0);
+        if (idx > 0) return idx - 1;
+        if (idx == 0) return 0;
+        return (int)count + idx;
+    };
+
+    const char *p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char *lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+        if (!lineEnd) lineEnd = chunk.end;
+        const char *next = lineEnd + 1;
+        if (lineEnd > p && lineEnd[-1] == '\r') lineEnd--;
+
+        skipSpace(p, lineEnd);
+        if (p == lineEnd || *p == '#')
+        {
+            p = next;
+            continue;
+        }
+
+        if (p[0] == 'v' && lineEnd - p > 1 && isSpace(p[1]))
+        {
+            p += 2;
+            float x = parseFloat(p, lineEnd);
+            float y = parseFloat(p, lineEnd);
+            float z = parseFloat(p, lineEnd);
+            chunk.v.push_back(x);
+            chunk.v.push_back(y);
+            chunk.v.push_back(z);
+        }
+        else if (startsWith(p, lineEnd, "vn", 2))
+        {
+            p += 3;
+            float x = parseFloat(p, lineEnd);
+            float y = parseFloat(p, lineEnd);
+            float z = parseFloat(p, lineEnd);
+            chunk.vn.push_back(x);
+            chunk.vn.push_back(y);
+            chunk.vn.push_back(z);
+        }
+        else if (startsWith(p, lineEnd, "vt", 2))
+        {
+            p += 3;
+            float u = parseFloat(p, lineEnd);
+            float v = parseFloat(p, lineEnd);
+            chunk.vt.push_back(u);
+            chunk.vt.push_back(v);
+        }
+        else if (p[0] == 'f' && lineEnd - p > 1 && isSpace(p[1]))
+        {
+            p += 2;
+            skipSpace(p, lineEnd);
+
+            // Parse triples: i, i/j, i//k, i/j/k
+            face.clear();
+            while (p < lineEnd)
+            {
+                FaceVertex fv;
+                fv.ind.vt = fv.ind.vn = -1;
+                fv.relative[1] = fv.relative[2] = false;
+                fv.ind.v = fixIndex(parseInt(p, lineEnd), chunk.v.size() / 3, fv.relative[0]);
+                if (p < lineEnd && *p == '/')
+                {
+                    p++;
+                    if (p < lineEnd && *p != '/')
+                        fv.ind.vt = fixIndex(parseInt(p, lineEnd), chunk.vt.size() / 2, fv.relative[1]);
+                    if (p < lineEnd && *p == '/')
+                    {
+                        p++;
+                        fv.ind.vn = fixIndex(parseInt(p, lineEnd), chunk.vn.size() / 3, fv.relative[2]);
+                    }
+                }
+                face.push_back(fv);
+                while (p < lineEnd && isDelimiter(*p)) p++;
+            }
+
+            // Polygon -> triangle fan
+            for (size_t k = 2; k < face.size(); k++)
+            {
+                const FaceVertex *tri[3] = { &face[0], &face[k - 1], &face[k] };
+                for (const FaceVertex *fv : tri)
+                {
+                    for (int a = 0; a < 3; a++)
+                        if (fv->relative[a]) chunk.relative[a].push_back(chunk.indices.size());
+                    chunk.indices.push_back(fv->ind);
+                }
+            }
+        }
+        else if (startsWith(p, lineEnd, "usemtl", 6))
+        {
+            p += 7;
+            skipSpace(p, lineEnd);
+            const char *nameEnd = p;
+            while (nameEnd < lineEnd && !isDelimiter(*nameEnd)) nameEnd++;
+            chunk.events.push_back({ chunk.indices.size() / 3, false, std::string(p, nameEnd) });
+        }
+        else if (startsWith(p, lineEnd, "mtllib", 6))
+        {
+            p += 7;
+            chunk.events.push_back({ chunk.indices.size() / 3, true, std::string(p, lineEnd) });
+        }
+
+        // Groups, objects, smoothing groups etc. ignored
+        p = next;
+    }
+}
+
+// Use the first library in the list that can be opened
+void ObjParser::loadMaterialLibs(const std::string &line)
+{
+    const char *p = line.c_str();
+    const char *end = p + line.length();
+    while (p < end)
+    {
+        skipSpace(p, end);
+        const char *nameEnd = p;
+        while (nameEnd < end && !isSpace(*nameEnd)) nameEnd++;
+        std::string name(p, nameEnd);
+        p = nameEnd;
+
+        if (name.empty())
+            continue;
+
+        materialLibs.push_back(mtlBaseDir + name);
+        std::ifstream stream(mtlBaseDir + name);
+        if (!stream)
+        {
+            std::cerr << "WARN: Material file [ " << mtlBaseDir + name << " ] not found." << std::endl;
+            continue;
+        }
+
+        std::string warning;
+        tinyobj::LoadMtl(&materialMap, &materials, &stream, &warning);
+        if (!warning.empty())
+            std::cerr << warning << std::endl;
+
+        return;
+    }
+
+    std::cerr << "WARN: Failed to load material file(s). Use default material." << std::endl;
+}
+
+bool ObjParser::parse()
+{
+    MappedFile file(filePath);
+    if (!file.valid())
+    {
+        std::cout << "Could not read file: " << filePath << std::endl;
+        return false;
+    }
+
+    TaskPool pool;
+    const char *data = file.data();
+    const size_t size = file.size();
+
+    // Split at line boundaries
+    size_t numChunks = std::max((size_t)1, std::min(size / MinChunkSize, (size_t)pool.numThreads() * 8));
+    std::vector<Chunk> chunks(numChunks);
+    const char *start = data;
+    for (size_t c = 0; c < numChunks; c++)
+    {
+        const char *end = data + size * (c + 1) / numChunks;
+        if (c + 1 < numChunks && end > start)
+        {
+            const char *nl = (const char*)memchr(end - 1, '\n', data + size - (end - 1));
+            end = (nl) ? nl + 1 : data + size;
+        }
+        end = std::max(start, end);
+        chunks[c].begin = start;
+        chunks[c].end = end;
+        start = end;
+    }
+
+    pool.parallelFor(numChunks, [&](size_t c)
+    {
+        parseChunk(chunks[c]);
+    });
+
+    // Offsets and material state in file order, material libraries loaded as encountered
+    size_t counts[3] = { 0, 0, 0 };
+    size_t numTris = 0;
+    int material = -1;
+    for (Chunk &chunk : chunks)
+    {
+        chunk.offsets[0] = counts[0];
+        chunk.offsets[1] = counts[1];
+        chunk.offsets[2] = counts[2];
+        chunk.firstTri = numTris;
+        chunk.startMaterial = material;
+        counts[0] += chunk.v.size() / 3;
+        counts[1] += chunk.vt.size() / 2;
+        counts[2] += chunk.vn.size() / 3;
+        numTris += chunk.indices.size() / 3;
+
+        for (Event &e : chunk.events)
+        {
+            if (e.library)
+            {
+                loadMaterialLibs(e.name);
+            }
+            else
+            {
+                auto it = materialMap.find(e.name);
+                material = (it != materialMap.end()) ? it->second : -1;
+            }
+            chunk.eventMaterials.push_back(material);
+        }
+    }
+
+    positions.resize(counts[0] * 3);
+    texcoords.resize(counts[1] * 2);
+    normals.resize(counts[2] * 3);
+    indices.resize(numTris * 3);
+    materialIds.resize(numTris);
+
+    // Merge chunks, fix up relative indices
+    std::atomic<size_t> invalid(0);
+    pool.parallelFor(numChunks, [&](size_t c)
+    {
+        Chunk &chunk = chunks[c];
+        std::copy(chunk.v.begin(), chunk.v.end(), positions.begin() + chunk.offsets[0] * 3);
+        std::copy(chunk.vt.begin(), chunk.vt.end(), texcoords.begin() + chunk.offsets[1] * 2);
+        std::copy(chunk.vn.begin(), chunk.vn.end(), normals.begin() + chunk.offsets[2] * 3);
+
+        for (size_t i : chunk.relative[0]) chunk.indices[i].v += (int)chunk.offsets[0];
+        for (size_t i : chunk.relative[1]) chunk.indices[i].vt += (int)chunk.offsets[1];
+        for (size_t i : chunk.relative[2]) chunk.indices[i].vn += (int)chunk.offsets[2];
+
+        size_t bad = 0;
+        Index *dst = indices.data() + chunk.firstTri * 3;
+        for (size_t i = 0; i < chunk.indices.size(); i++)
+        {
+            Index ind = chunk.indices[i];
+            if (ind.v < 0 || (size_t)ind.v >= counts[0]) bad++;
+            if (ind.vt >= (int)counts[1] || ind.vt < -1) ind.vt = -1;
+            if (ind.vn >= (int)counts[2] || ind.vn < -1) ind.vn = -1;
+            dst[i] = ind;
+        }
+        invalid += bad;
+
+        int *mat = materialIds.data() + chunk.firstTri;
+        size_t chunkTris = chunk.indices.size() / 3;
+        size_t t = 0;
+        int current = chunk.startMaterial;
+        for (size_t e = 0; e <= chunk.events.size(); e++)
+        {
+            size_t until = (e < chunk.events.size()) ? chunk.events[e].tri : chunkTris;
+            std::fill(mat + t, mat + until, current);
+            t = until;
+            if (e < chunk.events.size()) current = chunk.eventMaterials[e];
+        }
+
+        // Release chunk memory early
+        std::vector<float>().swap(chunk.v);
+        std::vector<float>().swap(chunk.vt);
+        std::vector<float>().swap(chunk.vn);
+        std::vector<Index>().swap(chunk.indices);
+    });
+
+    if (invalid > 0)
+    {
+        std::cout << "OBJ file references " << invalid << " nonexistent vertices" << std::endl;
+        return false;
+    }
+
+    std::cout << "Parsed " << counts[0] << " vertices, " << numTris << " triangles ("
+              << numChunks << " chunks, " << pool.numThreads() << " threads)" << std::endl;
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "tiny_obj_loader.h"
+
+/*
+    Parallel OBJ parser.
+    The memory-mapped file is split into chunks at line boundaries, chunks are parsed
+    on all cores and merged in file order. Relative (negative) indices are resolved
+    against the chunk start and fixed up during the merge.
+    Polygons are fan-triangulated, output matches tinyobj::LoadObj.
+*/
+class ObjParser
+{
+public:
+    struct Index
+    {
+        int v, vt, vn; // zero-based, -1 if missing
+    };
+
+    ObjParser(const std::string filePath, const std::string mtlBaseDir);
+
+    bool parse(); // false if file could not be read
+
+    std::vector<float> positions; // xyz
+    std::vector<float> normals;   // xyz
+    std::vector<float> texcoords; // uv
+    std::vector<Index> indices;   // three per triangle
+    std::vector<int> materialIds; // per triangle, -1 if none
+    std::vector<tinyobj::material_t> materials;
+    std::vector<std::string> materialLibs; // requested .mtl paths, found or not
+
+private:
+    struct Event; // usemtl or mtllib statement
+    struct Chunk;
+
+    void parseChunk(Chunk &chunk);
+    void loadMaterialLibs(const std::string &line);
+
+    std::string filePath;
+    std::string mtlBaseDir;
+    std::map<std::string, int> materialMap;
+};
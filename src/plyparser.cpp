@@ -0,0 +1,513 @@
+#include "plyparser.hpp"
+#include "taskpool.hpp"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+
+static const size_t TypeSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+static const size_t VertexBlock = 1 << 16;
+static const size_t FaceBlock = 1 << 16;
+
+enum Attribute { Attr_X, Attr_Y, Attr_Z, Attr_NX, Attr_NY, Attr_NZ, NumAttributes };
+static const char *AttributeNames[NumAttributes] = { "x", "y", "z", "nx", "ny", "nz" };
+
+template<typename T>
+static inline T load(const char *p, bool swap)
+{
+    char bytes[sizeof(T)];
+    memcpy(bytes, p, sizeof(T));
+    if (swap) std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+// Decodes a strided column with type switch hoisted out of the loop
+template<typename T>
+static void decodeColumn(float *dst, size_t dstStride, const char *src, size_t srcStride, size_t count, bool swap)
+{
+    if (swap)
+    {
+        for (size_t i = 0; i < count; i++)
+            dst[i * dstStride] = (float)load<T>(src + i * srcStride, true);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            dst[i * dstStride] = (float)load<T>(src + i * srcStride, false);
+    }
+}
+
+static void decodeColumn(float *dst, size_t dstStride, const char *src, size_t srcStride, size_t count, int type, bool swap)
+{
+    switch (type)
+    {
+    case 0: decodeColumn<int8_t>(dst, dstStride, src, srcStride, count, swap); break;
+    case 1: decodeColumn<uint8_t>(dst, dstStride, src, srcStride, count, swap); break;
+    case 2: decodeColumn<int16_t>(dst, dstStride, src, srcStride, count, swap); break;
+    case 3: decodeColumn<uint16_t>(dst, dstStride, src, srcStride, count, swap); break;
+    case 4: decodeColumn<int32_t>(dst, dstStride, src, srcStride, count, swap); break;
+    case 5: decodeColumn<uint32_t>(dst, dstStride, src, srcStride, count, swap); break;
+    case 6: decodeColumn<float>(dst, dstStride, src, srcStride, count, swap); break;
+    case 7: decodeColumn<double>(dst, dstStride, src, srcStride, count, swap); break;
+    }
+}
+
+static inline int64_t loadInt(const char *p, int type, bool swap)
+{
+    switch (type)
+    {
+    case 0: return load<int8_t>(p, swap);
+    case 1: return load<uint8_t>(p, swap);
+    case 2: return load<int16_t>(p, swap);
+    case 3: return load<uint16_t>(p, swap);
+    case 4: return load<int32_t>(p, swap);
+    case 5: return load<uint32_t>(p, swap);
+    case 6: return (int64_t)load<float>(p, swap);
+    case 7: return (int64_t)load<double>(p, swap);
+    }
+    return 0;
+}
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+// Next whitespace separated token in ascii data
+static inline bool nextToken(const char *&p, const char *end, const char *&tokEnd)
+{
+    while (p < end && isSpace(*p)) p++;
+    tokEnd = p;
+    while (tokEnd < end && !isSpace(*tokEnd)) tokEnd++;
+    return tokEnd > p;
+}
+
+static inline unsigned parseUnsigned(const char *p, const char *end)
+{
+    unsigned value = 0;
+    for (; p < end && (unsigned)(*p - '0') < 10u; p++)
+        value = value * 10 + (*p - '0');
+    return value;
+}
+
+static int findAttribute(const std::string &name)
+{
+    for (int a = 0; a < NumAttributes; a++)
+        if (name == AttributeNames[a]) return a;
+    return -1;
+}
+
+static bool isIndexList(const std::string &name)
+{
+    return name == "vertex_indices" || name == "vertex_index";
+}
+
+PlyParser::PlyParser(const std::string filePath) : filePath(filePath)
+{
+}
+
+PlyParser::Type PlyParser::parseType(const std::string &name)
+{
+    if (name == "char" || name == "int8") return Type_Int8;
+    if (name == "uchar" || name == "uint8") return Type_UInt8;
+    if (name == "short" || name == "int16") return Type_Int16;
+    if (name == "ushort" || name == "uint16") return Type_UInt16;
+    if (name == "int" || name == "int32") return Type_Int32;
+    if (name == "uint" || name == "uint32") return Type_UInt32;
+    if (name == "float" || name == "float32") return Type_Float32;
+    if (name == "double" || name == "float64") return Type_Float64;
+    return Type_Invalid;
+}
+
+bool PlyParser::parseHeader(const char *&p, const char *end)
+{
+    bool first = true;
+    while (p < end)
+    {
+        const char *lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (!lineEnd) return false;
+        std::istringstream iss(std::string(p, lineEnd));
+        p = lineEnd + 1;
+
+        std::string s;
+        iss >> s;
+        if (first)
+        {
+            if (s != "ply") return false;
+            first = false;
+        }
+        else if (s == "format")
+        {
+            std::string f;
+            iss >> f;
+            if (f == "ascii") format = Format_Ascii;
+            else if (f == "binary_little_endian") format = Format_BinaryLE;
+            else if (f == "binary_big_endian") format = Format_BinaryBE;
+            else
+            {
+                std::cout << "Unknown PLY format " << f << std::endl;
+                return false;
+            }
+        }
+        else if (s == "element")
+        {
+            Element e;
+            iss >> e.name >> e.count;
+            e.stride = 0;
+            elements.push_back(e);
+        }
+        else if (s == "property")
+        {
+            if (elements.empty()) return false;
+            Property prop;
+            std::string type;
+            iss >> type;
+            prop.list = (type == "list");
+            prop.countType = Type_Invalid;
+            if (prop.list)
+            {
+                std::string countType;
+                iss >> countType >> type;
+                prop.countType = parseType(countType);
+                if (prop.countType == Type_Invalid) return false;
+            }
+            prop.type = parseType(type);
+            iss >> prop.name;
+            if (prop.type == Type_Invalid)
+            {
+                std::cout << "Unknown PLY property type " << type << std::endl;
+                return false;
+            }
+            elements.back().props.push_back(prop);
+        }
+        else if (s == "end_header")
+        {
+            // Precompute record layout of fixed size elements
+            for (Element &e : elements)
+            {
+                size_t offset = 0;
+                bool fixed = true;
+                for (Property &prop : e.props)
+                {
+                    prop.offset = offset;
+                    fixed &= !prop.list;
+                    offset += (prop.list) ? 0 : TypeSizes[prop.type];
+                }
+                e.stride = (fixed) ? offset : 0;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool PlyParser::readAscii(const char *p, const char *end)
+{
+    const char *tokEnd;
+    std::vector<unsigned> face;
+
+    for (const Element &e : elements)
+    {
+        const bool isVertex = (e.name == "vertex");
+        const bool isFace = (e.name == "face");
+
+        std::vector<int> attribs;
+        for (const Property &prop : e.props)
+            attribs.push_back((isVertex && !prop.list) ? findAttribute(prop.name) : -1);
+
+        if (isVertex)
+        {
+            positions.resize(e.count * 3);
+            if (std::any_of(attribs.begin(), attribs.end(), [](int a) { return a >= Attr_NX; }))
+                normals.resize(e.count * 3);
+        }
+
+        for (size_t i = 0; i < e.count; i++)
+        {
+            for (size_t j = 0; j < e.props.size(); j++)
+            {
+                const Property &prop = e.props[j];
+                if (!nextToken(p, end, tokEnd)) return false;
+
+                if (prop.list)
+                {
+                    size_t count = parseUnsigned(p, tokEnd);
+                    p = tokEnd;
+                    const bool gather = isFace && isIndexList(prop.name);
+                    face.clear();
+                    for (size_t k = 0; k < count; k++)
+                    {
+                        if (!nextToken(p, end, tokEnd)) return false;
+                        if (gather) face.push_back(parseUnsigned(p, tokEnd));
+                        p = tokEnd;
+                    }
+
+                    // Polygon -> triangle fan
+                    for (size_t k = 2; k < face.size(); k++)
+                    {
+                        indices.push_back(face[0]);
+                        indices.push_back(face[k - 1]);
+                        indices.push_back(face[k]);
+                    }
+                }
+                else
+                {
+                    int a = attribs[j];
+                    if (a >= Attr_NX)
+                        normals[3 * i + a - Attr_NX] = stringToFloat(p, tokEnd);
+                    else if (a >= 0)
+                        positions[3 * i + a] = stringToFloat(p, tokEnd);
+                    p = tokEnd;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+const char* PlyParser::skipProperty(const Property &prop, const char *p, const char *end) const
+{
+    if (prop.list)
+    {
+        if (p + TypeSizes[prop.countType] > end) return nullptr;
+        int64_t count = loadInt(p, prop.countType, swapBytes);
+        p += TypeSizes[prop.countType] + std::max(count, (int64_t)0) * TypeSizes[prop.type];
+    }
+    else
+    {
+        p += TypeSizes[prop.type];
+    }
+
+    return (p > end) ? nullptr : p;
+}
+
+const char* PlyParser::skipBinaryRecord(const Element &e, const char *p, const char *end) const
+{
+    for (size_t i = 0; i < e.props.size() && p; i++)
+        p = skipProperty(e.props[i], p, end);
+
+    return p;
+}
+
+bool PlyParser::readBinaryVertices(TaskPool &pool, const Element &e, const char *&p, const char *end)
+{
+    int offsets[NumAttributes], types[NumAttributes];
+    std::fill(offsets, offsets + NumAttributes, -1);
+    for (const Property &prop : e.props)
+    {
+        int a = findAttribute(prop.name);
+        if (a >= 0 && !prop.list)
+        {
+            offsets[a] = (int)prop.offset;
+            types[a] = prop.type;
+        }
+    }
+
+    positions.resize(e.count * 3, 0.0f);
+    if (offsets[Attr_NX] >= 0 || offsets[Attr_NY] >= 0 || offsets[Attr_NZ] >= 0)
+        normals.resize(e.count * 3, 0.0f);
+
+    if (e.stride > 0)
+    {
+        // Fixed size records => decode blocks of columns in parallel
+        if ((size_t)(end - p) < e.count * e.stride) return false;
+        const char *base = p;
+        size_t numBlocks = (e.count + VertexBlock - 1) / VertexBlock;
+        pool.parallelFor(numBlocks, [&](size_t b)
+        {
+            size_t s = b * VertexBlock;
+            size_t n = std::min(VertexBlock, e.count - s);
+            for (int a = 0; a < NumAttributes; a++)
+            {
+                if (offsets[a] < 0) continue;
+                float *dst = (a >= Attr_NX) ? &normals[3 * s + a - Attr_NX] : &positions[3 * s + a];
+                decodeColumn(dst, 3, base + s * e.stride + offsets[a], e.stride, n, types[a], swapBytes);
+            }
+        });
+        p += e.count * e.stride;
+        return true;
+    }
+
+    // Lists in vertex records, walk serially
+    for (size_t i = 0; i < e.count; i++)
+    {
+        const char *rec = p;
+        for (const Property &prop : e.props)
+        {
+            int a = findAttribute(prop.name);
+            if (a >= 0 && !prop.list && rec + TypeSizes[prop.type] <= end)
+            {
+                float *dst = (a >= Attr_NX) ? &normals[3 * i + a - Attr_NX] : &positions[3 * i + a];
+                decodeColumn(dst, 3, rec, 0, 1, prop.type, swapBytes);
+            }
+            rec = skipProperty(prop, rec, end);
+            if (!rec) return false;
+        }
+        p = rec;
+    }
+
+    return true;
+}
+
+bool PlyParser::readBinaryFaces(TaskPool &pool, const Element &e, const char *&p, const char *end)
+{
+    // First pass: record start of each block and its first triangle
+    size_t numBlocks = (e.count + FaceBlock - 1) / FaceBlock;
+    std::vector<const char*> blockStart(numBlocks + 1);
+    std::vector<size_t> blockTris(numBlocks + 1);
+    size_t numTris = 0;
+    for (size_t i = 0; i < e.count; i++)
+    {
+        if (i % FaceBlock == 0)
+        {
+            blockStart[i / FaceBlock] = p;
+            blockTris[i / FaceBlock] = numTris;
+        }
+
+        for (const Property &prop : e.props)
+        {
+            if (prop.list)
+            {
+                if (p + TypeSizes[prop.countType] > end) return false;
+                int64_t count = loadInt(p, prop.countType, swapBytes);
+                if (isIndexList(prop.name) && count > 2) numTris += (size_t)count - 2;
+                p += TypeSizes[prop.countType] + std::max(count, (int64_t)0) * TypeSizes[prop.type];
+            }
+            else
+            {
+                p += TypeSizes[prop.type];
+            }
+
+            if (p > end) return false;
+        }
+    }
+    blockStart[numBlocks] = p;
+    blockTris[numBlocks] = numTris;
+
+    // Second pass: fan-triangulate blocks in parallel
+    size_t first = indices.size();
+    indices.resize(first + numTris * 3);
+    pool.parallelFor(numBlocks, [&](size_t b)
+    {
+        const char *rec = blockStart[b];
+        unsigned *dst = &indices[first + 3 * blockTris[b]];
+        size_t n = std::min(FaceBlock, e.count - b * FaceBlock);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (const Property &prop : e.props)
+            {
+                if (!prop.list)
+                {
+                    rec += TypeSizes[prop.type];
+                    continue;
+                }
+
+                int64_t count = loadInt(rec, prop.countType, swapBytes);
+                rec += TypeSizes[prop.countType];
+                size_t size = TypeSizes[prop.type];
+                if (isIndexList(prop.name))
+                {
+                    unsigned i0 = (unsigned)loadInt(rec, prop.type, swapBytes);
+                    for (int64_t k = 2; k < count; k++)
+                    {
+                        *dst++ = i0;
+                        *dst++ = (unsigned)loadInt(rec + (k - 1) * size, prop.type, swapBytes);
+                        *dst++ = (unsigned)loadInt(rec + k * size, prop.type, swapBytes);
+                    }
+                }
+                rec += std::max(count, (int64_t)0) * size;
+            }
+        }
+    });
+
+    return true;
+}
+
+bool PlyParser::readBinary(TaskPool &pool, const char *p, const char *end)
+{
+    for (const Element &e : elements)
+    {
+        if (e.name == "vertex")
+        {
+            if (!readBinaryVertices(pool, e, p, end)) return false;
+        }
+        else if (e.name == "face")
+        {
+            if (!readBinaryFaces(pool, e, p, end)) return false;
+        }
+        else if (e.stride > 0)
+        {
+            std::cout << "Skipping element of type " << e.name << std::endl;
+            if ((size_t)(end - p) < e.count * e.stride) return false;
+            p += e.count * e.stride;
+        }
+        else
+        {
+            std::cout << "Skipping element of type " << e.name << std::endl;
+            for (size_t i = 0; i < e.count && p; i++)
+                p = skipBinaryRecord(e, p, end);
+            if (!p) return false;
+        }
+    }
+
+    return true;
+}
+
+bool PlyParser::parse()
+{
+    MappedFile file(filePath);
+    if (!file.valid())
+    {
+        std::cout << "Could not read file: " << filePath << std::endl;
+        return false;
+    }
+
+    const char *p = file.data();
+    const char *end = p + file.size();
+    if (!parseHeader(p, end))
+    {
+        std::cout << "Invalid PLY header" << std::endl;
+        return false;
+    }
+
+    const uint16_t one = 1;
+    const bool hostLittleEndian = (*(const char*)&one == 1);
+    swapBytes = (format == Format_BinaryLE) != hostLittleEndian;
+
+    TaskPool pool;
+    bool ok = (format == Format_Ascii) ? readAscii(p, end) : readBinary(pool, p, end);
+    if (!ok)
+    {
+        std::cout << "PLY file truncated" << std::endl;
+        return false;
+    }
+
+    // Validate indices
+    const size_t numVerts = positions.size() / 3;
+    std::atomic<size_t> invalid(0);
+    const size_t numChunks = pool.numThreads() * 4;
+    pool.parallelFor(numChunks, [&](size_t c)
+    {
+        size_t s = indices.size() * c / numChunks;
+        size_t e = indices.size() * (c + 1) / numChunks;
+        size_t bad = 0;
+        for (size_t i = s; i < e; i++)
+            bad += (indices[i] >= numVerts);
+        invalid += bad;
+    });
+
+    if (invalid > 0)
+    {
+        std::cout << "PLY file references " << invalid << " nonexistent vertices" << std::endl;
+        return false;
+    }
+
+    std::cout << "Parsed " << numVerts << " vertices, " << indices.size() / 3 << " triangles ("
+              << ((format == Format_Ascii) ? "ascii" : "binary") << ")" << std::endl;
+
+    return true;
+}
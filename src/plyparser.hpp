@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class TaskPool;
+
+/*
+    PLY parser for ascii, binary_little_endian and binary_big_endian files.
+    The property layout is mapped once from the header, binary vertex and face
+    blocks are then decoded in parallel straight from the memory-mapped file.
+    Polygons are fan-triangulated.
+*/
+class PlyParser
+{
+public:
+    PlyParser(const std::string filePath);
+
+    bool parse(); // false on malformed or truncated file
+
+    std::vector<float> positions;  // xyz
+    std::vector<float> normals;    // xyz per vertex, empty if not present
+    std::vector<unsigned> indices; // three per triangle
+
+private:
+    enum Format
+    {
+        Format_Ascii,
+        Format_BinaryLE,
+        Format_BinaryBE
+    };
+
+    enum Type
+    {
+        Type_Int8,
+        Type_UInt8,
+        Type_Int16,
+        Type_UInt16,
+        Type_Int32,
+        Type_UInt32,
+        Type_Float32,
+        Type_Float64,
+        Type_Invalid
+    };
+
+    struct Property
+    {
+        std::string name;
+        Type type;       // value type, list elements for lists
+        Type countType;  // lists only
+        bool list;
+        size_t offset;   // in record, fixed size elements only
+    };
+
+    struct Element
+    {
+        std::string name;
+        size_t count;
+        std::vector<Property> props;
+        size_t stride;   // record size, 0 if element contains lists
+    };
+
+    static Type parseType(const std::string &name);
+    bool parseHeader(const char *&p, const char *end);
+
+    bool readAscii(const char *p, const char *end);
+    bool readBinary(TaskPool &pool, const char *p, const char *end);
+    bool readBinaryVertices(TaskPool &pool, const Element &e, const char *&p, const char *end);
+    bool readBinaryFaces(TaskPool &pool, const Element &e, const char *&p, const char *end);
+    const char* skipProperty(const Property &prop, const char *p, const char *end) const;
+    const char* skipBinaryRecord(const Element &e, const char *p, const char *end) const;
+
+    std::string filePath;
+    Format format = Format_Ascii;
+    bool swapBytes = false;
+    std::vector<Element> elements;
+};
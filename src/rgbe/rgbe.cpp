@@ -7,6 +7,10 @@
 #include <cmath>
 #include <cstring>
 #include <cctype>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RGBE_USE_SSE2
+#endif
 #ifdef __APPLE__
 #include <stdlib.h>
 #else
@@ -23,6 +27,8 @@ a status value as defined below.  This code is intended as a skeleton so
 feel free to modify it to suit your needs.
 
 (Place notice here if you modified the code.)
+Modified: added in-memory header parsing and independent per-scanline
+decoding to RGBA floats, see the end of this file.
 posted to http://www.graphics.cornell.edu/~bjw/
 written by Bruce Walter  (bjw@graphics.cornell.edu)  5/26/95
 based on code written by Greg Ward
@@ -46,7 +52,7 @@ enum rgbe_error_codes {
 };
 
 /* default error routine.  change this to change error handling */
-static int rgbe_error(int rgbe_error_code, char *msg)
+static int rgbe_error(int rgbe_error_code, const char *msg)
 {
     switch (rgbe_error_code) {
     case rgbe_read_error:
@@ -109,7 +115,7 @@ rgbe2float(float *red, float *green, float *blue, unsigned char rgbe[4])
 /* default minimal header. modify if you want more information in header */
 int RGBE_WriteHeader(FILE *fp, int width, int height, rgbe_header_info *info)
 {
-    char *programtype = "RGBE";
+    const char *programtype = "RGBE";
 
     if (info && (info->valid & RGBE_VALID_PROGRAMTYPE))
         programtype = info->programtype;
@@ -414,3 +420,203 @@ int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
     free(scanline_buffer);
     return RGBE_RETURN_SUCCESS;
 }
+
+/* The code below decodes from memory, e.g. a memory-mapped file. */
+/* Scanline offsets are found in one cheap serial pass, after which */
+/* the scanlines can be decoded in parallel by the caller. */
+
+/* rgbe2float as a lookup table: scale[e] = 2^(e-136), zero for e = 0 */
+struct rgbe_scale_table {
+    float scale[256];
+    rgbe_scale_table() {
+        scale[0] = 0.0f;
+        for (int e = 1; e < 256; e++)
+            scale[e] = (float)ldexp(1.0, e - (int)(128 + 8));
+    }
+};
+static const rgbe_scale_table rgbe_scales;
+
+/* planar rgbe bytes to interleaved RGBA floats, same results as rgbe2float */
+static void rgbe2rgba(const unsigned char *r, const unsigned char *g,
+    const unsigned char *b, const unsigned char *e, float *data, int numpixels)
+{
+    const float *scale = rgbe_scales.scale;
+    int i = 0;
+#ifdef RGBE_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= numpixels; i += 4) {
+        int rb, gb, bb;
+        memcpy(&rb, r + i, 4);
+        memcpy(&gb, g + i, 4);
+        memcpy(&bb, b + i, 4);
+        __m128 s = _mm_setr_ps(scale[e[i]], scale[e[i + 1]], scale[e[i + 2]], scale[e[i + 3]]);
+        __m128 rv = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(rb), zero), zero)), s);
+        __m128 gv = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(gb), zero), zero)), s);
+        __m128 bv = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bb), zero), zero)), s);
+        __m128 av = _mm_set1_ps(1.0f);
+        _MM_TRANSPOSE4_PS(rv, gv, bv, av); /* four channels -> four pixels */
+        _mm_storeu_ps(data + 4 * i + 0, rv);
+        _mm_storeu_ps(data + 4 * i + 4, gv);
+        _mm_storeu_ps(data + 4 * i + 8, bv);
+        _mm_storeu_ps(data + 4 * i + 12, av);
+    }
+#endif
+    for (; i < numpixels; i++) {
+        float f = scale[e[i]];
+        data[4 * i + 0] = r[i] * f;
+        data[4 * i + 1] = g[i] * f;
+        data[4 * i + 2] = b[i] * f;
+        data[4 * i + 3] = 1.0f;
+    }
+}
+
+/* copies the next line without newline, returns 0 at end of data */
+static int rgbe_getline(const char *buf, size_t size, size_t *pos, char *line, size_t maxlen)
+{
+    const char *nl;
+    size_t start = *pos, len;
+
+    if (start >= size)
+        return 0;
+    nl = (const char *)memchr(buf + start, '\n', size - start);
+    len = ((nl) ? (size_t)(nl - buf) : size) - start;
+    *pos = start + len + ((nl) ? 1 : 0);
+    if (len > maxlen - 1)
+        len = maxlen - 1;
+    memcpy(line, buf + start, len);
+    line[len] = 0;
+    return 1;
+}
+
+int RGBE_ReadHeader_Mem(const char *buf, size_t size, int *width, int *height,
+    size_t *offset)
+{
+    char line[128];
+    size_t pos = 0;
+
+    if (!rgbe_getline(buf, size, &pos, line, sizeof(line)))
+        return rgbe_error(rgbe_read_error, NULL);
+    if ((line[0] == '#') && (line[1] == '?')) {
+        if (!rgbe_getline(buf, size, &pos, line, sizeof(line)))
+            return rgbe_error(rgbe_read_error, NULL);
+    }
+    if (line[0] == 0)
+        return rgbe_error(rgbe_format_error, "no FORMAT specifier found");
+    /* header variables end with a blank line */
+    do {
+        if (!rgbe_getline(buf, size, &pos, line, sizeof(line)))
+            return rgbe_error(rgbe_read_error, NULL);
+    } while (line[0] != 0);
+    if (!rgbe_getline(buf, size, &pos, line, sizeof(line)))
+        return rgbe_error(rgbe_read_error, NULL);
+    if ((sscanf(line, "-Y %d +X %d", height, width) < 2) || (*width <= 0) || (*height <= 0))
+        return rgbe_error(rgbe_format_error, "missing image size specifier");
+    *offset = pos;
+    return RGBE_RETURN_SUCCESS;
+}
+
+int RGBE_ScanlineOffsets(const char *buf, size_t size, size_t offset,
+    int scanline_width, int num_scanlines, size_t *offsets, int *first_flat)
+{
+    const unsigned char *data = (const unsigned char *)buf;
+    int y, i, n, count;
+
+    *first_flat = num_scanlines;
+    for (y = 0; y < num_scanlines; y++) {
+        if (offset + 4 > size)
+            return rgbe_error(rgbe_read_error, NULL);
+        if ((scanline_width < 8) || (scanline_width > 0x7fff) ||
+            (data[offset] != 2) || (data[offset + 1] != 2) || (data[offset + 2] & 0x80)) {
+            /* not run length encoded, the rest of the file is flat */
+            *first_flat = y;
+            for (; y < num_scanlines; y++) {
+                offsets[y] = offset;
+                offset += (size_t)scanline_width * 4;
+            }
+            if (offset > size)
+                return rgbe_error(rgbe_read_error, NULL);
+            return RGBE_RETURN_SUCCESS;
+        }
+        if ((((int)data[offset + 2]) << 8 | data[offset + 3]) != scanline_width)
+            return rgbe_error(rgbe_format_error, "wrong scanline width");
+
+        /* skip over the runs of each channel */
+        offsets[y] = offset;
+        offset += 4;
+        for (i = 0; i < 4; i++) {
+            n = 0;
+            while (n < scanline_width) {
+                if (offset + 2 > size)
+                    return rgbe_error(rgbe_read_error, NULL);
+                count = data[offset];
+                if (count > 128) {
+                    count -= 128;
+                    offset += 2;
+                }
+                else {
+                    offset += 1 + count;
+                }
+                if ((count == 0) || (count > scanline_width - n))
+                    return rgbe_error(rgbe_format_error, "bad scanline data");
+                n += count;
+            }
+        }
+        if (offset > size)
+            return rgbe_error(rgbe_read_error, NULL);
+    }
+    return RGBE_RETURN_SUCCESS;
+}
+
+int RGBE_DecodeScanline_RGBA(const char *src, size_t avail, int rle, float *data,
+    int scanline_width, unsigned char *scratch)
+{
+    const unsigned char *ptr = (const unsigned char *)src;
+    const unsigned char *end = ptr + avail;
+    unsigned char *dst, *dst_end;
+    int i, count;
+
+    if (!rle) {
+        /* deinterleave flat pixels */
+        if (avail < (size_t)scanline_width * 4)
+            return rgbe_error(rgbe_read_error, NULL);
+        for (i = 0; i < scanline_width; i++) {
+            scratch[i] = ptr[4 * i + 0];
+            scratch[i + scanline_width] = ptr[4 * i + 1];
+            scratch[i + 2 * scanline_width] = ptr[4 * i + 2];
+            scratch[i + 3 * scanline_width] = ptr[4 * i + 3];
+        }
+    }
+    else {
+        if (avail < 4)
+            return rgbe_error(rgbe_read_error, NULL);
+        ptr += 4; /* scanline header */
+        dst = scratch;
+        for (i = 0; i < 4; i++) {
+            dst_end = &scratch[(i + 1) * scanline_width];
+            while (dst < dst_end) {
+                if (end - ptr < 2)
+                    return rgbe_error(rgbe_read_error, NULL);
+                count = *ptr++;
+                if (count > 128) {
+                    /* a run of the same value */
+                    count -= 128;
+                    if (count > dst_end - dst)
+                        return rgbe_error(rgbe_format_error, "bad scanline data");
+                    memset(dst, *ptr++, count);
+                }
+                else {
+                    /* a non-run */
+                    if ((count == 0) || (count > dst_end - dst) || (count > end - ptr))
+                        return rgbe_error(rgbe_format_error, "bad scanline data");
+                    memcpy(dst, ptr, count);
+                    ptr += count;
+                }
+                dst += count;
+            }
+        }
+    }
+
+    rgbe2rgba(scratch, scratch + scanline_width, scratch + 2 * scanline_width,
+        scratch + 3 * scanline_width, data, scanline_width);
+    return RGBE_RETURN_SUCCESS;
+}
@@ -11,6 +11,7 @@ See rgbe.txt file for more details.
 */
 
 #include <cstdio>
+#include <cstddef>
 
 typedef struct {
     int valid;            /* indicate which fields are valid */
@@ -49,6 +50,18 @@ int RGBE_WritePixels_RLE(FILE *fp, float *data, int scanline_width,
 int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
     int num_scanlines);
 
+/* read from memory (e.g. a mapped file), scanlines can be decoded independently */
+/* header parsing, *offset receives the start of the pixel data */
+int RGBE_ReadHeader_Mem(const char *buf, size_t size, int *width, int *height,
+    size_t *offset);
+/* locates num_scanlines scanlines starting at offset, fills offsets[num_scanlines] */
+/* *first_flat receives the first scanline that is not run length encoded */
+int RGBE_ScanlineOffsets(const char *buf, size_t size, size_t offset,
+    int scanline_width, int num_scanlines, size_t *offsets, int *first_flat);
+/* decodes one scanline into RGBA floats (alpha 1), scratch holds 4*scanline_width bytes */
+int RGBE_DecodeScanline_RGBA(const char *src, size_t avail, int rle, float *data,
+    int scanline_width, unsigned char *scratch);
+
 #endif /* RGBE_HPP */
 
 
@@ -14,11 +14,19 @@ typedef cl_uint U32;
 typedef cl_int S32;
 typedef cl_float F32;
 typedef cl_uchar U8;
+typedef cl_ulong U64;
 
 enum SplitMode {
 	SplitMode_SpatialMedian,
 	SplitMode_ObjectMedian,
-	SplitMode_Sah
+	SplitMode_Sah,
+	SplitMode_BinnedSah
+};
+
+// Order of nodes in memory, left child always at parent + 1
+enum NodeLayout {
+	NodeLayout_DepthFirst,	// as built
+	NodeLayout_SurfaceArea	// larger child first
 };
 
 struct AABB_t {
@@ -39,10 +47,6 @@ struct AABB_t {
 	inline float3 centroid() {
 		return 0.5f * (min + max);
 	}
-	inline void expand(const RTTriangle &t) {
-		min = vmin(min, t.min());
-		max = vmax(max, t.max());
-	}
 	inline void expand(const AABB_t &box) {
 		min = vmin(min, box.min);
 		max = vmax(max, box.max);
@@ -1,52 +1,158 @@
 #include "sbvh.hpp"
 #include "progressview.hpp"
+#include "taskpool.hpp"
+#include "utils.h"
+#include <chrono>
 
-SBVH::SBVH(std::vector<RTTriangle>* tris, SplitMode mode, ProgressView *progressView)
+static const F32 ProgressScale = 4294967296.0f; // fixed point for atomic progress
+
+SBVH::SBVH(TriangleMesh *mesh, SplitMode mode, ProgressView *progressView, U32 sahBins)
 {
-	m_triangles = tris;
+	m_mesh = mesh;
+	m_mode = mode;
+	m_sahBins = std::max(2u, std::min(sahBins, (U32)MaxSahBins));
 	progress = progressView;
+	progressDone = 0;
 
-	NodeSpec rootSpec;
-	rootSpec.refs = tris->size();
+	BuildTask *rootTask = new BuildTask();
+	rootTask->spec.refs = mesh->size();
+	rootTask->depth = 0;
+	rootTask->progressStart = 0.0f;
+	rootTask->progressEnd = 1.0f;
 
 	// Setup references for building
-	m_refs.resize(rootSpec.refs);
-	for (int i = 0; i < m_triangles->size(); i++)
+	rootTask->refs.resize(rootTask->spec.refs);
+	for (int i = 0; i < m_mesh->size(); i++)
 	{
-		m_refs[i] = TriRef(i, (*m_triangles)[i]);
-		rootSpec.box.expand(m_refs[i].box);
+		rootTask->refs[i] = TriRef(i, *m_mesh);
+		rootTask->spec.box.expand(rootTask->refs[i].box);
 	}
 
-	// Shared vector to avoid reallocations
-	rightBoxes.resize(std::max(m_triangles->size(), (size_t)NumSpatialBins) - 1);
-	minOverlap = rootSpec.box.area() * splitAlpha;
+	minOverlap = rootTask->spec.box.area() * splitAlpha;
+	m_splitAlpha = splitAlpha;
 
 	// Perform building
-	SBVHNode* root = build(rootSpec, 0, 0.0f, 1.0f);
-	printf("\rSBVH builder: progress 100%% (%.2f%% duplicates)\n", metrics.duplicates * 100.0f / m_triangles->size());
+	size_t rssBefore = getPeakRSS();
+	SBVHNode* root = nullptr;
+	rootTask->target = &root;
+	auto t0 = std::chrono::high_resolution_clock::now();
+	U32 numThreads;
+	{
+		TaskPool taskPool;
+		pool = &taskPool;
+		numThreads = taskPool.numThreads();
+		taskPool.submit([this, rootTask]() { runTask(rootTask); });
+
+		// Workers must not touch the UI => report progress from this thread
+		while (!taskPool.waitFor(std::chrono::milliseconds(50)))
+			lazyPrintBuildStatus(progressDone / ProgressScale);
+		pool = nullptr;
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+	printf("\rSBVH builder: progress 100%% (%.2f%% duplicates)\n", metrics.duplicates * 100.0f / m_mesh->size());
+
+	// Concatenate task-local indices in serial build order
+	gatherIndices(rootTask);
+	deleteTasks(rootTask);
 
 	// Indices relative to LAST triangle => reverse
 	std::reverse(m_indices.begin(), m_indices.end());
 
 	// Convert tree structure to small node vector
 	convertTree(root, -1);
-	root->deleteTree();
+	size_t rssPeak = getPeakRSS();
+	nodeArena.clear();
 	assert(metrics.depth <= MaxDepth);
-	assert(m_indices.size() >= m_triangles->size());
+	assert(m_indices.size() >= m_mesh->size());
 
 	if (metrics.depth > MaxDepth)
 		std::cout << "WARN: SBVH might not fit traversal stack! (" << metrics.depth << " > " << MaxDepth << ")" << std::endl;
 	
 	std::cout
 		<< "======================" << std::endl
-		<< "SBVH" << std::endl
+		<< "SBVH (" << splitModeName() << ")" << std::endl
+		<< "Build time: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms (" << numThreads << " threads)" << std::endl
+		<< "Peak RSS: " << rssPeak / (1 << 20) << " MB (" << rssBefore / (1 << 20) << " MB before build)" << std::endl
+		<< "SAH cost: " << treeSahCost() << std::endl
 		<< "Splits: " << metrics.splits << " (" << int(metrics.bad_splits / float(metrics.splits) * 100.0f) << "% bad)" << std::endl
 		<< "Depth: " << metrics.depth << std::endl
 		<< "Leaves: " << metrics.splits + 1 << std::endl
-		<< "Duplicates: " << metrics.duplicates << " (" << int(metrics.duplicates * 100.0f / m_triangles->size()) << "%)" << std::endl
+		<< "Duplicates: " << metrics.duplicates << " (" << int(metrics.duplicates * 100.0f / m_mesh->size()) << "%)" << std::endl
 		<< "======================" << std::endl;
 }
 
+// Build subtree of task with a private ref stack and index list
+void SBVH::runTask(BuildTask *task)
+{
+	std::unique_ptr<BuildContext> ctx(new BuildContext());
+	ctx->task = task;
+	ctx->refs.swap(task->refs);
+	ctx->rightBoxes.resize(std::max(task->spec.refs, (S32)NumSpatialBins) - 1);
+
+	*task->target = build(*ctx, task->spec, task->depth, task->progressStart, task->progressEnd);
+	assert(ctx->refs.empty());
+	assert(ctx->indices.empty() || task->subtasks.empty());
+	task->indices.swap(ctx->indices);
+
+	std::lock_guard<std::mutex> lock(metricsLock);
+	nodeArena.merge(ctx->nodes);
+	metrics.depth = std::max(metrics.depth, ctx->metrics.depth);
+	metrics.bad_splits += ctx->metrics.bad_splits;
+	metrics.splits += ctx->metrics.splits;
+	metrics.duplicates += ctx->metrics.duplicates;
+}
+
+// Move rightmost refs of node into new task, consumes them from stack like a serial build would
+void SBVH::spawnTask(BuildContext &ctx, const NodeSpec &spec, int depth, F32 progressStart, F32 progressEnd, SBVHNode **target)
+{
+	BuildTask *task = new BuildTask();
+	task->spec = spec;
+	task->depth = depth;
+	task->progressStart = progressStart;
+	task->progressEnd = progressEnd;
+	task->target = target;
+	task->refs.assign(ctx.refs.end() - spec.refs, ctx.refs.end());
+	ctx.refs.resize(ctx.refs.size() - spec.refs);
+	ctx.task->subtasks.push_back(task);
+	pool->submit([this, task]() { runTask(task); });
+}
+
+// Subtasks were spawned in build order => concatenation matches serial index list
+void SBVH::gatherIndices(BuildTask *task)
+{
+	if (!task->indices.empty())
+	{
+		U32 offset = m_indices.size();
+		m_indices.insert(m_indices.end(), task->indices.begin(), task->indices.end());
+		offsetLeaves(*task->target, offset);
+	}
+
+	for (BuildTask *sub : task->subtasks)
+		gatherIndices(sub);
+}
+
+// Make leaf ranges of task subtree global, stops at subtasks (they own no leaves of this task)
+void SBVH::offsetLeaves(SBVHNode *node, U32 offset)
+{
+	if (node->isLeaf())
+	{
+		node->lo += offset;
+		node->hi += offset;
+	}
+	else
+	{
+		offsetLeaves(node->leftChild, offset);
+		offsetLeaves(node->rightChild, offset);
+	}
+}
+
+void SBVH::deleteTasks(BuildTask *task)
+{
+	for (BuildTask *sub : task->subtasks)
+		deleteTasks(sub);
+	delete task;
+}
+
 // Convert pointer tree to linear node vector
 void SBVH::convertTree(SBVHNode *node, S32 parentId)
 {
@@ -78,41 +184,44 @@ void SBVH::lazyPrintBuildStatus(F32 progress)
 	if (percentage > buildPercentage)
 	{
 		buildPercentage = percentage;
-		F32 duplicates = metrics.duplicates * 100.0f / m_triangles->size();
+		std::lock_guard<std::mutex> lock(metricsLock);
+		F32 duplicates = metrics.duplicates * 100.0f / m_mesh->size();
 		printf("\rSBVH builder: progress %d%% (%.2f%% duplicates)", percentage, duplicates);
-		this->progress->showMessage("Building SBVH", percentage / 100.0f);
+		if (this->progress)
+			this->progress->showMessage("Building SBVH", percentage / 100.0f);
 	}
 }
 
 // Create leaf node. References are removed from stack.
 // Index list will be reversed after building to fix indexing.
-SBVHNode* SBVH::createLeaf(const NodeSpec& spec)
+SBVHNode* SBVH::createLeaf(BuildContext &ctx, const NodeSpec& spec, F32 progressSpan)
 {
 	for (int i = 0; i < spec.refs; i++)
 	{
-		TriRef last = m_refs.back();
-		m_refs.pop_back();
-		m_indices.push_back(last.ind);
+		TriRef last = ctx.refs.back();
+		ctx.refs.pop_back();
+		ctx.indices.push_back(last.ind);
 	}
 
-	int start = m_indices.size() - spec.refs;
-	int end = m_indices.size();
-	return new SBVHNode(spec.box, start, end);
+	progressDone += (U64)(progressSpan * ProgressScale);
+
+	int start = ctx.indices.size() - spec.refs;
+	int end = ctx.indices.size();
+	return ctx.nodes.alloc(spec.box, start, end);
 }
 
 // SBVH construction algorithm, in line with Stich et al. chapter 4.1
-SBVHNode* SBVH::build(NodeSpec &spec, int depth, F32 progressStart, F32 progressEnd)
+SBVHNode* SBVH::build(BuildContext &ctx, NodeSpec &spec, int depth, F32 progressStart, F32 progressEnd)
 {
-	lazyPrintBuildStatus(progressStart);
-	metrics.depth = std::max(metrics.depth, (U32)depth);
+	ctx.metrics.depth = std::max(ctx.metrics.depth, (U32)depth);
 
 	if (spec.refs <= MinLeafElems || depth >= MaxDepth)
-		return createLeaf(spec);
+		return createLeaf(ctx, spec, progressEnd - progressStart);
 
 	// 1. Find object split candidate using full SAH search
 	F32 parentArea = spec.box.area();
 	F32 nodeSAH = parentArea * 2 * 1;
-	SplitInfo objectSplit = sahSplit(spec, nodeSAH);
+	SplitInfo objectSplit = (m_mode == SplitMode_BinnedSah) ? binnedSahSplit(ctx, spec, nodeSAH) : sahSplit(ctx, spec, nodeSAH);
 
 	// 2. Find spatial split candidate using chopped binning
 	SplitInfo spatialSplit;
@@ -121,7 +230,7 @@ SBVHNode* SBVH::build(NodeSpec &spec, int depth, F32 progressStart, F32 progress
 		AABB_t overlap = objectSplit.leftBounds;
 		overlap.intersect(objectSplit.rightBounds);
 		if (overlap.area() >= minOverlap)
-			spatialSplit = binSplit(spec, nodeSAH);
+			spatialSplit = binSplit(ctx, spec, nodeSAH);
 	}
 
 	// 3. Select the winner candidate
@@ -132,43 +241,54 @@ SBVHNode* SBVH::build(NodeSpec &spec, int depth, F32 progressStart, F32 progress
 	if (minCost == parentCost && spec.refs <= MaxLeafElems)
 	{
 		assert(spec.refs <= std::numeric_limits<U8>::max());
-		return createLeaf(spec);
+		return createLeaf(ctx, spec, progressEnd - progressStart);
 	}
 
 	// Perform partitioning
 	NodeSpec left, right;
 	if (minCost == spatialSplit.cost)
-		partitionSpatial(left, right, spec, spatialSplit);
+		partitionSpatial(ctx, left, right, spec, spatialSplit);
 	if (!left.refs || !right.refs)
-		partitionObject(left, right, spec, objectSplit);
+		partitionObject(ctx, left, right, spec, objectSplit);
 
-	metrics.splits++;
+	ctx.metrics.splits++;
 
 	// Create inner node.
-	metrics.duplicates += left.refs + right.refs - spec.refs;
+	ctx.metrics.duplicates += left.refs + right.refs - spec.refs;
 	F32 progressMid = lerp(progressStart, progressEnd, (F32)right.refs / (F32)(left.refs + right.refs));
 
+	// Large node => children built concurrently, still consumed from right to left
+	if (spec.refs >= ParallelThreshold)
+	{
+		SBVHNode *node = ctx.nodes.alloc(spec.box, nullptr, nullptr);
+		spawnTask(ctx, right, depth + 1, progressStart, progressMid, &node->rightChild);
+		spawnTask(ctx, left, depth + 1, progressMid, progressEnd, &node->leftChild);
+		return node;
+	}
+
 	// Built from right to left (so that duplicates can be added to end of ref list)
-	SBVHNode* rightNode = build(right, depth + 1, progressStart, progressMid);
-	SBVHNode* leftNode = build(left, depth + 1, progressMid, progressEnd);
+	SBVHNode* rightNode = build(ctx, right, depth + 1, progressStart, progressMid);
+	SBVHNode* leftNode = build(ctx, left, depth + 1, progressMid, progressEnd);
 
-	return new SBVHNode(spec.box, leftNode, rightNode);
+	return ctx.nodes.alloc(spec.box, leftNode, rightNode);
 }
 
-BVH::SplitInfo SBVH::sahSplit(const NodeSpec& spec, F32 nodeSAH)
+BVH::SplitInfo SBVH::sahSplit(BuildContext &ctx, const NodeSpec& spec, F32 nodeSAH)
 {
 	F32 bestTieBreak = FLT_MAX;
 	SplitInfo info;
+	std::vector<TriRef> &refs = ctx.refs;
+	std::vector<AABB_t> &rightBoxes = ctx.rightBoxes;
 
 	// Rightmost N references
-	int start = m_refs.size() - spec.refs;
-	int end = m_refs.size() - 1;
+	int start = refs.size() - spec.refs;
+	int end = refs.size() - 1;
 
 	// Loop over all three axes to find best split
 	for (U32 dim = 0; dim < 3; dim++)
 	{
 		// Sort along axis
-		sortReferences(start, end, dim);
+		sortReferences(refs, start, end, dim);
 
 		// Create AABB lookup
 		//buildBoxLookup(n);
@@ -176,7 +296,7 @@ BVH::SplitInfo SBVH::sahSplit(const NodeSpec& spec, F32 nodeSAH)
 		AABB_t rightBounds;
 		for (int i = spec.refs - 1; i > 0; i--)
 		{
-			rightBounds.expand(m_refs[start + i].box);
+			rightBounds.expand(refs[start + i].box);
 			rightBoxes[i - 1] = rightBounds; // use relative indexing (doesn't grow too large)
 		}
 
@@ -186,7 +306,7 @@ BVH::SplitInfo SBVH::sahSplit(const NodeSpec& spec, F32 nodeSAH)
 		// Try different split points along axis
 		for (int i = 1; i < spec.refs; i++) // exclude first and last
 		{
-			leftBox.expand(m_refs[start + i - 1].box);
+			leftBox.expand(refs[start + i - 1].box);
 			leftCount++;
 
 			AABB_t &rightBox = rightBoxes[i - 1];
@@ -221,14 +341,51 @@ BVH::SplitInfo SBVH::sahSplit(const NodeSpec& spec, F32 nodeSAH)
 	return info;
 }
 
+// Binned object split candidate: one pass over refs instead of three sorts
+BVH::SplitInfo SBVH::binnedSahSplit(BuildContext &ctx, const NodeSpec& spec, F32 nodeSAH)
+{
+	int start = ctx.refs.size() - spec.refs;
+	int end = ctx.refs.size() - 1;
+
+	SplitInfo info = binnedSah(ctx.refs, start, end);
+
+	// All centroids in same spot => sorting splits by index
+	if (info.dim == -1)
+		return sahSplit(ctx, spec, nodeSAH);
+
+	info.cost += nodeSAH;
+	return info;
+}
+
 // Object split cheapest => just sort triangles, update reference ranges
-void SBVH::partitionObject(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& info)
+void SBVH::partitionObject(BuildContext &ctx, NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& info)
 {
 	assert(info.dim > -1);
 	
-	int start = m_refs.size() - spec.refs;
-	int end = m_refs.size() - 1;
-	sortReferences(start, end, info.dim);
+	int start = ctx.refs.size() - spec.refs;
+	int end = ctx.refs.size() - 1;
+
+	if (info.binned)
+	{
+		// Split plane might fall on the other side of some centroids than their bin
+		// => bounds recomputed, median split as last resort
+		S32 leftCount = partitionCentroids(ctx.refs, start, end, info);
+		if (leftCount == 0 || leftCount == spec.refs)
+		{
+			sortReferences(ctx.refs, start, end, info.dim);
+			leftCount = spec.refs / 2;
+			ctx.metrics.bad_splits++;
+		}
+
+		left.refs = leftCount;
+		right.refs = spec.refs - leftCount;
+		left.box = right.box = AABB_t();
+		for (int i = start; i <= end; i++)
+			(i < start + leftCount ? left.box : right.box).expand(ctx.refs[i].box);
+		return;
+	}
+
+	sortReferences(ctx.refs, start, end, info.dim);
 
 	left.refs = info.i;
 	left.box = info.leftBounds;
@@ -239,8 +396,12 @@ void SBVH::partitionObject(NodeSpec& left, NodeSpec& right, const NodeSpec& spec
 // Find cheapest spatial split using binned SAH
 // 1. Chop triangles into bins, update bin bounds + triangle counts
 // 2. Build area lookup (per bin boundary), calculate SAH, keep cheapest
-SBVH::SplitInfo SBVH::binSplit(const NodeSpec& spec, F32 nodeSAH)
+SBVH::SplitInfo SBVH::binSplit(BuildContext &ctx, const NodeSpec& spec, F32 nodeSAH)
 {
+	std::vector<TriRef> &refs = ctx.refs;
+	std::vector<AABB_t> &rightBoxes = ctx.rightBoxes;
+	auto &bins = ctx.bins;
+
 	float3 origin = spec.box.min;
 	float3 binSize = (spec.box.max - origin) * (1.0f / (F32)NumSpatialBins);
 	float3 invBinSize = 1.0f / binSize;
@@ -258,9 +419,9 @@ SBVH::SplitInfo SBVH::binSplit(const NodeSpec& spec, F32 nodeSAH)
 	}
 
 	// Perform chopped binning on spanned triangles
-	for (int refIdx = m_refs.size() - spec.refs; refIdx < m_refs.size(); refIdx++)
+	for (int refIdx = refs.size() - spec.refs; refIdx < refs.size(); refIdx++)
 	{
-		const TriRef& ref = m_refs[refIdx];
+		const TriRef& ref = refs[refIdx];
 
 		// Find bins that AABB overlaps
 		int3 firstBin = vclamp(int3((ref.box.min - origin) * invBinSize), 0, NumSpatialBins - 1);
@@ -324,15 +485,17 @@ SBVH::SplitInfo SBVH::binSplit(const NodeSpec& spec, F32 nodeSAH)
 
 // Spatial split was cheapest => distribute references (while potentially splitting)
 // Only chosen cheapest split dimension is considered
-void SBVH::partitionSpatial(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& split)
+void SBVH::partitionSpatial(BuildContext &ctx, NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& split)
 {
+	std::vector<TriRef> &refs = ctx.refs;
+
 	// Left-hand side:      [leftStart, leftEnd[
 	// Uncategorized/split: [leftEnd, rightStart[
-	// Right-hand side:     [rightStart, m_refs.size()[
+	// Right-hand side:     [rightStart, refs.size()[
 
-	int leftStart = m_refs.size() - spec.refs;
+	int leftStart = refs.size() - spec.refs;
 	int leftEnd = leftStart;
-	int rightStart = m_refs.size();
+	int rightStart = refs.size();
 	left.box = right.box = AABB_t();
 
 	// Scan refs, swap non-intersecting tris to their corresponding sides
@@ -340,16 +503,16 @@ void SBVH::partitionSpatial(NodeSpec& left, NodeSpec& right, const NodeSpec& spe
 	for (int i = leftEnd; i < rightStart; i++)
 	{
 		// Entirely on the left-hand side?
-		if (m_refs[i].box.max[split.dim] <= split.pos)
+		if (refs[i].box.max[split.dim] <= split.pos)
 		{
-			left.box.expand(m_refs[i].box);
-			std::swap(m_refs[i], m_refs[leftEnd++]);
+			left.box.expand(refs[i].box);
+			std::swap(refs[i], refs[leftEnd++]);
 		}
 		// Entirely on the right-hand side?
-		else if (m_refs[i].box.min[split.dim] >= split.pos)
+		else if (refs[i].box.min[split.dim] >= split.pos)
 		{
-			right.box.expand(m_refs[i].box);
-			std::swap(m_refs[i--], m_refs[--rightStart]);
+			right.box.expand(refs[i].box);
+			std::swap(refs[i--], refs[--rightStart]);
 		}
 	}
 
@@ -357,22 +520,22 @@ void SBVH::partitionSpatial(NodeSpec& left, NodeSpec& right, const NodeSpec& spe
 	while (leftEnd < rightStart)
 	{
 		TriRef lref, rref;
-		splitReference(lref, rref, m_refs[leftEnd], split.dim, split.pos);
+		splitReference(lref, rref, refs[leftEnd], split.dim, split.pos);
 
 		// Check how unsplitting / duplicating affects existing AABBs
 		AABB_t lub = left.box;  // left unsplit
 		AABB_t rub = right.box; // right unsplit
 		AABB_t ldb = left.box;  // left duplicate
 		AABB_t rdb = right.box; // right duplicate
-		lub.expand(m_refs[leftEnd].box);
-		rub.expand(m_refs[leftEnd].box);
+		lub.expand(refs[leftEnd].box);
+		rub.expand(refs[leftEnd].box);
 		ldb.expand(lref.box);
 		rdb.expand(rref.box);
 
 		F32 lac = sahParams.costTri * (leftEnd - leftStart);
-		F32 rac = sahParams.costTri * (m_refs.size() - rightStart);
+		F32 rac = sahParams.costTri * (refs.size() - rightStart);
 		F32 lbc = sahParams.costTri * (leftEnd - leftStart + 1);
-		F32 rbc = sahParams.costTri * (m_refs.size() - rightStart + 1);
+		F32 rbc = sahParams.costTri * (refs.size() - rightStart + 1);
 
 		F32 unsplitLeftSAH = lub.area() * lbc + right.box.area() * rac;
 		F32 unsplitRightSAH = left.box.area() * lac + rub.area() * rbc;
@@ -387,38 +550,35 @@ void SBVH::partitionSpatial(NodeSpec& left, NodeSpec& right, const NodeSpec& spe
 		else if (minSAH == unsplitRightSAH)
 		{
 			right.box = rub;
-			std::swap(m_refs[leftEnd], m_refs[--rightStart]);
+			std::swap(refs[leftEnd], refs[--rightStart]);
 		}
 		else
 		{
 			left.box = ldb;
 			right.box = rdb;
-			m_refs[leftEnd++] = lref;
-			m_refs.push_back(rref);
+			refs[leftEnd++] = lref;
+			refs.push_back(rref);
 		}
 	}
 
 	left.refs = leftEnd - leftStart;
-	right.refs = m_refs.size() - rightStart;
+	right.refs = refs.size() - rightStart;
 }
 
 // Split triangle (reference) into two references based on bin boundary coord
-void SBVH::splitReference(TriRef& left, TriRef& right, const TriRef& ref, int dim, F32 coord)
+void SBVH::splitReference(TriRef& left, TriRef& right, const TriRef& ref, int dim, F32 coord) const
 {
 	left.ind = right.ind = ref.ind;
 	left.box = right.box = AABB_t();
 
 	const U32 offsets[] = { 2, 0, 1 };
-	const RTTriangle &tri = (*m_triangles)[ref.ind];
-	const VertexPNT verts[3] = { tri.v0, tri.v1, tri.v2 };
+	const float3 verts[3] = { m_mesh->pos(ref.ind, 0), m_mesh->pos(ref.ind, 1), m_mesh->pos(ref.ind, 2) };
 
 	// Compare each vertex against plane that splits left and right bins
 	for (int i = 0; i < 3; i++)
 	{
-		const VertexPNT *v1v = verts + i;
-		const VertexPNT *v2v = verts + offsets[i];
-		float3 p1 = v2v->p;
-		float3 p2 = v1v->p;
+		float3 p1 = verts[offsets[i]];
+		float3 p2 = verts[i];
 		F32 v0p = p1[dim];
 		F32 v1p = p2[dim];
 
@@ -2,35 +2,49 @@
 
 #include <vector>
 #include <fstream>
+#include <atomic>
+#include <mutex>
 #include "bvh.hpp"
+#include "bvhnode.hpp"
 #include "math/int3.hpp"
 
 using FireRays::int3;
 class ProgressView;
-class SBVHNode;
+class TaskPool;
 
 /*
 	Split BVH (SBVH), based on "Spatial Splits in Bounding Volume Hierarchies" by Stich et al.
 	Tree built from right to left, so that duplicated refs can be pushed to end of ref stack.
 	Based on implementation by Aila & Laine 09.
+	Large subtrees are built in parallel as independent tasks, each with its own ref stack.
+	Leaf indices are gathered in serial build order => output identical to a serial build.
 */
 class SBVH : public BVH
 {
 public:
-	SBVH(std::vector<RTTriangle>* tris, SplitMode mode, ProgressView *progress);
-	SBVH(std::vector<RTTriangle>* tris, const std::string filename) : BVH(tris, filename) {}
+	SBVH(TriangleMesh *mesh, SplitMode mode, ProgressView *progress, U32 sahBins = 32);
+	SBVH(TriangleMesh *mesh, const std::string filename) : BVH(mesh, filename) {}
 	~SBVH() {}
 
 private:
 	struct NodeSpec;
+	struct BuildTask;
+	struct BuildContext;
 
-	SBVHNode* build(NodeSpec &spec, int depth, F32 progressStart, F32 progressEnd);
-	SBVHNode* createLeaf(const NodeSpec& spec);
-	SplitInfo binSplit(const NodeSpec& spec, F32 nodeSAH);
-	SplitInfo sahSplit(const NodeSpec& spec, F32 nodeSAH);
-	void partitionObject(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& split);
-	void partitionSpatial(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& split);
-	void splitReference(TriRef& left, TriRef& right, const TriRef& ref, int dim, F32 coord);
+	void runTask(BuildTask *task);
+	void spawnTask(BuildContext &ctx, const NodeSpec &spec, int depth, F32 progressStart, F32 progressEnd, SBVHNode **target);
+	void gatherIndices(BuildTask *task);
+	void offsetLeaves(SBVHNode *node, U32 offset);
+	void deleteTasks(BuildTask *task);
+
+	SBVHNode* build(BuildContext &ctx, NodeSpec &spec, int depth, F32 progressStart, F32 progressEnd);
+	SBVHNode* createLeaf(BuildContext &ctx, const NodeSpec& spec, F32 progressSpan);
+	SplitInfo binSplit(BuildContext &ctx, const NodeSpec& spec, F32 nodeSAH);
+	SplitInfo sahSplit(BuildContext &ctx, const NodeSpec& spec, F32 nodeSAH);
+	SplitInfo binnedSahSplit(BuildContext &ctx, const NodeSpec& spec, F32 nodeSAH);
+	void partitionObject(BuildContext &ctx, NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& split);
+	void partitionSpatial(BuildContext &ctx, NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SplitInfo& split);
+	void splitReference(TriRef& left, TriRef& right, const TriRef& ref, int dim, F32 coord) const;
 	void lazyPrintBuildStatus(F32 progress);
 	void convertTree(SBVHNode *node, S32 parentId);
 
@@ -38,12 +52,13 @@ private:
 	{
 		MaxLeafElems = 8,
 		MinLeafElems = 1,
-		MaxDepth = 64,
+		MaxDepth = MaxTraversalDepth,
 		MaxSpatialDepth = 48,
-		NumSpatialBins = 128
+		NumSpatialBins = 128,
+		ParallelThreshold = 4096 // nodes with more refs hand their children to the task pool
 	};
 
-	struct
+	struct Metrics
 	{
 		U32 depth = 0;
 		U32 bad_splits = 0;
@@ -65,9 +80,36 @@ private:
 		S32 exiting;
 	};
 
+	// Per-task state, only touched by the worker running the task
+	struct BuildContext
+	{
+		BuildTask *task;
+		std::vector<TriRef> refs;       // ref stack, rightmost refs belong to current node
+		std::vector<U32> indices;       // leaf indices in build order
+		std::vector<AABB_t> rightBoxes; // SAH sweep lookup
+		Bin bins[3][NumSpatialBins];
+		Metrics metrics;
+		SBVHNodeArena nodes;
+	};
+
+	// Independent subtree, indices are gathered after all tasks have finished
+	struct BuildTask
+	{
+		NodeSpec spec;
+		int depth;
+		F32 progressStart, progressEnd;
+		SBVHNode **target;                // receives subtree root
+		std::vector<TriRef> refs;         // initial refs of subtree
+		std::vector<U32> indices;         // leaf indices, relative to this task
+		std::vector<BuildTask*> subtasks; // in build order (right to left)
+	};
+
 	ProgressView *progress;
-	
-	Bin bins[3][NumSpatialBins];
+	TaskPool *pool = nullptr;
+	std::mutex metricsLock;
+	SBVHNodeArena nodeArena; // owns all build nodes
+	std::atomic<U64> progressDone; // fixed point, sum of finished leaf progress spans
+
 	F32 splitAlpha = 1e-5f; // ~35% duplication rate
 	F32 minOverlap;         // min area that triggers spatial split search
 };
\ No newline at end of file
@@ -2,10 +2,16 @@
 #include "tiny_obj_loader.h"
 
 #include "scene.hpp"
+#include "objparser.hpp"
+#include "plyparser.hpp"
+#include "taskpool.hpp"
 #include "progressview.hpp"
 #include "utils.h"
+#include "settings.hpp"
 #include "bxdf_types.h"
 
+static const size_t MeshBlockSize = 1 << 16; // faces per vertex deduplication block
+
 Scene::Scene()
 {
     // Init default material
@@ -23,6 +29,7 @@ Scene::Scene()
 
 Scene::~Scene()
 {
+    waitTextures();
     for (Texture *t : textures)
     {
         delete t;
@@ -50,6 +57,7 @@ void Scene::loadModel(const std::string filename, ProgressView *progress)
 {
     // Starting time for model loading
     auto time1 = std::chrono::high_resolution_clock::now();
+    compressTextures = Settings::getInstance().getTextureCompression(filename);
 
     if (endsWith(filename, "obj"))
     {
@@ -59,7 +67,7 @@ void Scene::loadModel(const std::string filename, ProgressView *progress)
     else if (endsWith(filename, "ply"))
     {
         std::cout << "Loading PLY file: " << filename << std::endl;
-        loadPlyModel(filename);
+        loadPlyModel(filename, progress);
     }
     else
     {
@@ -69,77 +77,39 @@ void Scene::loadModel(const std::string filename, ProgressView *progress)
 
     this->hash = fileHash(filename);
 
-    // Print elapsed time
+    // Print elapsed time and throughput
     auto time2 = std::chrono::high_resolution_clock::now();
-    std::cout << "Mesh loaded in: "
-        << std::chrono::duration<double, std::milli>(time2 - time1).count()
-        << " ms" << std::endl;
+    double seconds = std::chrono::duration<double>(time2 - time1).count();
+    uint64_t fileSize = 0, mtime = 0;
+    getFileStats(filename, fileSize, mtime);
+    std::cout << "Mesh loaded in: " << seconds * 1000.0 << " ms ("
+        << fileSize / (1024.0 * 1024.0) / seconds << " MB/s, "
+        << mesh.size() / 1e6 / seconds << "M tris/s)" << std::endl;
+    std::cout << "Mesh: " << mesh.vertices.size() << " vertices, " << mesh.size() << " triangles ("
+        << (mesh.vertices.size() * sizeof(VertexPNT) + mesh.size() * sizeof(RTTriangle)) / (1024.0 * 1024.0) << " MB)" << std::endl;
 }
 
 
-// Possible face data formats include:
-//  `f v1/vt1/vn1 v2/vt2/vn2 ...`
-//  `f v1//vn1 v2//vn2 ...`
-//  `f v1 v2 ...`
-//  `f -v1 -v2 ...`
-inline void setFaceFormat(int &format, std::string &format_string, bool &negatives, std::istringstream &line)
+// Normal maps stay uncompressed, BC1 endpoint quantization shows up as shading artifacts
+TexturePack &Scene::getTexturePack()
 {
-    if (format > -1) return; // Only set once
-    
-    std::string block1;
-    line >> block1;
+    waitTextures();
+    if (!texturePack.empty() || textures.empty())
+        return texturePack;
 
-    bool textures = false;
-    bool normals = false;
-    int ind = 0;
-    for (char c : block1)
-    {
-        if (c == '-')
-            negatives = true;
-        if (c == '/')
-            ind++;
-        else if (ind == 0)
-            continue;
-        else if (ind == 1)
-            textures = true;
-        else if (ind == 2)
-            normals = true;
-        else
-            std::cout << "Unknown OBJ face format, too many indices!" << std::endl;
-    }
+    auto startTime = std::chrono::high_resolution_clock::now();
 
-    if (textures && normals)
-    {
-        format = 0;
-        format_string = "f %u/%u/%u %u/%u/%u %u/%u/%u";
-    }
-    else if (!textures && normals)
-    {
-        format = 1;
-        format_string = "f %u//%u %u//%u %u//%u";
-    }
-    else if (textures && !normals)
-    {
-        format = 2;
-        format_string = "f %u/%u %u/%u %u/%u";
-    }
-    else
-    {
-        format = 3;
-        format_string = "f %u %u %u";
-    }
+    std::vector<bool> compress(textures.size(), compressTextures);
+    for (const Material &m : materials)
+        if (m.map_N >= 0) compress[m.map_N] = false;
 
-    // Replace "%u" with "-%u"
-    if (negatives)
-    {
-        std::stringstream res;
-        for (char c : format_string)
-        {
-            if (c == '%') res << '-';
-            res << c;
-        }
-        format_string = res.str();
-    }
+    texturePack.build(textures, compress);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::cout << "Texture mips" << (compressTextures ? " and BC1 blocks" : "") << " built in "
+              << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+
+    return texturePack;
 }
 
 cl_int Scene::parseShaderType(std::string &type)
@@ -164,408 +134,302 @@ cl_int Scene::parseShaderType(std::string &type)
 
 void Scene::loadObjWithMaterials(const std::string filePath, ProgressView *progress)
 {
-    std::vector<tinyobj::shape_t> shapesVec;
-    std::vector<tinyobj::material_t> materialsVec;
-    tinyobj::attrib_t attrib;
-    std::string err;
-    
     size_t fileNameStart = filePath.find_last_of("\\"); // assume Windows
     if (fileNameStart == std::string::npos) fileNameStart = filePath.find_last_of("/"); // Linux/MacOS
     std::string folderPath = filePath.substr(0, fileNameStart + 1);
     std::string meshName = filePath.substr(fileNameStart + 1);
 
-    progress->showMessage("Loading mesh", meshName);
-    bool ret = tinyobj::LoadObj(&attrib, &shapesVec, &materialsVec, &err, filePath.c_str(), folderPath.c_str());
-
-    if (!err.empty()) // `err` may contain warning message.
+    if (progress) progress->showMessage("Loading mesh", meshName);
+    ObjParser parser(filePath, folderPath);
+    if (!parser.parse())
     {
-        std::cerr << err << std::endl;
-    }
-
-    if (!ret)
-    {
-        std::cout << "OBJ loading failed (tinyobjloader)" << std::endl;
+        std::cout << "OBJ loading failed" << std::endl;
         waitExit();
     }
 
-    const bool hasNormals = attrib.normals.size() > 0;
-    const bool hasTexCoords = attrib.texcoords.size() > 0;
-
+    dependencies.insert(dependencies.end(), parser.materialLibs.begin(), parser.materialLibs.end());
 
-    size_t numTris = 0;
-    for (tinyobj::shape_t &s : shapesVec)
+    // Materials first, textures decode in the background during mesh conversion
+    for (tinyobj::material_t &t_mat : parser.materials)
     {
-        numTris += s.mesh.indices.size() / 3;
+        Material m;
+        m.Kd = float3(t_mat.diffuse[0], t_mat.diffuse[1], t_mat.diffuse[2]);
+        m.Ks = float3(t_mat.specular[0], t_mat.specular[1], t_mat.specular[2]);
+        m.Ke = float3(t_mat.emission[0], t_mat.emission[1], t_mat.emission[2]);
+        m.Ns = t_mat.shininess;
+        m.Ni = t_mat.ior;
+        m.map_Kd = requestTexture(unixifyPath(folderPath + t_mat.diffuse_texname), unixifyPath(t_mat.diffuse_texname));
+        m.map_Ks = requestTexture(unixifyPath(folderPath + t_mat.specular_texname), unixifyPath(t_mat.specular_texname));
+        m.map_N = requestTexture(unixifyPath(folderPath + t_mat.bump_texname), unixifyPath(t_mat.bump_texname)); // map_bump in mtl treated as normal map
+        m.type = parseShaderType(t_mat.unknown_parameter["shader"]);
+
+        materials.push_back(m);
+        materialTypes |= m.type;
     }
 
-    // Loop over shapesVec in file
-    for (size_t i = 0; i < shapesVec.size(); i++)
+    startTextureImport();
+
+    const std::vector<float> &positions = parser.positions;
+    const std::vector<float> &normals = parser.normals;
+    const std::vector<float> &texcoords = parser.texcoords;
+    const bool hasNormals = normals.size() > 0;
+    const bool hasTexCoords = texcoords.size() > 0;
+
+    // Convert faces in parallel, file order preserved.
+    // Vertices are deduplicated within fixed size blocks of faces, only vertices
+    // on block borders get duplicated. Faces without normals on all corners are
+    // flat shaded: their corners get zero normals and don't share normal indices.
+    if (progress) progress->showMessage("Converting mesh", meshName);
+    typedef ObjParser::Index Key;
+    const size_t numTris = parser.materialIds.size();
+    const size_t numBlocks = (numTris + MeshBlockSize - 1) / MeshBlockSize;
+    const size_t vertBase = mesh.vertices.size();
+    const size_t triBase = mesh.triangles.size();
+    mesh.triangles.resize(triBase + numTris);
+
+    std::vector<std::vector<Key>> blockVerts(numBlocks);
+    std::vector<size_t> blockOffsets(numBlocks + 1, vertBase);
+
+    TaskPool pool;
+    pool.parallelFor(numBlocks, [&](size_t b)
     {
-        tinyobj::shape_t &shape = shapesVec[i];
-        assert((shapesVec[i].mesh.indices.size() % 3) == 0); // properly triangulated
+        const size_t s = b * MeshBlockSize;
+        const size_t e = std::min(numTris, s + MeshBlockSize);
+        std::vector<Key> &keys = blockVerts[b];
+
+        // Open addressing, stores local vertex index + 1
+        size_t tableSize = 1;
+        while (tableSize < 6 * (e - s)) tableSize <<= 1;
+        std::vector<unsigned int> table(tableSize, 0);
 
-        // Loop over faces in the shape's mesh
-        for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++)
+        for (size_t f = s; f < e; f++)
         {
-            // Progress bar
-            size_t N = triangles.size();
-            float done = (float)N / numTris;
-            if (N % 5000 == 0)
-                progress->showMessage("Converting mesh", meshName, done);
-            
-            VertexPNT V[3];
-            
-            // Vertices
-            bool allNormals = true;
+            Key corners[3];
+            bool allNormals = hasNormals;
             for (size_t v = 0; v < 3; v++)
             {
-                auto ind = shape.mesh.indices[3 * f + v];
-                
-                // Position
-                V[v].p = float3(attrib.vertices[3 * ind.vertex_index + 0], attrib.vertices[3 * ind.vertex_index + 1], attrib.vertices[3 * ind.vertex_index + 2]);
+                corners[v] = parser.indices[3 * f + v];
+                allNormals &= (corners[v].vn >= 0);
+                if (!hasTexCoords) corners[v].vt = -1;
+            }
 
-                // Normal
-                if (ind.normal_index < 0 || !hasNormals)
+            RTTriangle &tri = mesh.triangles[triBase + f];
+            tri.matId = parser.materialIds[f] + 1; // -1 becomes 0 (default material)
+            for (size_t v = 0; v < 3; v++)
+            {
+                Key k = corners[v];
+                if (!allNormals) k.vn = -1;
+
+                size_t h = ((size_t)k.v * 73856093u ^ (size_t)k.vt * 19349663u ^ (size_t)k.vn * 83492791u) & (tableSize - 1);
+                while (table[h] != 0)
                 {
-                    allNormals = false;
-                    V[v].n = float3(0.0f);
+                    const Key &o = keys[table[h] - 1];
+                    if (o.v == k.v && o.vt == k.vt && o.vn == k.vn) break;
+                    h = (h + 1) & (tableSize - 1);
                 }
-                else
+
+                if (table[h] == 0)
                 {
-                    V[v].n = float3(attrib.normals[3 * ind.normal_index + 0], attrib.normals[3 * ind.normal_index + 1], attrib.normals[3 * ind.normal_index + 2]);
+                    keys.push_back(k);
+                    table[h] = (unsigned int)keys.size();
                 }
-
-                // Tex coord
-                if (ind.texcoord_index > -1 && hasTexCoords)
-                    V[v].t = float3(attrib.texcoords[2 * ind.texcoord_index + 0], attrib.texcoords[2 * ind.texcoord_index + 1], 0.0f);
-                else
-                    V[v].t = float3(0.0f);
+                tri.v[v] = table[h] - 1; // local, offset later
             }
-
-            if(!allNormals)
-                V[0].n = V[1].n = V[2].n = normalize(cross(V[1].p - V[0].p, V[2].p - V[0].p));
-
-            RTTriangle tri(V[0], V[1], V[2]);
-            tri.matId = shape.mesh.material_ids[f] + 1; // -1 becomes 0 (default material)
-            triangles.push_back(tri);
         }
-    }
+    });
+
+    for (size_t b = 0; b < numBlocks; b++)
+        blockOffsets[b + 1] = blockOffsets[b] + blockVerts[b].size();
+    mesh.vertices.resize(blockOffsets[numBlocks]);
 
-    // Read materialsVec into own format
-    for (tinyobj::material_t &t_mat : materialsVec)
+    pool.parallelFor(numBlocks, [&](size_t b)
     {
-        Material m;
-        m.Kd = float3(t_mat.diffuse[0], t_mat.diffuse[1], t_mat.diffuse[2]);
-        m.Ks = float3(t_mat.specular[0], t_mat.specular[1], t_mat.specular[2]);
-        m.Ke = float3(t_mat.emission[0], t_mat.emission[1], t_mat.emission[2]);
-        m.Ns = t_mat.shininess;
-        m.Ni = t_mat.ior;
-        m.map_Kd = tryImportTexture(unixifyPath(folderPath + t_mat.diffuse_texname), unixifyPath(t_mat.diffuse_texname));
-        m.map_Ks = tryImportTexture(unixifyPath(folderPath + t_mat.specular_texname), unixifyPath(t_mat.specular_texname));
-        m.map_N = tryImportTexture(unixifyPath(folderPath + t_mat.bump_texname), unixifyPath(t_mat.bump_texname)); // map_bump in mtl treated as normal map
-        m.type = parseShaderType(t_mat.unknown_parameter["shader"]);
+        const std::vector<Key> &keys = blockVerts[b];
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            const Key &k = keys[i];
+            VertexPNT &V = mesh.vertices[blockOffsets[b] + i];
+            V.p = float3(positions[3 * k.v + 0], positions[3 * k.v + 1], positions[3 * k.v + 2]);
+            V.n = (k.vn >= 0) ? float3(normals[3 * k.vn + 0], normals[3 * k.vn + 1], normals[3 * k.vn + 2]) : float3(0.0f);
+            V.t = (k.vt >= 0) ? float3(texcoords[2 * k.vt + 0], texcoords[2 * k.vt + 1], 0.0f) : float3(0.0f);
+        }
 
-        materials.push_back(m);
-        materialTypes |= m.type;
-    }
+        const size_t s = b * MeshBlockSize;
+        const size_t e = std::min(numTris, s + MeshBlockSize);
+        for (size_t f = s; f < e; f++)
+            for (size_t v = 0; v < 3; v++)
+                mesh.triangles[triBase + f].v[v] += (unsigned int)blockOffsets[b];
+    });
 }
 
-// Import texture if it exists and hasn't been loaded yet, set index in material
-cl_int Scene::tryImportTexture(const std::string path, std::string name)
+// Reserve texture index for material, decoded later by startTextureImport()
+cl_int Scene::requestTexture(const std::string path, std::string name)
 {
     if (name.length() == 0) return -1;
 
-    auto prev = std::find_if(textures.begin(), textures.end(), [name](Texture *t) { return t->getName() == name; });
-    if (prev != textures.end())
-    {
-        return (cl_int)(prev - textures.begin());
-    }
-
-    // Texture doesn't exist, load it 
-    Texture *tex = new Texture(path, name);
-    if (tex->getName() == "error") return -1;
-
-    textures.push_back(tex);
-    return (cl_int)(textures.size() - 1);
+    auto prev = textureSlots.find(name);
+    if (prev != textureSlots.end())
+        return prev->second;
+
+    cl_int slot = (cl_int)texturePaths.size();
+    texturePaths.push_back(path);
+    dependencies.push_back(path);
+    textureNames.push_back(name);
+    textures.push_back(nullptr);
+    textureSlots[name] = slot;
+    return slot;
 }
 
-void Scene::loadObjModel(const std::string filename)
+// Read and hash requested files in parallel, decode unique contents in the background
+void Scene::startTextureImport()
 {
-    std::vector<float3> positions, normals;
-    std::vector<std::array<unsigned, 6>> faces;
-    
-    int face_format = -1;
-    std::string format_string = "";
-    bool negative_indices = false;
+    const size_t numSlots = texturePaths.size();
+    if (numSlots == 0) return;
 
-    // Open input file stream for reading.
-    std::ifstream input(filename, std::ios::in);
+    textureStart = std::chrono::high_resolution_clock::now();
+    texturePool.reset(new TaskPool());
 
-    if(!input)
+    std::vector<std::shared_ptr<MappedFile>> files(numSlots);
+    std::vector<size_t> hashes(numSlots);
+    texturePool->parallelFor(numSlots, [&](size_t i)
     {
-        std::cout << "Could not open file: " << filename << ", exiting..." << std::endl;
-        waitExit();
-    }
-
-    // Read the file line by line.
-    std::string line;
-    while(getline(input, line))
+        files[i] = std::make_shared<MappedFile>(texturePaths[i]);
+        hashes[i] = (files[i]->valid()) ? computeHash(files[i]->data(), files[i]->size()) : 0;
+    });
+
+    // Same content under different names => first occurrence is decoded
+    std::vector<cl_int> remap(numSlots);
+    std::unordered_map<size_t, cl_int> firstByHash;
+    for (size_t i = 0; i < numSlots; i++)
     {
-        // Temporary objects to read data into
-        std::array<unsigned, 6>  f; // Face index array
-        std::string              s;
-
-        std::istringstream iss(line);
-
-        // Read object type into s
-        iss >> s;
-
-        // MSVCCompiler has a float cast performance bug
-        //   => patch: read into string, cast with atof
-        std::string s1, s2, s3;
-        if (s == "v")
+        remap[i] = (cl_int)i;
+        if (!files[i]->valid())
         {
-            iss >> s1 >> s2 >> s3;
-            float x = (float)atof(s1.c_str());
-            float y = (float)atof(s2.c_str());
-            float z = (float)atof(s3.c_str());
-            positions.push_back(float3(x, y, z));
-        }
-        else if (s == "vn")
-        {
-            iss >> s1 >> s2 >> s3;
-            float nx = (float)atof(s1.c_str());
-            float ny = (float)atof(s2.c_str());
-            float nz = (float)atof(s3.c_str());
-            normals.push_back(float3(nx, ny, nz));
+            std::cout << "Texture loading failed for " << texturePaths[i] << std::endl;
+            continue;
         }
-        else if (s == "f")
-        {
-            setFaceFormat(face_format, format_string, negative_indices, iss);
-
-            unsigned sink; // Texture indices ignored for now
-
-            switch (face_format) {
-            case 0:
-                sscanf(line.c_str(), format_string.c_str(), &f[0], &sink, &f[1], &f[2], &sink, &f[3], &f[4], &sink, &f[5]);
-                break;
-            case 1:
-                sscanf(line.c_str(), format_string.c_str(), &f[0], &f[1], &f[2], &f[3], &f[4], &f[5]);
-                break;
-            case 2:
-                sscanf(line.c_str(), format_string.c_str(), &f[0], &sink, &f[2], &sink, &f[4], &sink);
-                break;
-            case 3:
-                sscanf(line.c_str(), format_string.c_str(), &f[0], &f[2], &f[4]);
-                break;
-            }
-
-            if (negative_indices)
-            {
-                // Calculate indices from offsets
-                int p = positions.size();
-                int n = normals.size();
-                f[0] = p - f[0];
-                f[1] = n - f[1];
-                f[2] = p - f[2];
-                f[3] = n - f[3];
-                f[4] = p - f[4];
-                f[5] = n - f[5];
-            }
-            else
-            {
-                // Obj indices start from 1, need to be shifted
-                for (unsigned& v : f)
-                {
-                    v -= 1;
-                }
-            }
 
-            faces.push_back(f);
-        }
+        auto prev = firstByHash.find(hashes[i]);
+        if (prev != firstByHash.end() && files[prev->second]->size() == files[i]->size())
+            remap[i] = prev->second;
+        else
+            firstByHash[hashes[i]] = (cl_int)i;
     }
 
-    unpackIndexedData(positions, normals, faces, false);
-}
-
-/* Used for loading PLY meshes */
-void Scene::loadPlyModel(const std::string filename)
-{
-    struct Element
+    for (Material &m : materials)
     {
-        std::string name;                // e.g. vertex
-        int lines;                       // e.g. 1300
-        std::vector<std::string> props;  // e.g. [x, y, z, nx, ny, nz]
-    };
-
-    // Keep track of what data, and how meny elements each, to expect
-    std::vector<Element> elements;
-
-    // Open input file stream for reading.
-    std::ifstream input(filename, std::ios::in);
-
-    std::string line;
+        if (m.map_Kd >= 0) m.map_Kd = remap[m.map_Kd];
+        if (m.map_Ks >= 0) m.map_Ks = remap[m.map_Ks];
+        if (m.map_N >= 0) m.map_N = remap[m.map_N];
+    }
 
-    // Data of current element
-    std::string type = "none";
-    int num_elem = 0;
-    std::vector<std::string> currentProps;
+    std::cout << "Decoding " << firstByHash.size() << " textures (" << numSlots - firstByHash.size()
+              << " duplicate or missing files skipped, " << texturePool->numThreads() << " threads)" << std::endl;
 
-    /* READ HEADERS */
-    while (getline(input, line))
+    // Mapping is kept alive by the task, released after decoding
+    for (auto &entry : firstByHash)
     {
-        std::istringstream iss(line);
-        std::string s;
-        iss >> s;
-        if (s == "element")
+        const cl_int slot = entry.second;
+        std::shared_ptr<MappedFile> file = files[slot];
+        std::string name = textureNames[slot];
+        Texture **dst = &textures[slot];
+        texturePool->submit([file, name, dst]()
         {
-            elements.push_back(Element{ type, num_elem, currentProps }); //Push previous element
-            currentProps.clear();
-            iss >> type >> num_elem;
-        }
-        else if (s == "property")
-        {
-            std::string type, name;
-            iss >> type >> name;
-            currentProps.push_back(name);
-        }
-        else if (s == "end_header")
-        {
-            elements.push_back(Element{ type, num_elem, currentProps }); //push last element
-            break;
-        }
+            *dst = new Texture(name, file->data(), file->size());
+        });
     }
+}
 
-    std::cout << "PLY headers processed" << std::endl;
+// Drop failed and duplicate slots, compact material texture indices
+void Scene::waitTextures()
+{
+    if (!texturePool) return;
 
-    std::vector<float3> positions, normals;
-    std::vector<std::array<unsigned, 6>> faces;
+    texturePool->wait();
+    texturePool.reset();
 
-    /* READ DATA */
-    for (Element &e : elements)
+    std::vector<cl_int> remap(textures.size(), -1);
+    std::vector<Texture*> loaded;
+    size_t bytes = 0;
+    for (size_t i = 0; i < textures.size(); i++)
     {
-        if (e.name == "vertex")
-        {
-            std::cout << "Reading " << e.lines << " vertices" << std::endl;
-            for (int i = 0; i < e.lines; i++)
-            {
-                getline(input, line);
-                std::istringstream iss(line);
-
-                // MSVCCompiler has a float cast performance bug
-                //   => patch: read into string, cast with atof
-                std::map<std::string, float> map;
-                std::string bucket;
-                for (std::string name : e.props)
-                {
-                    iss >> bucket;
-                    map[name] = (float)atof(bucket.c_str());
-                }
+        Texture *t = textures[i];
+        if (!t) continue;
 
-                positions.push_back(float3(map["x"], map["y"], map["z"]));
-                if (map.find("nx") != map.end()) // contains normals
-                    normals.push_back(float3(map["nx"], map["ny"], map["nz"]));
-            }
-        }
-        else if (e.name == "face")
+        if (t->getName() == "error")
         {
-            std::cout << "Reading " << e.lines << " faces" << std::endl;
-            for (int i = 0; i < e.lines; i++)
-            {
-                getline(input, line);
-                std::istringstream iss(line);
-
-                std::array<unsigned, 6>  f; // Face index array
-
-                // Face list format: '3 i1 i2 i3' (triangle) or '4 i1 i2 i3 i4' (quad)
-                // A quad can be represented with two triangles
-
-                int poly_type;
-                iss >> poly_type;
-
-                if (poly_type == 3)
-                {
-                    iss >> f[0] >> f[2] >> f[4];
-                    faces.push_back(f);
-                }
-                else if (poly_type == 4)
-                {
-                    int i0, i1, i2, i3;
-                    iss >> i0 >> i1 >> i2 >> i3;
+            delete t;
+            continue;
+        }
 
-                    //triangle 1
-                    f[0] = i0; f[2] = i1; f[4] = i2;
-                    faces.push_back(f);
+        remap[i] = (cl_int)loaded.size();
+        loaded.push_back(t);
+        bytes += (size_t)t->getWidth() * t->getHeight() * 4;
+    }
 
-                    //triangle 2
-                    f[0] = i2; f[2] = i3; f[4] = i0;
-                    faces.push_back(f);
-                }
-                else
-                {
-                    std::cout << "Unknown polygon type!" << std::endl;
-                    waitExit();
-                }
-            }
-        }
-        else
-        {
-            //skip data
-            std::cout << "Skipping element of type " << e.name << std::endl;
-            for (int i = 0; i < e.lines; i++)
-            {
-                getline(input, line);
-            }
-        }
+    for (Material &m : materials)
+    {
+        if (m.map_Kd >= 0) m.map_Kd = remap[m.map_Kd];
+        if (m.map_Ks >= 0) m.map_Ks = remap[m.map_Ks];
+        if (m.map_N >= 0) m.map_N = remap[m.map_N];
     }
 
-    unpackIndexedData(positions, normals, faces, true); //true = ply format
+    textures.swap(loaded);
+    std::vector<std::string>().swap(texturePaths);
+    std::vector<std::string>().swap(textureNames);
+    textureSlots.clear();
+
+    auto textureEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Textures ready after " << std::chrono::duration<double, std::milli>(textureEnd - textureStart).count()
+              << " ms: " << textures.size() << " textures (" << bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
 }
 
-void Scene::unpackIndexedData(const std::vector<float3> &positions,
-                              const std::vector<float3>& normals,
-                              const std::vector<std::array<unsigned, 6>>& faces,
-                              bool type_ply)
+/* Used for loading PLY meshes */
+void Scene::loadPlyModel(const std::string filename, ProgressView *progress)
 {
-    std::cout << "Unpacking mesh" << std::endl;
+    size_t fileNameStart = unixifyPath(filename).find_last_of("/");
+    std::string meshName = filename.substr(fileNameStart + 1);
+    if (progress) progress->showMessage("Loading mesh", meshName);
 
-    std::cout << "Positions: " << positions.size() << std::endl;
-    std::cout << "Normals: " << normals.size() << std::endl;
-    std::cout << "Faces: " << faces.size() << std::endl;
-
-    VertexPNT v0, v1, v2;
-
-    for (auto& f : faces)
+    PlyParser parser(filename);
+    if (!parser.parse())
     {
-        // f[0] = index of the position of the first vertex
-        // f[1] = index of the normal of the first vertex
-        // f[2] = index of the position of the second vertex
-        // ...
-
-        v0.p = positions[f[0]];
-        v1.p = positions[f[2]];
-        v2.p = positions[f[4]];
+        std::cout << "PLY loading failed" << std::endl;
+        waitExit();
+    }
 
-        if (normals.size() == 0)
-        {
-            // Generate normals
-            v0.n = v1.n = v2.n = normalize(cross(v1.p - v0.p, v2.p - v0.p));
-        }
-        else if(type_ply)
+    const std::vector<float> &positions = parser.positions;
+    const std::vector<float> &normals = parser.normals;
+    const bool hasNormals = normals.size() > 0;
+
+    // PLY-normals have the same indices as their corresponding vertices
+    // Zero normals => flat shading with geometric normal
+    if (progress) progress->showMessage("Converting mesh", meshName);
+    const size_t numVerts = positions.size() / 3;
+    const size_t numTris = parser.indices.size() / 3;
+    const size_t vertBase = mesh.vertices.size();
+    const size_t triBase = mesh.triangles.size();
+    mesh.vertices.resize(vertBase + numVerts);
+    mesh.triangles.resize(triBase + numTris);
+
+    TaskPool pool;
+    const size_t numChunks = pool.numThreads() * 4;
+    pool.parallelFor(numChunks, [&](size_t c)
+    {
+        for (size_t i = numVerts * c / numChunks; i < numVerts * (c + 1) / numChunks; i++)
         {
-            // PLY-normals have the same indices as their corresponding vertices
-            v0.n = normals[f[0]];
-            v1.n = normals[f[2]];
-            v2.n = normals[f[4]];
+            VertexPNT &V = mesh.vertices[vertBase + i];
+            V.p = float3(positions[3 * i + 0], positions[3 * i + 1], positions[3 * i + 2]);
+            V.n = (hasNormals) ? float3(normals[3 * i + 0], normals[3 * i + 1], normals[3 * i + 2]) : float3(0.0f);
+            V.t = float3(0.0f);
         }
-        else
+
+        for (size_t f = numTris * c / numChunks; f < numTris * (c + 1) / numChunks; f++)
         {
-            // Use pre-calculated normals for OBJ
-            v0.n = normals[f[1]];
-            v1.n = normals[f[3]];
-            v2.n = normals[f[5]];
+            mesh.triangles[triBase + f] = RTTriangle(
+                (unsigned int)(vertBase + parser.indices[3 * f + 0]),
+                (unsigned int)(vertBase + parser.indices[3 * f + 1]),
+                (unsigned int)(vertBase + parser.indices[3 * f + 2]));
         }
-
-        triangles.push_back(RTTriangle(v0, v1, v2));
-    }
-};
\ No newline at end of file
+    });
+}
@@ -8,6 +8,9 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
 #include "texture.hpp"
 #include "envmap.hpp"
 #include "triangle.hpp"
@@ -15,8 +18,11 @@
 
 using FireRays::float3;
 class ProgressView;
+class TaskPool;
 
 class Scene {
+    friend class SceneCache;
+
 public:
     Scene();
     ~Scene();
@@ -25,32 +31,38 @@ public:
     void setEnvMap(std::shared_ptr<EnvironmentMap> envMapPtr);
     void loadModel(const std::string filename, ProgressView *progress); // load .obj or .ply model
 
-    std::vector<RTTriangle> &getTriangles() { return triangles; }
-    std::vector<Material> &getMaterials() { return materials; }
-    std::vector<Texture*> &getTextures() { return textures; }
+    TriangleMesh &getMesh() { return mesh; }
+    std::vector<Material> &getMaterials() { waitTextures(); return materials; } // texture indices final after join
+    std::vector<Texture*> &getTextures() { waitTextures(); return textures; }
+    TexturePack &getTexturePack(); // mip chains, built on first use
     std::shared_ptr<EnvironmentMap> getEnvMap() { return envmap; }
 
+    void waitTextures(); // join pending texture decoding
+
     std::string hashString();
     unsigned int getMaterialTypes() { return materialTypes; }
 
 private:
-    void loadObjModel(const std::string filename);
-    void loadPlyModel(const std::string filename);
+    void loadPlyModel(const std::string filename, ProgressView *progress);
 
-    // With tiny_obj_loader
+    // With parallel OBJ parser, tiny_obj_loader for MTL files
     void loadObjWithMaterials(const std::string filename, ProgressView *progress);
-    cl_int tryImportTexture(const std::string path, const std::string name);
+    cl_int requestTexture(const std::string path, const std::string name);
+    void startTextureImport();
     cl_int parseShaderType(std::string &type);
 
-    void unpackIndexedData(const std::vector<float3> &positions,
-                           const std::vector<float3>& normals,
-                           const std::vector<std::array<unsigned, 6>>& faces,
-                           bool type_ply);
-
   std::shared_ptr<EnvironmentMap> envmap;
-  std::vector<RTTriangle> triangles;
+  TriangleMesh mesh;
   std::vector<Material> materials;
   std::vector<Texture*> textures;
+  TexturePack texturePack;
+  bool compressTextures = false; // BC1 for color textures, per-scene setting
+  std::vector<std::string> texturePaths; // requested files, index = material texture index
+  std::vector<std::string> textureNames;
+  std::vector<std::string> dependencies; // material libraries and textures, for scene cache staleness
+  std::unordered_map<std::string, cl_int> textureSlots; // name => index
+  std::unique_ptr<TaskPool> texturePool; // decodes in background until waitTextures()
+  std::chrono::high_resolution_clock::time_point textureStart;
   size_t hash;
   unsigned int materialTypes = 0; // bits represent material types present in scene
 };
@@ -0,0 +1,279 @@
+#include "scenecache.hpp"
+#include "scene.hpp"
+#include "bvh.hpp"
+#include "utils.h"
+#include "settings.hpp"
+#include "xxhash/xxhash.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+static const U32 SceneCacheMagic = 0x4E435346; // 'FSCN'
+static const U32 SceneCacheVersion = 4;
+static const size_t SectionAlignment = 64;
+
+enum Section
+{
+    Section_Vertices,
+    Section_Triangles,
+    Section_Materials,
+    Section_TexDescriptors,
+    Section_TexData,        // mip chains, as uploaded
+    Section_Hierarchy,
+    Section_Dependencies,   // size, mtime and path of material/texture files
+    NumSections
+};
+
+struct SceneCacheHeader
+{
+    U32 magic;
+    U32 version;
+    U32 vertexSize;     // struct sizes catch layout changes
+    U32 triangleSize;
+    U32 materialSize;
+    U32 textureCompression;
+    U64 sourceSize;
+    U64 sourceMtime;
+    U64 sourceHash;     // content hash, names hierarchy and state files
+    U32 materialTypes;
+    U32 numTextures;
+    U64 offsets[NumSections]; // from start of file, aligned
+    U64 sizes[NumSections];
+    U64 checksum;       // XXH64 of everything after header
+};
+
+static inline size_t alignUp(size_t offset)
+{
+    return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+}
+
+// Missing files are recorded too, creating one makes the cache stale
+static void dependencyStats(const std::string &path, U64 &size, U64 &mtime)
+{
+    uint64_t s, t;
+    if (!getFileStats(path, s, t))
+        s = t = ~0ull;
+    size = s;
+    mtime = t;
+}
+
+static void serializeDependencies(const std::vector<std::string> &paths, std::vector<char> &out)
+{
+    for (const std::string &path : paths)
+    {
+        U64 stats[2];
+        dependencyStats(path, stats[0], stats[1]);
+        const U32 len = (U32)path.length();
+        out.insert(out.end(), (const char*)stats, (const char*)(stats + 2));
+        out.insert(out.end(), (const char*)&len, (const char*)(&len + 1));
+        out.insert(out.end(), path.begin(), path.end());
+    }
+}
+
+// False if any file changed or the section is malformed
+static bool checkDependencies(const char *p, const char *end, std::vector<std::string> &paths)
+{
+    while (p < end)
+    {
+        U64 stats[2];
+        U32 len;
+        if ((size_t)(end - p) < sizeof(stats) + sizeof(len))
+            return false;
+        memcpy(stats, p, sizeof(stats));
+        memcpy(&len, p + sizeof(stats), sizeof(len));
+        p += sizeof(stats) + sizeof(len);
+        if ((size_t)(end - p) < len)
+            return false;
+
+        std::string path(p, len);
+        p += len;
+
+        U64 size, mtime;
+        dependencyStats(path, size, mtime);
+        if (size != stats[0] || mtime != stats[1])
+            return false;
+        paths.push_back(path);
+    }
+    return true;
+}
+
+std::string SceneCache::cachePath(const std::string sourceFile)
+{
+    std::string absPath = getAbsolutePath(sourceFile);
+    return "data/scenes/scene_" + std::to_string(computeHash(absPath.data(), absPath.length())) + ".bin";
+}
+
+bool SceneCache::load(const std::string sourceFile, Scene &scene, BVH **bvh)
+{
+    *bvh = nullptr;
+
+    uint64_t sourceSize, sourceMtime;
+    if (!getFileStats(sourceFile, sourceSize, sourceMtime))
+        return false;
+
+    MappedFile file(cachePath(sourceFile));
+    if (!file.valid() || file.size() < sizeof(SceneCacheHeader))
+        return false;
+
+    SceneCacheHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    if (h.magic != SceneCacheMagic || h.version != SceneCacheVersion ||
+        h.vertexSize != sizeof(VertexPNT) || h.triangleSize != sizeof(RTTriangle) || h.materialSize != sizeof(Material))
+    {
+        std::cout << "Scene cache has outdated format" << std::endl;
+        return false;
+    }
+
+    if (h.sourceSize != sourceSize || h.sourceMtime != sourceMtime)
+    {
+        std::cout << "Scene cache is stale" << std::endl;
+        return false;
+    }
+
+    const bool compressTextures = Settings::getInstance().getTextureCompression(sourceFile);
+    if (h.textureCompression != (U32)compressTextures)
+    {
+        std::cout << "Scene cache has different texture compression" << std::endl;
+        return false;
+    }
+
+    // Header is not checksummed => sections must lie within payload before anything is read
+    const size_t payloadStart = alignUp(sizeof(SceneCacheHeader));
+    bool inBounds = file.size() >= payloadStart;
+    for (int s = 0; s < NumSections && inBounds; s++)
+        inBounds = h.offsets[s] >= payloadStart && h.offsets[s] <= file.size() && h.sizes[s] <= file.size() - h.offsets[s];
+    inBounds = inBounds && (U64)h.numTextures * sizeof(TexDescriptor) <= h.sizes[Section_TexDescriptors];
+
+    const size_t end = inBounds ? h.offsets[NumSections - 1] + h.sizes[NumSections - 1] : 0;
+    if (!inBounds || file.size() != end || XXH64(file.data() + payloadStart, end - payloadStart, 0) != h.checksum)
+    {
+        std::cout << "Scene cache is corrupt" << std::endl;
+        return false;
+    }
+
+    auto section = [&](Section s) { return file.data() + h.offsets[s]; };
+
+    // Material libraries and textures are not covered by source size and mtime
+    std::vector<std::string> dependencies;
+    if (!checkDependencies(section(Section_Dependencies), section(Section_Dependencies) + h.sizes[Section_Dependencies], dependencies))
+    {
+        std::cout << "Scene cache is stale (materials or textures changed)" << std::endl;
+        return false;
+    }
+    scene.dependencies.swap(dependencies);
+
+    const VertexPNT *verts = reinterpret_cast<const VertexPNT*>(section(Section_Vertices));
+    scene.mesh.vertices.assign(verts, verts + h.sizes[Section_Vertices] / sizeof(VertexPNT));
+
+    const RTTriangle *tris = reinterpret_cast<const RTTriangle*>(section(Section_Triangles));
+    scene.mesh.triangles.assign(tris, tris + h.sizes[Section_Triangles] / sizeof(RTTriangle));
+
+    const Material *mats = reinterpret_cast<const Material*>(section(Section_Materials));
+    scene.materials.assign(mats, mats + h.sizes[Section_Materials] / sizeof(Material));
+
+    // Packed textures only, no decoded originals on warm starts
+    const TexDescriptor *descs = reinterpret_cast<const TexDescriptor*>(section(Section_TexDescriptors));
+    scene.texturePack.descriptors.assign(descs, descs + h.numTextures);
+    const cl_uchar *texData = reinterpret_cast<const cl_uchar*>(section(Section_TexData));
+    scene.texturePack.data.assign(texData, texData + h.sizes[Section_TexData]);
+    scene.compressTextures = compressTextures;
+
+    scene.materialTypes = h.materialTypes;
+    scene.hash = (size_t)h.sourceHash;
+
+    *bvh = new BVH(&scene.mesh, section(Section_Hierarchy), h.sizes[Section_Hierarchy]);
+    if (!(*bvh)->isValid())
+    {
+        delete *bvh;
+        *bvh = nullptr;
+    }
+
+    return true;
+}
+
+void SceneCache::save(const std::string sourceFile, Scene &scene, const BVH &bvh)
+{
+    const TexturePack &pack = scene.getTexturePack();
+
+    SceneCacheHeader h = {};
+    h.magic = SceneCacheMagic;
+    h.version = SceneCacheVersion;
+    h.vertexSize = sizeof(VertexPNT);
+    h.triangleSize = sizeof(RTTriangle);
+    h.materialSize = sizeof(Material);
+    h.sourceHash = scene.hash;
+    h.materialTypes = scene.materialTypes;
+    h.textureCompression = (U32)scene.compressTextures;
+    h.numTextures = (U32)pack.descriptors.size();
+
+    uint64_t sourceSize, sourceMtime;
+    if (!getFileStats(sourceFile, sourceSize, sourceMtime))
+        return;
+    h.sourceSize = sourceSize;
+    h.sourceMtime = sourceMtime;
+
+    std::vector<char> hierarchy;
+    bvh.serialize(hierarchy);
+
+    std::vector<char> dependencies;
+    serializeDependencies(scene.dependencies, dependencies);
+
+    const size_t sizes[NumSections] =
+    {
+        scene.mesh.vertices.size() * sizeof(VertexPNT),
+        scene.mesh.triangles.size() * sizeof(RTTriangle),
+        scene.materials.size() * sizeof(Material),
+        pack.descriptors.size() * sizeof(TexDescriptor),
+        pack.data.size(),
+        hierarchy.size(),
+        dependencies.size()
+    };
+
+    size_t offset = alignUp(sizeof(SceneCacheHeader));
+    for (int s = 0; s < NumSections; s++)
+    {
+        h.offsets[s] = offset;
+        h.sizes[s] = sizes[s];
+        offset = alignUp(offset + sizes[s]);
+    }
+
+    std::ofstream out(cachePath(sourceFile), std::ios::binary);
+    if (!out.good())
+    {
+        std::cout << "Could not create scene cache file!" << std::endl;
+        return;
+    }
+
+    // Header written last, once checksum is known
+    XXH64_state_t *state = XXH64_createState();
+    XXH64_reset(state, 0);
+    size_t pos = alignUp(sizeof(SceneCacheHeader));
+    out.seekp(pos);
+
+    const char zeros[SectionAlignment] = {};
+    auto append = [&](const void *data, size_t bytes)
+    {
+        out.write(static_cast<const char*>(data), bytes);
+        XXH64_update(state, data, bytes);
+        pos += bytes;
+    };
+    auto pad = [&]()
+    {
+        append(zeros, alignUp(pos) - pos);
+    };
+
+    append(scene.mesh.vertices.data(), sizes[Section_Vertices]); pad();
+    append(scene.mesh.triangles.data(), sizes[Section_Triangles]); pad();
+    append(scene.materials.data(), sizes[Section_Materials]); pad();
+    append(pack.descriptors.data(), sizes[Section_TexDescriptors]); pad();
+    append(pack.data.data(), sizes[Section_TexData]); pad();
+    append(hierarchy.data(), sizes[Section_Hierarchy]); pad();
+    append(dependencies.data(), sizes[Section_Dependencies]);
+
+    h.checksum = XXH64_digest(state);
+    XXH64_freeState(state);
+
+    out.seekp(0);
+    write(out, h);
+    out.write(zeros, alignUp(sizeof(SceneCacheHeader)) - sizeof(SceneCacheHeader));
+}
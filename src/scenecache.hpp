@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+class Scene;
+class BVH;
+
+/*
+    Packed scene cache: geometry, materials, texture mip chains (BC1 if enabled for the scene)
+    and hierarchy in one mappable file.
+    Keyed by source path, size and modification time, plus those of material libraries and textures
+    => no parsing, decoding or hashing on warm starts.
+*/
+class SceneCache
+{
+public:
+    // Fills empty scene, hierarchy is null if cached one is unusable
+    static bool load(const std::string sourceFile, Scene &scene, BVH **bvh);
+    static void save(const std::string sourceFile, Scene &scene, const BVH &bvh);
+
+private:
+    static std::string cachePath(const std::string sourceFile);
+};
@@ -1,4 +1,5 @@
 #include <fstream>
+#include <algorithm>
 #include "settings.hpp"
 
 using json = nlohmann::json;
@@ -18,8 +19,26 @@ void Settings::init()
     windowWidth = 640;
     windowHeight = 480;
     wfBufferSize = 1 << 20; // appropriate for dedicated GPU
+    wfSegmentsPerFrame = 1;
+    wfRaySort = false;
+    wfMaterialSort = false;
     clUseBitstack = false;
     clUseSoA = true;
+    sahBins = 0;
+    lbvhPreview = false;
+    bvhWidth = 2;
+    bvhQuantized = false;
+    bvhLayout = "depthFirst";
+    sceneCache = true;
+    textureCompression = false;
+    envMapHalfFloat = false;
+    envMapTableScale = 1;
+}
+
+bool Settings::getTextureCompression(const std::string scene)
+{
+    auto it = textureCompressionScenes.find(scene);
+    return (it != textureCompressionScenes.end()) ? it->second : textureCompression;
 }
 
 inline bool contains(json j, std::string value)
@@ -66,6 +85,44 @@ void Settings::import(json j)
     if (contains(j, "clUseBitstack")) this->clUseBitstack = j["clUseBitstack"].get<bool>();
     if (contains(j, "clUseSoA")) this->clUseSoA = j["clUseSoA"].get<bool>();
     if (contains(j, "wfBufferSize")) this->wfBufferSize = j["wfBufferSize"].get<unsigned int>();
+    if (contains(j, "wfSegmentsPerFrame")) this->wfSegmentsPerFrame = std::max(1u, j["wfSegmentsPerFrame"].get<unsigned int>());
+    if (contains(j, "wfRaySort")) this->wfRaySort = j["wfRaySort"].get<bool>();
+    if (contains(j, "wfMaterialSort")) this->wfMaterialSort = j["wfMaterialSort"].get<bool>();
+    if (contains(j, "sahBins")) this->sahBins = j["sahBins"].get<unsigned int>();
+    if (contains(j, "lbvhPreview")) this->lbvhPreview = j["lbvhPreview"].get<bool>();
+    if (contains(j, "bvhWidth")) this->bvhWidth = j["bvhWidth"].get<unsigned int>();
+    if (contains(j, "bvhQuantized")) this->bvhQuantized = j["bvhQuantized"].get<bool>();
+    if (contains(j, "bvhLayout")) this->bvhLayout = j["bvhLayout"].get<std::string>();
+    if (contains(j, "sceneCache")) this->sceneCache = j["sceneCache"].get<bool>();
+
+    // Either a flag or an object of scene paths and flags, with optional "default"
+    if (contains(j, "textureCompression"))
+    {
+        json tc = j["textureCompression"];
+        if (tc.is_boolean())
+        {
+            this->textureCompression = tc.get<bool>();
+        }
+        else if (tc.is_object())
+        {
+            for (auto it = tc.begin(); it != tc.end(); ++it)
+            {
+                if (it.key() == "default")
+                    this->textureCompression = it.value().get<bool>();
+                else
+                    this->textureCompressionScenes[it.key()] = it.value().get<bool>();
+            }
+        }
+    }
+
+    if (contains(j, "envMapHalfFloat")) this->envMapHalfFloat = j["envMapHalfFloat"].get<bool>();
+    if (contains(j, "envMapTableScale")) this->envMapTableScale = std::max(1u, j["envMapTableScale"].get<unsigned int>());
+
+    if (bvhWidth != 2 && bvhWidth != 4 && bvhWidth != 8)
+    {
+        std::cout << "Unsupported BVH width " << bvhWidth << ", using binary BVH" << std::endl;
+        bvhWidth = 2;
+    }
 
     // Map of numbers 1-5 to scenes (shortcuts)
     if (contains(j, "shortcuts"))
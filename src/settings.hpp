@@ -28,6 +28,18 @@ public:
     bool getUseBitstack() { return clUseBitstack; }
     bool getUseSoA() { return clUseSoA; }
     unsigned int getWfBufferSize() { return wfBufferSize; }
+    unsigned int getWfSegmentsPerFrame() { return wfSegmentsPerFrame; }
+    bool getWfRaySort() { return wfRaySort; }
+    bool getWfMaterialSort() { return wfMaterialSort; }
+    unsigned int getSahBins() { return sahBins; }
+    bool getUseLbvhPreview() { return lbvhPreview; }
+    unsigned int getBvhWidth() { return bvhWidth; }
+    bool getBvhQuantized() { return bvhQuantized; }
+    std::string getBvhLayout() { return bvhLayout; }
+    bool getUseSceneCache() { return sceneCache; }
+    bool getTextureCompression(const std::string scene);
+    bool getEnvMapHalfFloat() { return envMapHalfFloat; }
+    unsigned int getEnvMapTableScale() { return envMapTableScale; }
 
 private:
     Settings();
@@ -41,6 +53,19 @@ private:
     std::string envMapName;
     std::map<unsigned int, std::string> shortcuts;
     unsigned int wfBufferSize;
+    unsigned int wfSegmentsPerFrame; // wavefront iterations enqueued between host syncs
+    bool wfRaySort;                  // bin extension rays before tracing, toggled with B
+    bool wfMaterialSort;             // bin material queues by matId before shading, toggled with N
+    unsigned int sahBins; // 0 => full sweep SAH
+    bool lbvhPreview;     // render with HLBVH while SBVH is built
+    unsigned int bvhWidth; // 2 => binary, 4/8 => collapsed wide BVH
+    bool bvhQuantized;     // 8-bit child bounds
+    std::string bvhLayout; // node order: depthFirst, surfaceArea
+    bool sceneCache;       // packed geometry, textures and BVH in data/scenes
+    bool textureCompression; // BC1 textures, default for all scenes
+    std::map<std::string, bool> textureCompressionScenes; // per-scene overrides
+    bool envMapHalfFloat;           // upload env map as CL_HALF_FLOAT
+    unsigned int envMapTableScale;  // downsampling of env map IS tables, 1 => full resolution
     bool clUseBitstack;
     bool clUseSoA;
     int windowWidth;
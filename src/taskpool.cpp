@@ -0,0 +1,127 @@
+#include "taskpool.hpp"
+
+// Worker that is executing on the current thread (if any)
+static thread_local TaskPool *tlsPool = nullptr;
+static thread_local unsigned int tlsWorkerId = 0;
+
+TaskPool::TaskPool(unsigned int numThreads) : m_queued(0), m_pending(0), m_nextQueue(0)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < numThreads; i++)
+		m_workers.emplace_back(new Worker());
+
+	for (unsigned int i = 0; i < numThreads; i++)
+		m_threads.emplace_back(&TaskPool::workerLoop, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread &t : m_threads)
+		t.join();
+}
+
+void TaskPool::submit(std::function<void()> task)
+{
+	// Subtasks stay on the spawning worker, others are distributed round-robin
+	unsigned int id = (tlsPool == this) ? tlsWorkerId : m_nextQueue++ % numThreads();
+
+	m_pending++;
+	{
+		std::lock_guard<std::mutex> lock(m_workers[id]->lock);
+		m_workers[id]->queue.push_back(std::move(task));
+	}
+	m_queued++;
+
+	// Taking the lock prevents a lost wakeup between predicate check and sleep
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+	}
+	m_wake.notify_one();
+}
+
+void TaskPool::parallelFor(size_t count, std::function<void(size_t)> fn)
+{
+	for (size_t i = 0; i < count; i++)
+		submit([&fn, i]() { fn(i); });
+	wait();
+}
+
+void TaskPool::wait()
+{
+	std::unique_lock<std::mutex> lock(m_doneLock);
+	m_done.wait(lock, [this]() { return m_pending == 0; });
+}
+
+bool TaskPool::waitFor(std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(m_doneLock);
+	return m_done.wait_for(lock, timeout, [this]() { return m_pending == 0; });
+}
+
+bool TaskPool::popOrSteal(unsigned int id, std::function<void()> &task)
+{
+	// Own queue: newest first
+	{
+		Worker &w = *m_workers[id];
+		std::lock_guard<std::mutex> lock(w.lock);
+		if (!w.queue.empty())
+		{
+			task = std::move(w.queue.back());
+			w.queue.pop_back();
+			return true;
+		}
+	}
+
+	// Steal oldest (typically largest) task from other workers
+	for (unsigned int i = 1; i < numThreads(); i++)
+	{
+		Worker &w = *m_workers[(id + i) % numThreads()];
+		std::lock_guard<std::mutex> lock(w.lock);
+		if (!w.queue.empty())
+		{
+			task = std::move(w.queue.front());
+			w.queue.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TaskPool::workerLoop(unsigned int id)
+{
+	tlsPool = this;
+	tlsWorkerId = id;
+
+	while (true)
+	{
+		std::function<void()> task;
+		if (popOrSteal(id, task))
+		{
+			m_queued--;
+			task();
+
+			if (--m_pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(m_doneLock);
+				m_done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_wake.wait(lock, [this]() { return m_queued > 0 || m_stop; });
+		if (m_stop && m_queued == 0)
+			return;
+	}
+}
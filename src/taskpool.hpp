@@ -0,0 +1,62 @@
+#pragma once
+
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <memory>
+
+/*
+	Work-stealing task pool.
+	Each worker owns a deque: tasks submitted from a worker are pushed to its own deque
+	and popped LIFO (depth-first, cache friendly). Idle workers steal FIFO from the others.
+*/
+class TaskPool
+{
+public:
+	explicit TaskPool(unsigned int numThreads = 0); // 0 => hardware concurrency
+	~TaskPool();
+
+	TaskPool(TaskPool const&) = delete;
+	void operator=(TaskPool const&) = delete;
+
+	// Safe to call from within running tasks
+	void submit(std::function<void()> task);
+
+	// Run fn(i) for i in [0, count) and wait for completion, not to be called from tasks
+	void parallelFor(size_t count, std::function<void(size_t)> fn);
+
+	// Block until all submitted tasks (and their subtasks) have finished
+	void wait();
+	bool waitFor(std::chrono::milliseconds timeout); // true if finished
+
+	unsigned int numThreads() const { return (unsigned int)m_workers.size(); }
+
+private:
+	struct Worker
+	{
+		std::deque<std::function<void()>> queue;
+		std::mutex lock;
+	};
+
+	void workerLoop(unsigned int id);
+	bool popOrSteal(unsigned int id, std::function<void()> &task);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::vector<std::thread> m_threads;
+
+	std::atomic<int> m_queued;  // tasks waiting in deques
+	std::atomic<int> m_pending; // tasks submitted but not finished
+	std::atomic<unsigned int> m_nextQueue;
+	bool m_stop = false;
+
+	std::mutex m_sleepLock;
+	std::condition_variable m_wake;
+	std::mutex m_doneLock;
+	std::condition_variable m_done;
+};
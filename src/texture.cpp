@@ -1,7 +1,14 @@
 #include "texture.hpp"
+#include "taskpool.hpp"
 #include "IL/il.h"
 #include "IL/ilu.h"
 #include <iostream>
+#include <cstring>
+#include <cmath>
+#include <mutex>
+
+// DevIL keeps the bound image in global state
+static std::mutex ilLock;
 
 inline void checkILErrors()
 {
@@ -15,6 +22,8 @@ inline void checkILErrors()
 
 Texture::Texture(const std::string path, const std::string filename)
 {
+    std::lock_guard<std::mutex> lock(ilLock);
+
     ILuint ImageName;
     ilGenImages(1, &ImageName);
     ilBindImage(ImageName);
@@ -35,7 +44,279 @@ Texture::Texture(const std::string path, const std::string filename)
         std::cout << "Texture loading failed for " << filename << std::endl;
         checkILErrors();
         name = "error";
+        data = nullptr;
+    }
+
+    ilDeleteImages(1, &ImageName);
+}
+
+Texture::Texture(const std::string filename, const void *fileData, size_t size)
+{
+    std::lock_guard<std::mutex> lock(ilLock);
+
+    ILuint ImageName;
+    ilGenImages(1, &ImageName);
+    ilBindImage(ImageName);
+    checkILErrors();
+
+    // Format detected from header and extension-less data
+    ILboolean success = ilLoadL(IL_TYPE_UNKNOWN, fileData, (ILuint)size);
+
+    if (success == IL_TRUE)
+    {
+        width = (cl_uint)ilGetInteger(IL_IMAGE_WIDTH);
+        height = (cl_uint)ilGetInteger(IL_IMAGE_HEIGHT);
+        data = new cl_uchar[width * height * 4 * 1];
+        ilCopyPixels(0, 0, 0, width, height, 1, IL_RGBA, IL_UNSIGNED_BYTE, data);
+        name = filename;
+    }
+    else
+    {
+        std::cout << "Texture loading failed for " << filename << std::endl;
+        checkILErrors();
+        name = "error";
+        data = nullptr;
     }
 
     ilDeleteImages(1, &ImageName);
-}
\ No newline at end of file
+}
+
+Texture::Texture(const std::string name, cl_uint width, cl_uint height, const cl_uchar *rgba)
+    : name(name), width(width), height(height)
+{
+    data = new cl_uchar[width * height * 4];
+    memcpy(data, rgba, width * height * 4);
+}
+
+// Next mip level, 2x2 box filter (edge texels repeated for odd sizes)
+static void downsampleLevel(TaskPool &pool, const cl_uchar *src, cl_uint sw, cl_uint sh, cl_uchar *dst)
+{
+    const cl_uint dw = std::max(sw >> 1, 1u);
+    const cl_uint dh = std::max(sh >> 1, 1u);
+    pool.parallelFor(dh, [&](size_t y)
+    {
+        const cl_uint y0 = std::min(2 * (cl_uint)y, sh - 1);
+        const cl_uint y1 = std::min(2 * (cl_uint)y + 1, sh - 1);
+        for (cl_uint x = 0; x < dw; x++)
+        {
+            const cl_uint x0 = std::min(2 * x, sw - 1);
+            const cl_uint x1 = std::min(2 * x + 1, sw - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                unsigned sum = src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c] +
+                               src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c];
+                dst[(y * dw + x) * 4 + c] = (cl_uchar)((sum + 2) / 4);
+            }
+        }
+    });
+}
+
+static inline cl_ushort packRGB565(const float c[3])
+{
+    auto q = [](float v, float maxVal) { return (cl_ushort)std::lround(std::min(std::max(v, 0.0f), 255.0f) * maxVal / 255.0f); };
+    return (cl_ushort)((q(c[0], 31.0f) << 11) | (q(c[1], 63.0f) << 5) | q(c[2], 31.0f));
+}
+
+// Same expansion as kernel decoder
+static inline void unpackRGB565(cl_ushort c, float out[3])
+{
+    out[0] = ((c >> 11) & 31) * (255.0f / 31.0f);
+    out[1] = ((c >> 5) & 63) * (255.0f / 63.0f);
+    out[2] = (c & 31) * (255.0f / 31.0f);
+}
+
+// Endpoints at extremes of principal axis, indices to nearest palette entry
+static void encodeBC1Block(const float px[16][3], cl_uchar *out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += px[i][c] / 16.0f;
+
+    float cov[3][3] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                cov[a][b] += (px[i][a] - mean[a]) * (px[i][b] - mean[b]);
+
+    // Power iteration
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 8; iter++)
+    {
+        float next[3];
+        for (int a = 0; a < 3; a++)
+            next[a] = cov[a][0] * axis[0] + cov[a][1] * axis[1] + cov[a][2] * axis[2];
+        float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (len < 1e-6f) break;
+        for (int a = 0; a < 3; a++)
+            axis[a] = next[a] / len;
+    }
+    float len = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (int a = 0; a < 3; a++)
+        axis[a] /= len;
+
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (px[i][0] - mean[0]) * axis[0] + (px[i][1] - mean[1]) * axis[1] + (px[i][2] - mean[2]) * axis[2];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    float e0[3], e1[3];
+    for (int a = 0; a < 3; a++)
+    {
+        e0[a] = mean[a] + axis[a] * tMax;
+        e1[a] = mean[a] + axis[a] * tMin;
+    }
+
+    // c0 > c1 selects four color mode, equal endpoints => all indices zero
+    cl_ushort c0 = packRGB565(e0);
+    cl_ushort c1 = packRGB565(e1);
+    if (c0 < c1) std::swap(c0, c1);
+
+    float palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int a = 0; a < 3; a++)
+    {
+        palette[2][a] = (2.0f * palette[0][a] + palette[1][a]) / 3.0f;
+        palette[3][a] = (palette[0][a] + 2.0f * palette[1][a]) / 3.0f;
+    }
+
+    out[0] = (cl_uchar)(c0 & 0xFF);
+    out[1] = (cl_uchar)(c0 >> 8);
+    out[2] = (cl_uchar)(c1 & 0xFF);
+    out[3] = (cl_uchar)(c1 >> 8);
+    for (int y = 0; y < 4; y++)
+    {
+        cl_uchar row = 0;
+        for (int x = 0; x < 4 && c0 != c1; x++)
+        {
+            const float *p = px[y * 4 + x];
+            int best = 0;
+            float bestDist = 1e30f;
+            for (int k = 0; k < 4; k++)
+            {
+                float d0 = p[0] - palette[k][0], d1 = p[1] - palette[k][1], d2 = p[2] - palette[k][2];
+                float dist = d0 * d0 + d1 * d1 + d2 * d2;
+                if (dist < bestDist) { bestDist = dist; best = k; }
+            }
+            row |= (cl_uchar)(best << (2 * x));
+        }
+        out[4 + y] = row;
+    }
+}
+
+// Edge texels repeated for partial blocks
+static void encodeBC1(TaskPool &pool, const cl_uchar *src, cl_uint w, cl_uint h, cl_uchar *dst)
+{
+    const cl_uint bw = (w + 3) / 4;
+    const cl_uint bh = (h + 3) / 4;
+    pool.parallelFor(bh, [&](size_t by)
+    {
+        float px[16][3];
+        for (cl_uint bx = 0; bx < bw; bx++)
+        {
+            for (cl_uint i = 0; i < 16; i++)
+            {
+                const cl_uint x = std::min(bx * 4 + (i & 3), w - 1);
+                const cl_uint y = std::min((cl_uint)by * 4 + (i >> 2), h - 1);
+                for (int c = 0; c < 3; c++)
+                    px[i][c] = src[(y * w + x) * 4 + c];
+            }
+            encodeBC1Block(px, dst + (by * bw + bx) * 8);
+        }
+    });
+}
+
+size_t TexturePack::levelSize(cl_uint format, cl_uint width, cl_uint height)
+{
+    if (format == TEX_FORMAT_BC1)
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+    return (size_t)width * height * 4;
+}
+
+size_t TexturePack::uncompressedSize() const
+{
+    size_t bytes = 0;
+    for (const TexDescriptor &desc : descriptors)
+    {
+        cl_uint w = desc.width, h = desc.height;
+        for (cl_uint l = 0; l < desc.levels; l++)
+        {
+            bytes += levelSize(TEX_FORMAT_RGBA8, w, h);
+            w = std::max(w >> 1, 1u);
+            h = std::max(h >> 1, 1u);
+        }
+    }
+    return bytes;
+}
+
+void TexturePack::build(const std::vector<Texture*> &textures, const std::vector<bool> &compress)
+{
+    descriptors.clear();
+    data.clear();
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        TexDescriptor desc;
+        desc.offset = (cl_uint)bytes;
+        desc.width = textures[i]->getWidth();
+        desc.height = textures[i]->getHeight();
+        desc.levels = 1;
+        desc.format = (compress[i]) ? TEX_FORMAT_BC1 : TEX_FORMAT_RGBA8;
+
+        cl_uint w = desc.width, h = desc.height;
+        bytes += levelSize(desc.format, w, h);
+        while (w > 1 || h > 1)
+        {
+            w = std::max(w >> 1, 1u);
+            h = std::max(h >> 1, 1u);
+            bytes += levelSize(desc.format, w, h);
+            desc.levels++;
+        }
+        descriptors.push_back(desc);
+    }
+
+    // RGBA8 chain built in place, or in scratch memory and then encoded
+    TaskPool pool;
+    data.resize(bytes);
+    std::vector<cl_uchar> scratch;
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        const TexDescriptor &desc = descriptors[i];
+        const bool bc1 = (desc.format == TEX_FORMAT_BC1);
+        cl_uint w = desc.width, h = desc.height;
+
+        cl_uchar *level = data.data() + desc.offset;
+        if (bc1)
+        {
+            size_t chainBytes = 0;
+            for (cl_uint l = 0, lw = w, lh = h; l < desc.levels; l++, lw = std::max(lw >> 1, 1u), lh = std::max(lh >> 1, 1u))
+                chainBytes += levelSize(TEX_FORMAT_RGBA8, lw, lh);
+            scratch.resize(chainBytes);
+            level = scratch.data();
+        }
+        memcpy(level, textures[i]->getData(), levelSize(TEX_FORMAT_RGBA8, w, h));
+
+        cl_uchar *dst = data.data() + desc.offset;
+        for (cl_uint l = 0; l < desc.levels; l++)
+        {
+            if (bc1)
+            {
+                encodeBC1(pool, level, w, h, dst);
+                dst += levelSize(TEX_FORMAT_BC1, w, h);
+            }
+
+            cl_uchar *next = level + levelSize(TEX_FORMAT_RGBA8, w, h);
+            if (l + 1 < desc.levels)
+                downsampleLevel(pool, level, w, h, next);
+
+            level = next;
+            w = std::max(w >> 1, 1u);
+            h = std::max(h >> 1, 1u);
+        }
+    }
+}
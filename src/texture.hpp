@@ -1,15 +1,19 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "cl2.hpp"
+#include "geom.h"
 
-/* Reads a texture using DevIL */
+/* Reads a texture using DevIL, safe to construct from multiple threads */
 
 class Texture
 {
 public:
     //Texture() : width(0), height(0), data(NULL) {} // default constructor
     Texture(const std::string path, const std::string name);
+    Texture(const std::string name, const void *fileData, size_t size); // decodes encoded file in memory
+    Texture(const std::string name, cl_uint width, cl_uint height, const cl_uchar *rgba); // copies decoded data
     ~Texture() { if (data) delete[] data; }
 
     cl_uchar *getData() { return data; }
@@ -21,4 +25,23 @@ private:
     std::string name; // used to check if a specific texture is already loaded
     cl_uint width, height;
     cl_uchar *data; // eventually passed to OpenCL
+};
+
+/*
+    Device layout of all scene textures. Each texture is stored as a full
+    box filtered mip chain, levels consecutively from the descriptor offset.
+    Compressed textures use BC1 at 4 bits per texel.
+*/
+class TexturePack
+{
+public:
+    // compress[i] => BC1 for texture i
+    void build(const std::vector<Texture*> &textures, const std::vector<bool> &compress);
+    bool empty() const { return descriptors.empty(); }
+
+    static size_t levelSize(cl_uint format, cl_uint width, cl_uint height);
+    size_t uncompressedSize() const; // same mip chains as RGBA8
+
+    std::vector<TexDescriptor> descriptors;
+    std::vector<cl_uchar> data;
 };
\ No newline at end of file
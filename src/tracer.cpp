@@ -1,4 +1,6 @@
 #include "tracer.hpp"
+#include "lbvh.hpp"
+#include "scenecache.hpp"
 #include "window.hpp"
 #include "progressview.hpp"
 #include "clcontext.hpp"
@@ -6,8 +8,9 @@
 #include "settings.hpp"
 #include "utils.h"
 #include "geom.h"
+#include <thread>
 
-Tracer::Tracer(int width, int height) : useWavefront(true)
+Tracer::Tracer(int width, int height, bool headless) : useWavefront(true)
 {
     resetParams(width, height);
 
@@ -21,6 +24,14 @@ Tracer::Tracer(int width, int height) : useWavefront(true)
 
     scene.reset(new Scene());
 
+    // Headless: plain CL context, no window or GL
+    if (headless)
+    {
+        clctx = new CLContext(true);
+        clctx->setup(nullptr, params.width, params.height);
+        return;
+    }
+
     // done only once (VS debugging stops working if context is recreated)
     window = new PTWindow(width, height, this); // this = glfw user pointer
     window->setShowFPS(true);
@@ -30,7 +41,7 @@ Tracer::Tracer(int width, int height) : useWavefront(true)
     clctx = new CLContext();
     window->setCLContextPtr(clctx);
     window->setupGUI();
-    clctx->setup(window);
+    clctx->setup(window, params.width, params.height);
     setupToolbar();
 }
 
@@ -49,34 +60,57 @@ void Tracer::resetParams(int width, int height)
     params.sampleExpl = (cl_uint)true;
     params.useRoulette = (cl_uint)false;
     params.wfSeparateQueues = (cl_uint)false;
+    params.wfSortRays = (cl_uint)Settings::getInstance().getWfRaySort();
+    params.wfSortMaterials = (cl_uint)Settings::getInstance().getWfMaterialSort();
 }
 
 // Run whenever a scene is loaded
 void Tracer::init(int width, int height, std::string sceneFile)
 {
+    auto startTime = std::chrono::high_resolution_clock::now();
     resetParams(width, height);
 
-    window->showMessage("Loading scene");
+    // Previous scene might still be building its SBVH, no use uploading it
+    retirePendingHierarchy();
+
+    showMessage("Loading scene");
     selectScene(sceneFile);
     loadState();
-    window->showMessage("Creating BVH");
-    initHierarchy();
+
+    // Hierarchy might come from scene cache
+    if (!bvh)
+    {
+        showMessage("Creating BVH");
+        initHierarchy();
+
+        // Background SBVH is cached once swapped in
+        if (!pending.bvh.valid() && Settings::getInstance().getUseSceneCache())
+            SceneCache::save(sceneSource, *scene, *bvh);
+    }
 
     // Diagonal gives maximum ray length within the scene
     AABB_t bounds = bvh->getSceneBounds();
     params.worldRadius = (cl_float)(length(bounds.max - bounds.min) * 0.5f);
+    params.worldMin = bounds.min;
+    params.worldMax = bounds.max;
 
-    window->showMessage("Uploading scene data");
+    showMessage("Uploading scene data");
     clctx->uploadSceneData(bvh, scene.get());
 
     // Data uploaded to GPU => no longer needed
     delete bvh;
+    bvh = nullptr;
 
     // Setup GUI sliders with correct values
     updateGUI();
 
     // Hide status message
-    window->hideMessage();
+    if (window)
+        window->hideMessage();
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::cout << "Scene ready in " << std::chrono::duration<double, std::milli>(endTime - startTime).count()
+        << " ms (" << (sceneFromCache ? "warm" : "cold") << " start, peak RSS " << getPeakRSS() / (1 << 20) << " MB)" << std::endl;
 }
 
 // Render interactive preview
@@ -94,7 +128,10 @@ void Tracer::renderInteractive()
 // Final frame render with predefined spp
 void Tracer::renderSingle(int spp, bool denoise)
 {
-    const bool drawProgress = true;
+    const bool drawProgress = (window != nullptr);
+
+    // Final render should use the full-quality hierarchy
+    swapPendingHierarchy(true);
 
     // Currently only MK can guarantee given spp for every pixel
     if (useWavefront)
@@ -146,7 +183,8 @@ void Tracer::renderSingle(int spp, bool denoise)
         clctx->finishQueue();
 
         // Check for exit etc.
-        glfwPollEvents();
+        if (window)
+            glfwPollEvents();
 
         if (sample % 10 == 0)
             std::cout << "\rRendered: " << sample << "/" << spp << std::flush;
@@ -157,7 +195,7 @@ void Tracer::renderSingle(int spp, bool denoise)
     // Export result
     clctx->saveImage("output_" + std::to_string(sample) + ".png", params);
 #ifdef WITH_OPTIX
-    if (denoise)
+    if (denoise && window)
     {
         std::cout << "Initializing denoiser..." << std::endl;
         denoiser.denoise();
@@ -176,10 +214,19 @@ inline void printStats(CLContext *ctx)
     if (delta > 1.0)
     {
         lastPrinted = now;
+        if (ctx->useWavefront)
+            ctx->fetchWfStats();
         ctx->updateRenderPerf(delta); // updated perf can now be accessed from anywhere
         PerfNumbers perf = ctx->getRenderPerf();
-        printf("%.1fM primary, %.1fM extension, %.1fM shadow, %.1fM samples, total: %.1fMRays/s\r",
+        printf("%.1fM primary, %.1fM extension, %.1fM shadow, %.1fM samples, total: %.1fMRays/s",
             perf.primary, perf.extension, perf.shadow, perf.samples, perf.total);
+        if (perf.raySort > 0.0f)
+            printf(", ray sort: %.2f ms", perf.raySort);
+        if (perf.shading > 0.0f)
+            printf(", shading: %.2f ms", perf.shading);
+        if (perf.matSort > 0.0f)
+            printf(" (mat sort: %.2f ms)", perf.matSort);
+        printf("\r");
 
         // Reset stat counters (synchronously...)
         ctx->resetStats();
@@ -197,6 +244,10 @@ void Tracer::update()
     glfwPollEvents();
     pollKeys(deltaT);
 
+    // Replace preview hierarchy when ready
+    swapPendingHierarchy(false);
+    exportRetiredHierarchies(false);
+
     glFinish(); // locks execution to refresh rate of display (GL)
 
     // Update RenderParams in GPU memory if needed
@@ -217,13 +268,11 @@ void Tracer::update()
         iteration = 0; // accumulation reset
     }
 
-    QueueCounters cnt = {};
-    
     if (useWavefront)
     {
         // Aila-style WF
         cl_uint maxBounces = params.maxBounces;
-        int N = 1;
+        int N = Settings::getInstance().getWfSegmentsPerFrame();
         
         if (iteration == 0)
         {
@@ -237,10 +286,10 @@ void Tracer::update()
             clctx->enqueueWfResetKernel(params); // puts all in raygen queue
             clctx->enqueueWfRaygenKernel(params);
             clctx->enqueueWfExtRayKernel(params);
-            clctx->enqueueClearWfQueues();
+            clctx->enqueueWfAdvanceKernel(params, false);
         }
 
-        // Advance wavefront N segments
+        // Advance wavefront N segments, no host sync in between
         for (int i = 0; i < N; i++)
         {
             // Fill queues
@@ -249,12 +298,11 @@ void Tracer::update()
             // Operate on queues
             clctx->enqueueWfRaygenKernel(params);
             clctx->enqueueWfMaterialKernels(params);
-            clctx->enqueueGetCounters(&cnt); // the subsequent kernels don't grow the queues
             clctx->enqueueWfExtRayKernel(params);
             clctx->enqueueWfShadowRayKernel(params);
 
-            // Clear queues
-            clctx->enqueueClearWfQueues();
+            // Record stats, move pixel index, clear queues
+            clctx->enqueueWfAdvanceKernel(params, iteration > 0);
         }
 
         // Reset bounces
@@ -304,9 +352,6 @@ void Tracer::update()
     // Finish command queue
     clctx->finishQueue();
 
-    // Enqueue WF pixel index update
-    clctx->updatePixelIndex(params.width * params.height, cnt.raygenQueue);
-
     // Denoise and draw preview
 #ifdef WITH_OPTIX
     const int threshold = 10;
@@ -330,19 +375,10 @@ void Tracer::update()
     window->draw();
 #endif
     
-    if (useWavefront)
-    {
-        // Update statsAsync based on queues
-        clctx->statsAsync.extensionRays += cnt.extensionQueue;
-        clctx->statsAsync.shadowRays += cnt.shadowQueue;
-        clctx->statsAsync.primaryRays += cnt.raygenQueue;
-        clctx->statsAsync.samples += (iteration > 0) ? cnt.raygenQueue : 0;
-    }
-    else
-    {
-        // Explicit atomic render stats only on MK
+    // Explicit atomic render stats only on MK
+    // WF stats collected on device, read once per second
+    if (!useWavefront)
         clctx->fetchStatsAsync();
-    }
 
     // Calculate tracing performance without overhead
     //clctx->checkTracingPerf();
@@ -398,6 +434,8 @@ void Tracer::runBenchmark()
 
     auto logStats = [&](const char* scene, double elapsed, double deltaT)
     {
+        if (useWavefront)
+            clctx->fetchWfStats();
         RenderStats stats = clctx->getStats();
         statsLog.push_back(stats);
         clctx->resetStats();
@@ -417,14 +455,13 @@ void Tracer::runBenchmark()
     for (int i = 0; i < scenes.size(); i++) {
         std::string counter = std::to_string(i + 1) + "/" + std::to_string(scenes.size());
         init(params.width, params.height, scenes[i]);
+        swapPendingHierarchy(true);
         resetRenderer();
 
         double startT = glfwGetTime();
         double currT = startT;
         while (currT - startT < RENDER_LEN)
         {
-            QueueCounters cnt;
-
             glfwPollEvents();
             if (!window->available()) exit(0); // react to exit button
 
@@ -433,10 +470,9 @@ void Tracer::runBenchmark()
                 clctx->enqueueWfLogicKernel(params, false);
                 clctx->enqueueWfRaygenKernel(params);
                 clctx->enqueueWfMaterialKernels(params);
-                clctx->enqueueGetCounters(&cnt);
                 clctx->enqueueWfExtRayKernel(params);
                 clctx->enqueueWfShadowRayKernel(params);
-                clctx->enqueueClearWfQueues();
+                clctx->enqueueWfAdvanceKernel(params, iteration > 0);
             }
             else
             {
@@ -451,23 +487,9 @@ void Tracer::runBenchmark()
             // Synchronize
             clctx->finishQueue();
 
-            // Update statistics
-            if (useWavefront)
-            {
-                // Update statsAsync based on queues
-                clctx->statsAsync.extensionRays += cnt.extensionQueue;
-                clctx->statsAsync.shadowRays += cnt.shadowQueue;
-                clctx->statsAsync.primaryRays += cnt.raygenQueue;
-                clctx->statsAsync.samples += (iteration > 0) ? cnt.raygenQueue : 0;
-            }
-            else
-            {
-                // Fetch explicit stats from device
+            // Fetch explicit stats from device, WF stats read when logged
+            if (!useWavefront)
                 clctx->fetchStatsAsync();
-            }
-
-            // Update index of next pixel to shade
-            clctx->updatePixelIndex(params.width * params.height, cnt.raygenQueue);
 
             // Draw image + loading bar
             prg->showMessage("Running benchmark " + counter, (currT - startT) / RENDER_LEN);
@@ -532,12 +554,39 @@ void Tracer::selectScene(std::string file)
 {
     if (file == "")
     {
-        std::string selected = openFileDialog("Select a scene file", "assets/", { "*.obj", "*.ply" });
+        std::string selected = window ? openFileDialog("Select a scene file", "assets/", { "*.obj", "*.ply" }) : "";
         file = (selected != "") ? selected : "assets/egyptcat/egyptcat.obj";
     }
 
+    // Warm start: geometry, textures and hierarchy from packed cache
+    sceneSource = file;
     scene.reset(new Scene());
-    scene->loadModel(file, window->getProgressView());
+    sceneFromCache = Settings::getInstance().getUseSceneCache() && SceneCache::load(file, *scene, &bvh);
+
+    if (sceneFromCache)
+    {
+        std::cout << "Loaded scene from cache: " << file << std::endl;
+        m_mesh = &scene->getMesh();
+        params.n_tris = (cl_uint)m_mesh->size();
+
+        // Cached hierarchy built with other settings => rebuilt or loaded separately
+        unsigned int sahBins = Settings::getInstance().getSahBins();
+        SplitMode splitMode = (sahBins > 0) ? SplitMode_BinnedSah : SplitMode_Sah;
+        if (bvh && (bvh->getSplitMode() != splitMode || (sahBins > 0 && bvh->getSahBins() != sahBins)))
+        {
+            delete bvh;
+            bvh = nullptr;
+        }
+
+        if (bvh)
+            bvh->relayout(BVH::layoutFromName(Settings::getInstance().getBvhLayout()));
+    }
+    else
+    {
+        scene.reset(new Scene());
+        scene->loadModel(file, window ? window->getProgressView() : nullptr);
+    }
+
     if (envMap)
         scene->setEnvMap(envMap);
 
@@ -573,31 +622,54 @@ void Tracer::initEnvMap()
 // Check if old hierarchy can be reused
 void Tracer::initHierarchy()
 {
-	std::string hashFile = "data/hierarchies/hierarchy_" + sceneHash + ".bin";
+    // Binned builds stored separately for comparison
+    unsigned int sahBins = Settings::getInstance().getSahBins();
+    SplitMode splitMode = (sahBins > 0) ? SplitMode_BinnedSah : SplitMode_Sah;
+    std::string suffix = (sahBins > 0) ? "_b" + std::to_string(sahBins) : "";
+	std::string hashFile = "data/hierarchies/hierarchy_" + sceneHash + suffix + ".bin";
     std::ifstream input(hashFile, std::ios::in);
+    bool cached = input.good();
+    input.close();
 
-    if (input.good())
+    if (cached)
     {
         std::cout << "Reusing BVH..." << std::endl;
-        loadHierarchy(hashFile, scene->getTriangles());
+        if (loadHierarchy(hashFile, scene->getMesh()))
+            return;
+        std::cout << "Rebuilding BVH..." << std::endl;
+    }
+
+    if (Settings::getInstance().getUseLbvhPreview())
+    {
+        std::cout << "Building LBVH preview..." << std::endl;
+        constructPreviewHierarchy(scene->getMesh(), splitMode, hashFile);
     }
     else
     {
         std::cout << "Building BVH..." << std::endl;
-        constructHierarchy(scene->getTriangles(), SplitMode_Sah, window->getProgressView());
+        constructHierarchy(scene->getMesh(), splitMode, window ? window->getProgressView() : nullptr);
         saveHierarchy(hashFile);
     }
 }
 
 Tracer::~Tracer()
 {
+    // Export finished background builds, unfinished ones are abandoned
+    retirePendingHierarchy();
+    exportRetiredHierarchies(false);
     delete window;
     delete clctx;
 }
 
 bool Tracer::running()
 {
-    return window->available();
+    return !window || window->available();
+}
+
+void Tracer::showMessage(const std::string message)
+{
+    if (window)
+        window->showMessage(message);
 }
 
 // Callback for when the window size changes
@@ -738,11 +810,22 @@ void Tracer::saveImage()
     clctx->saveImage(fileName, params);
 }
 
-void Tracer::loadHierarchy(const std::string filename, std::vector<RTTriangle>& triangles)
+bool Tracer::loadHierarchy(const std::string filename, TriangleMesh &mesh)
 {
-    m_triangles = &triangles;
-    params.n_tris = (cl_uint)m_triangles->size();
-    bvh = new SBVH(m_triangles, filename);
+    m_mesh = &mesh;
+    params.n_tris = (cl_uint)m_mesh->size();
+    bvh = new SBVH(m_mesh, filename);
+
+    // Stale or corrupt cache
+    if (!bvh->isValid())
+    {
+        delete bvh;
+        bvh = nullptr;
+        return false;
+    }
+
+    bvh->relayout(BVH::layoutFromName(Settings::getInstance().getBvhLayout()));
+    return true;
 }
 
 void Tracer::saveHierarchy(const std::string filename)
@@ -750,11 +833,101 @@ void Tracer::saveHierarchy(const std::string filename)
     bvh->exportTo(filename);
 }
 
-void Tracer::constructHierarchy(std::vector<RTTriangle>& triangles, SplitMode splitMode, ProgressView *progress)
+void Tracer::constructHierarchy(TriangleMesh &mesh, SplitMode splitMode, ProgressView *progress)
+{
+    m_mesh = &mesh;
+    params.n_tris = (cl_uint)m_mesh->size();
+    bvh = new SBVH(m_mesh, splitMode, progress, Settings::getInstance().getSahBins());
+    bvh->relayout(BVH::layoutFromName(Settings::getInstance().getBvhLayout()));
+}
+
+// Fast HLBVH for rendering right away, SBVH is built in the background
+void Tracer::constructPreviewHierarchy(TriangleMesh &mesh, SplitMode splitMode, const std::string filename)
+{
+    m_mesh = &mesh;
+    params.n_tris = (cl_uint)m_mesh->size();
+    NodeLayout layout = BVH::layoutFromName(Settings::getInstance().getBvhLayout());
+    bvh = new LBVH(m_mesh, true);
+    bvh->relayout(layout);
+
+    // Scene reference keeps triangles alive even if scene is switched
+    std::shared_ptr<Scene> sceneRef = scene;
+    unsigned int sahBins = Settings::getInstance().getSahBins();
+    pending.bvhFile = filename;
+    pending.scene = scene;
+    pending.sceneSource = sceneSource;
+
+    // Detached thread instead of std::async, whose future would block exit until the build is done
+    std::promise<BVH*> promise;
+    pending.bvh = promise.get_future();
+    std::thread([sceneRef, splitMode, sahBins, layout](std::promise<BVH*> result)
+    {
+        try
+        {
+            BVH *sbvh = new SBVH(&sceneRef->getMesh(), splitMode, nullptr, sahBins);
+            sbvh->relayout(layout);
+            result.set_value(sbvh);
+        }
+        catch (...)
+        {
+            result.set_exception(std::current_exception());
+        }
+    }, std::move(promise)).detach();
+}
+
+// Save and upload background-built SBVH once available
+void Tracer::swapPendingHierarchy(bool wait)
+{
+    if (!pending.bvh.valid())
+        return;
+
+    if (!wait && pending.bvh.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    if (wait)
+        showMessage("Finishing SBVH");
+
+    BVH *sbvh = pending.bvh.get();
+    exportHierarchy(pending, sbvh);
+    clctx->uploadHierarchy(sbvh);
+    delete sbvh;
+
+    std::cout << "Swapped in SBVH" << std::endl;
+    paramsUpdatePending = true; // restart accumulation
+}
+
+// Scene is being switched: keep building in the background, only export when done
+void Tracer::retirePendingHierarchy()
+{
+    if (pending.bvh.valid())
+        retiredHierarchies.push_back(std::move(pending));
+    pending = PendingHierarchy();
+}
+
+void Tracer::exportRetiredHierarchies(bool wait)
+{
+    for (auto it = retiredHierarchies.begin(); it != retiredHierarchies.end();)
+    {
+        if (!wait && it->bvh.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            it++;
+            continue;
+        }
+
+        BVH *sbvh = it->bvh.get();
+        exportHierarchy(*it, sbvh);
+        delete sbvh;
+        it = retiredHierarchies.erase(it);
+    }
+}
+
+// Save finished SBVH to disk and scene cache
+void Tracer::exportHierarchy(PendingHierarchy &build, BVH *sbvh)
 {
-    m_triangles = &triangles;
-    params.n_tris = (cl_uint)m_triangles->size();
-    bvh = new SBVH(m_triangles, splitMode, progress);
+    sbvh->exportTo(build.bvhFile);
+    if (Settings::getInstance().getUseSceneCache())
+        SceneCache::save(build.sceneSource, *build.scene, *sbvh);
+    build.scene.reset();
 }
 
 void Tracer::initCamera()
@@ -876,7 +1049,9 @@ void Tracer::toggleLightSourceMode()
 void Tracer::toggleRenderer()
 {
     useWavefront = !useWavefront;
-    window->setRenderMethod((useWavefront) ? PTWindow::RenderMethod::WAVEFRONT : PTWindow::RenderMethod::MICROKERNEL);
+    clctx->useWavefront = useWavefront;
+    if (window)
+        window->setRenderMethod((useWavefront) ? PTWindow::RenderMethod::WAVEFRONT : PTWindow::RenderMethod::MICROKERNEL);
 }
 
 void Tracer::toggleDenoiserVisibility()
@@ -956,6 +1131,8 @@ void Tracer::handleKeypress(int key, int scancode, int action, int mods)
         matchInit(GLFW_KEY_K,           params.maxBounces = std::max(1u, params.maxBounces) - 1);
         matchInit(GLFW_KEY_M,           toggleSamplingMode());
         matchInit(GLFW_KEY_C,           params.wfSeparateQueues = 1 - params.wfSeparateQueues; printf("\nSeparate queues: %u\n", params.wfSeparateQueues));
+        matchInit(GLFW_KEY_B,           params.wfSortRays = 1 - params.wfSortRays; printf("\nRay sorting: %u\n", params.wfSortRays));
+        matchInit(GLFW_KEY_N,           params.wfSortMaterials = 1 - params.wfSortMaterials; printf("\nMaterial sorting: %u\n", params.wfSortMaterials));
 
         // Don't force init
         matchKeep(GLFW_KEY_F2,          saveState());
@@ -5,6 +5,7 @@
 #include <nanogui/nanogui.h>
 #include <string>
 #include <map>
+#include <future>
 #include "sbvh.hpp"
 #include "scene.hpp"
 #include "math/float2.hpp"
@@ -28,7 +29,7 @@ struct FloatWidget;
 class Tracer
 {
 public:
-    Tracer(int width, int height);
+    Tracer(int width, int height, bool headless = false);
     ~Tracer();
 
     // Load given scene (or open selector)
@@ -76,11 +77,24 @@ private:
     std::vector<nanogui::TextBox*> inputBoxes; // for checking focus
 
 private:
+    struct PendingHierarchy
+    {
+        std::future<BVH*> bvh; // SBVH built in background
+        std::string bvhFile;
+        std::shared_ptr<Scene> scene; // for scene cache
+        std::string sceneSource;
+    };
+
     // Create/load/export BVH
     void initHierarchy();
-    void loadHierarchy(const std::string filename, std::vector<RTTriangle> &triangles);
+    bool loadHierarchy(const std::string filename, TriangleMesh &mesh);
     void saveHierarchy(const std::string filename);
-    void constructHierarchy(std::vector<RTTriangle>& triangles, SplitMode splitMode, ProgressView* progress);
+    void constructHierarchy(TriangleMesh &mesh, SplitMode splitMode, ProgressView* progress);
+    void constructPreviewHierarchy(TriangleMesh &mesh, SplitMode splitMode, const std::string filename);
+    void swapPendingHierarchy(bool wait);
+    void retirePendingHierarchy();
+    void exportRetiredHierarchies(bool wait);
+    void exportHierarchy(PendingHierarchy &build, BVH *sbvh);
 
     void pollKeys(float deltaT); // movement keys
     void updateCamera();
@@ -102,6 +116,7 @@ private:
 	void iterateStateItems(StateIO mode);
 
     void selectScene(std::string file);
+    void showMessage(const std::string message); // no-op if headless
     void quickLoadScene(unsigned int num);
     void toggleSamplingMode();
     void toggleLightSourceMode();
@@ -115,7 +130,7 @@ private:
     float denoiserStrength = 1.0f;
 #endif
 
-    PTWindow *window;
+    PTWindow *window = nullptr; // null if headless
     CLContext *clctx;
     RenderParams params;    // copied into GPU memory
     float2 cameraRotation;  // not passed to GPU but needed for camera basis vectors
@@ -128,8 +143,12 @@ private:
     std::shared_ptr<Scene> scene;
     std::shared_ptr<EnvironmentMap> envMap;
     BVH *bvh = nullptr;
-    std::vector<RTTriangle>* m_triangles;
+    PendingHierarchy pending;
+    std::vector<PendingHierarchy> retiredHierarchies; // builds of previous scenes, exported but never uploaded
+    TriangleMesh* m_mesh;
     std::string sceneHash;
+    std::string sceneSource; // model file of current scene
+    bool sceneFromCache = false;
     cl_uint iteration;
     int frontBuffer = 0;
     bool hasEnvMap = false;
@@ -139,17 +139,33 @@ void Tracer::addRendererSettings(nanogui::Widget *parent)
         if (idx == 0)
         {
             useWavefront = true;
+            clctx->useWavefront = true;
             window->setRenderMethod(PTWindow::RenderMethod::WAVEFRONT);
         }
         if (idx == 1)
         {
             useWavefront = false;
+            clctx->useWavefront = false;
             window->setRenderMethod(PTWindow::RenderMethod::MICROKERNEL);
         }
             
         paramsUpdatePending = true;
     });
     integratorBox->setSelectedIndex((useWavefront) ? 0 : 1);
+    auto raySortBox = new CheckBox(rendererPopup, "Sort extension rays (W-PT)");
+    uiMapping["RAY_SORT_TOGGLE"] = raySortBox;
+    raySortBox->setChecked(params.wfSortRays);
+    raySortBox->setCallback([&](bool value) {
+        params.wfSortRays = value;
+        paramsUpdatePending = true;
+    });
+    auto matSortBox = new CheckBox(rendererPopup, "Sort material queues (W-PT)");
+    uiMapping["MAT_SORT_TOGGLE"] = matSortBox;
+    matSortBox->setChecked(params.wfSortMaterials);
+    matSortBox->setCallback([&](bool value) {
+        params.wfSortMaterials = value;
+        paramsUpdatePending = true;
+    });
 
     // Sampler
     new Label(rendererPopup, "Sampler settings", "sans-bold");
@@ -457,6 +473,9 @@ void Tracer::addStateSettings(Widget *parent)
 // Update GUI sliders/boxes based on new state
 void Tracer::updateGUI()
 {
+    if (!window)
+        return;
+
     auto fovBox = static_cast<FloatBox<cl_float>*>(uiMapping["FOV_BOX"]);
     auto fovSlider = static_cast<Slider*>(uiMapping["FOV_SLIDER"]);
     fovBox->setValue(params.camera.fov);
@@ -482,11 +501,15 @@ void Tracer::updateGUI()
     auto implSampleToggle = static_cast<CheckBox*>(uiMapping["IMPL_SAMPL_TOGGLE"]);
     auto areaLightToggle = static_cast<CheckBox*>(uiMapping["AREA_LIGHT_TOGGLE"]);
     auto rrToggle = static_cast<CheckBox*>(uiMapping["RR_TOGGLE"]);
+    auto raySortToggle = static_cast<CheckBox*>(uiMapping["RAY_SORT_TOGGLE"]);
+    auto matSortToggle = static_cast<CheckBox*>(uiMapping["MAT_SORT_TOGGLE"]);
     envMapToggle->setChecked(params.useEnvMap);
     explSampleToggle->setChecked(params.sampleExpl);
     implSampleToggle->setChecked(params.sampleImpl);
     areaLightToggle->setChecked(params.useAreaLight);
     rrToggle->setChecked(params.useRoulette);
+    raySortToggle->setChecked(params.wfSortRays);
+    matSortToggle->setChecked(params.wfSortMaterials);
 
 #ifdef WITH_OPTIX    
     auto denoiseToggle = static_cast<CheckBox*>(uiMapping["DENOISE_TOGGLE"]);
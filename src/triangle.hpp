@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include "math/float3.hpp"
 
 using FireRays::float3;
@@ -7,7 +8,7 @@ using FireRays::float3;
 struct VertexPNT
 {
     float3 p; // position
-    float3 n; // normal
+    float3 n; // normal, zero for flat shaded triangles
     float3 t; // texture coordinates
     // float3 c; // color
 
@@ -15,35 +16,53 @@ struct VertexPNT
     VertexPNT(const float3& pp, const float3& nn, const float3& tt) : p(pp), n(nn), t(tt) {}
 };
 
+// Indexed triangle, same layout as Triangle in geom.h
 struct RTTriangle {
 
-    VertexPNT v0, v1, v2;
+    unsigned int v[3]; // indices into vertex buffer
     int matId = 0; // default material, defined in scene constructor
 
-	// TODO: Fix alignment issues!
-    RTTriangle(const VertexPNT &v0i, const VertexPNT &v1i, const VertexPNT &v2i) {
-        v0 = v0i;
-        v1 = v1i;
-        v2 = v2i;
+    RTTriangle(void) {}
+
+    RTTriangle(unsigned int i0, unsigned int i1, unsigned int i2) {
+        v[0] = i0;
+        v[1] = i1;
+        v[2] = i2;
+    }
+};
+
+// Deduplicated vertices shared by indexed triangles
+struct TriangleMesh {
+
+    std::vector<VertexPNT> vertices;
+    std::vector<RTTriangle> triangles;
+
+    inline size_t size() const {
+        return triangles.size();
+    }
+
+    inline const float3& pos(size_t tri, int i) const {
+        return vertices[triangles[tri].v[i]].p;
     }
 
-    inline float3 min() const {
-        return vmin(v0.p, vmin(v1.p, v2.p));
+    inline float3 min(size_t tri) const {
+        return vmin(pos(tri, 0), vmin(pos(tri, 1), pos(tri, 2)));
     }
 
-    inline float3 max() const {
-        return vmax(v0.p, vmax(v1.p, v2.p));
+    inline float3 max(size_t tri) const {
+        return vmax(pos(tri, 0), vmax(pos(tri, 1), pos(tri, 2)));
     }
 
-    inline float3 centroid() const {
-        return (v0.p + v1.p + v2.p) * (1.0f / 3.0f);
+    inline float3 centroid(size_t tri) const {
+        return (pos(tri, 0) + pos(tri, 1) + pos(tri, 2)) * (1.0f / 3.0f);
     }
 
-    inline float area() const {
-        return length(cross(v1.p - v0.p, v2.p - v0.p)) * .5f;
+    inline float area(size_t tri) const {
+        return length(cross(pos(tri, 1) - pos(tri, 0), pos(tri, 2) - pos(tri, 0))) * .5f;
     }
 
-    float3 normal() const {
-        return normalize(cross(v1.p - v0.p, v2.p - v0.p));
+    inline void clear() {
+        std::vector<VertexPNT>().swap(vertices);
+        std::vector<RTTriangle>().swap(triangles);
     }
 };
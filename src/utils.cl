@@ -111,56 +111,123 @@ inline float3 cosSampleHemisphere(float3 n, uint *seed, float *p)
 	return dir;
 }
 
-inline int2 getTexelCoords(float2 uv, uint width, uint height)
+inline uint textureLevelSize(uint format, int width, int height)
 {
-    uv.x *= width;
-    uv.y *= height;
-    int tx = ((int)(floor(uv.x)) % width + width) % width;
-    int ty = ((int)(floor(uv.y)) % height + height) % height;
+    return (format == TEX_FORMAT_BC1) ? ((width + 3) / 4) * ((height + 3) / 4) * 8 : width * height * 4;
+}
 
-    return clamp((int2)(tx + uv.x - floor(uv.x), ty + uv.y - floor(uv.y)), (int2)(0), (int2)(width - 1, height - 1));
-    //return Vec2f(tx + uv.x - floor(uv.x), ty + uv.y - floor(uv.y)).clamp(Vec2f(0), Vec2f(size)-Vec2f(1));
+inline float3 unpackRGB565(uint c)
+{
+    return (float3)((c >> 11) & 31, (c >> 5) & 63, c & 31) * (float3)(255.0f / 31.0f, 255.0f / 63.0f, 255.0f / 31.0f);
 }
 
-inline float3 readTexture(float2 uvTex, TexDescriptor tex, global uchar *data)
+// Single texel in [0,255]
+inline float3 readTexel(global uchar *level, uint format, int x, int y, int width)
 {
-    int2 coords = getTexelCoords(uvTex, tex.width, tex.height);
-    global uchar *pix = data + tex.offset + coords.x * 4 + coords.y * tex.width * 4;
-    float3 c = (float3)(*(pix + 0), *(pix + 1), *(pix + 2));
-	c /= 255.0f;
-	
-    return c;
+    if (format == TEX_FORMAT_RGBA8)
+    {
+        global uchar *pix = level + (x + y * width) * 4;
+        return (float3)(pix[0], pix[1], pix[2]);
+    }
+
+    // BC1 block: endpoints c0, c1, then one byte of 2-bit indices per row
+    global uchar *block = level + ((x >> 2) + (y >> 2) * ((width + 3) >> 2)) * 8;
+    const uint c0 = block[0] | (block[1] << 8);
+    const uint c1 = block[2] | (block[3] << 8);
+    const uint idx = (block[4 + (y & 3)] >> ((x & 3) * 2)) & 3;
+    const float3 e0 = unpackRGB565(c0);
+    const float3 e1 = unpackRGB565(c1);
+
+    if (idx == 0) return e0;
+    if (idx == 1) return e1;
+    if (c0 > c1) return (idx == 2) ? (2.0f * e0 + e1) / 3.0f : (e0 + 2.0f * e1) / 3.0f;
+    return (idx == 2) ? 0.5f * (e0 + e1) : (float3)(0.0f);
+}
+
+// Bilinear fetch from a single mip level, wrapping
+inline float3 readTextureLevel(float2 uvTex, global uchar *level, uint format, int width, int height)
+{
+    float2 st = (float2)(uvTex.x * width, uvTex.y * height) - 0.5f;
+    float2 f = st - floor(st);
+    int x0 = ((int)floor(st.x) % width + width) % width;
+    int y0 = ((int)floor(st.y) % height + height) % height;
+    int x1 = (x0 + 1) % width;
+    int y1 = (y0 + 1) % height;
+
+    float3 c0 = mix(readTexel(level, format, x0, y0, width), readTexel(level, format, x1, y0, width), f.x);
+    float3 c1 = mix(readTexel(level, format, x0, y1, width), readTexel(level, format, x1, y1, width), f.x);
+
+    return mix(c0, c1, f.y);
+}
+
+// Trilinear fetch, level chosen from ray cone footprint (Akenine-Moller et al. 2019)
+inline float3 readTexture(float2 uvTex, float footprint, TexDescriptor tex, global uchar *data)
+{
+    float lod = log2(max(footprint * sqrt((float)tex.width * tex.height), 1e-8f));
+    lod = clamp(lod, 0.0f, (float)(tex.levels - 1));
+    const uint l0 = (uint)lod;
+
+    // Find first level
+    global uchar *level = data + tex.offset;
+    int width = tex.width;
+    int height = tex.height;
+    for (uint l = 0; l < l0; l++)
+    {
+        level += textureLevelSize(tex.format, width, height);
+        width = max(width >> 1, 1);
+        height = max(height >> 1, 1);
+    }
+
+    float3 c = readTextureLevel(uvTex, level, tex.format, width, height);
+    const float f = lod - l0;
+    if (f > 0.0f)
+    {
+        level += textureLevelSize(tex.format, width, height);
+        float3 c1 = readTextureLevel(uvTex, level, tex.format, max(width >> 1, 1), max(height >> 1, 1));
+        c = mix(c, c1, f);
+    }
+
+    return c / 255.0f;
 }
 
 // Performs gamma correction
-inline float3 matGetAlbedo(float3 fallback, float2 uv, int idx, global TexDescriptor *textures, global uchar *texData)
+inline float3 matGetAlbedo(float3 fallback, float2 uv, float footprint, int idx, global TexDescriptor *textures, global uchar *texData)
 {
-	float3 val = (idx != -1) ? readTexture(uv, textures[idx], texData) : fallback;
+	float3 val = (idx != -1) ? readTexture(uv, footprint, textures[idx], texData) : fallback;
 	val.xyz = pow(val.xyz, 2.2f);
     return val;
 }
 
-inline float3 matGetFloat3(float3 fallback, float2 uv, int idx, global TexDescriptor *textures, global uchar *texData)
+inline float3 matGetFloat3(float3 fallback, float2 uv, float footprint, int idx, global TexDescriptor *textures, global uchar *texData)
+{
+	return (idx != -1) ? readTexture(uv, footprint, textures[idx], texData) : fallback;
+}
+
+// Ray cone spread of a single pixel, curvature at hits is ignored
+inline float pixelSpreadAngle(global RenderParams *params)
 {
-	return (idx != -1) ? readTexture(uv, textures[idx], texData) : fallback;
+    return 2.0f * tan(toRad(0.5f * params->camera.fov)) / params->height;
 }
 
 // Construct tangent space, convert normal into world space
-inline float3 tangentSpaceNormal(Hit hit, global Triangle *tris, const Material mat, global TexDescriptor *textures, global uchar *texData)
+inline float3 tangentSpaceNormal(Hit hit, global Triangle *tris, global Vertex *verts, const Material mat, global TexDescriptor *textures, global uchar *texData)
 {
     if (mat.map_N == -1)
         return hit.N;
     
     const float3 defaultVal = (float3)(0.5f, 0.5f, 1.0f); // flat surface
-    float3 texNormal = matGetFloat3(defaultVal, hit.uvTex, mat.map_N, textures, texData);
+    float3 texNormal = matGetFloat3(defaultVal, hit.uvTex, hit.uvFootprint, mat.map_N, textures, texData);
     texNormal = 2.0f * texNormal - (float3)(1.0f, 1.0f, 1.0f);
     
-    Triangle t = tris[hit.i];
+    const Triangle tri = tris[hit.i];
+    const Vertex v0 = verts[tri.v[0]];
+    const Vertex v1 = verts[tri.v[1]];
+    const Vertex v2 = verts[tri.v[2]];
     
-    float3 e1 = t.v1.p - t.v0.p;
-    float3 e2 = t.v2.p - t.v0.p;
-    float3 t1 = t.v1.t - t.v0.t;
-    float3 t2 = t.v2.t - t.v0.t;
+    float3 e1 = v1.p - v0.p;
+    float3 e2 = v2.p - v0.p;
+    float3 t1 = v1.t - v0.t;
+    float3 t2 = v2.t - v0.t;
 
     // Detect invalid normal map
     float det = (t1.x * t2.y - t1.y * t2.x);
@@ -183,13 +250,13 @@ inline float3 tangentSpaceNormal(Hit hit, global Triangle *tris, const Material
 
 // Read all material parameters at once
 // Can alternatlvely be read separately in bsdf sampling/eval code
-inline void getMaterialParameters(Hit hit, global Triangle *tris, global Material *materials, global uchar *texData, global TexDescriptor *textures, float3 *Kd, float3 *N, float3 *Ks, float *refr)
+inline void getMaterialParameters(Hit hit, global Triangle *tris, global Vertex *verts, global Material *materials, global uchar *texData, global TexDescriptor *textures, float3 *Kd, float3 *N, float3 *Ks, float *refr)
 {
     const Material mat = materials[hit.matId];
 
-	*Kd = matGetAlbedo(mat.Kd, hit.uvTex, mat.map_Kd, textures, texData);
-	*Ks = matGetFloat3(mat.Ks, hit.uvTex, mat.map_Ks, textures, texData);
-    *N = tangentSpaceNormal(hit, tris, mat, textures, texData);
+	*Kd = matGetAlbedo(mat.Kd, hit.uvTex, hit.uvFootprint, mat.map_Kd, textures, texData);
+	*Ks = matGetFloat3(mat.Ks, hit.uvTex, hit.uvFootprint, mat.map_Ks, textures, texData);
+    *N = tangentSpaceNormal(hit, tris, verts, mat, textures, texData);
     *refr = mat.Ni;
 }
 
@@ -204,6 +271,7 @@ inline void writeHitSoA(Hit hit, global GPUTaskState *tasks, const size_t gid, c
 	WriteFloat3(P, tasks, hit.P);
 	WriteFloat3(N, tasks, hit.N);
 	WriteFloat2(uvTex, tasks, hit.uvTex);
+	WriteF32(uvFootprint, tasks, hit.uvFootprint);
 	WriteF32(t, tasks, hit.t);
 	WriteI32(i, tasks, hit.i);
 	WriteI32(areaLightHit, tasks, hit.areaLightHit);
@@ -216,6 +284,7 @@ inline Hit readHitSoA(global GPUTaskState *tasks, const size_t gid, const uint n
 	hit.P = ReadFloat3(P, tasks);
 	hit.N = ReadFloat3(N, tasks);
 	hit.uvTex = ReadFloat2(uvTex, tasks);
+	hit.uvFootprint = ReadF32(uvFootprint, tasks);
 	hit.t = ReadF32(t, tasks);
 	hit.i = ReadI32(i, tasks);
 	hit.areaLightHit = ReadI32(areaLightHit, tasks);
@@ -357,4 +426,113 @@ inline void atomicIncCounter(global uint* ctr)
 #endif
 }
 
-#endif
\ No newline at end of file
+// Inclusive Hillis-Steele scan over the work-group
+// Every work-item of the group must call this, scratch holds get_local_size(0) elements.
+inline uint groupScan(const uint value, local uint* scratch)
+{
+    const uint lid = get_local_id(0);
+    const uint size = get_local_size(0);
+
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint offset = 1; offset < size; offset <<= 1)
+    {
+        uint sum = scratch[lid];
+        if (lid >= offset)
+            sum += scratch[lid - offset];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        scratch[lid] = sum;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    return scratch[lid];
+}
+
+// Bin counts => exclusive bin start offsets, in place.
+// Called by a single work-group, numBins must be a multiple of the group size.
+inline void scanBins(global uint* bins, const uint numBins, local uint* scratch)
+{
+    const uint perItem = numBins / get_local_size(0);
+    const uint first = get_local_id(0) * perItem;
+
+    uint sum = 0;
+    for (uint i = 0; i < perItem; i++)
+        sum += bins[first + i];
+
+    // Exclusive prefix of own range
+    uint offset = groupScan(sum, scratch) - sum;
+    for (uint i = 0; i < perItem; i++)
+    {
+        const uint count = bins[first + i];
+        bins[first + i] = offset;
+        offset += count;
+    }
+}
+
+// Queue append with one global atomic per work-group: exclusive prefix sum
+// of flags in local memory. Every work-item of the group must call this once,
+// scratch holds get_local_size(0) + 1 elements.
+inline uint groupAppend(const uint flag, global uint* ctr, local uint* scratch)
+{
+    const uint lid = get_local_id(0);
+    const uint size = get_local_size(0);
+    const uint inclusive = groupScan(flag, scratch);
+
+    // Last work-item has the group total
+    if (lid == size - 1)
+        scratch[size] = (inclusive > 0) ? atomic_add(ctr, inclusive) : 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    return scratch[size] + inclusive - flag;
+}
+
+// Same for eight adjacent counters (e.g. QueueCounters) in a single scan
+inline uint8 groupAppend8(const uint8 flags, global uint* ctrs, local uint8* scratch)
+{
+    const uint lid = get_local_id(0);
+    const uint size = get_local_size(0);
+
+    scratch[lid] = flags;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint offset = 1; offset < size; offset <<= 1)
+    {
+        uint8 sum = scratch[lid];
+        if (lid >= offset)
+            sum += scratch[lid - offset];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        scratch[lid] = sum;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    const uint8 inclusive = scratch[lid];
+
+    if (lid == size - 1)
+    {
+        uint total[8], base[8];
+        vstore8(inclusive, 0, total);
+        for (uint i = 0; i < 8; i++)
+            base[i] = (total[i] > 0) ? atomic_add(ctrs + i, total[i]) : 0;
+        scratch[size] = vload8(0, base);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    return scratch[size] + inclusive - flags;
+}
+
+#ifdef NVIDIA
+// Warp-aggregated version, one atomic per counter per warp
+inline uint8 warpAppend8(const uint8 flags, global uint* ctrs)
+{
+    const uint mask = activemask();
+    uint f[8], idx[8];
+    vstore8(flags, 0, f);
+    for (uint i = 0; i < 8; i++)
+    {
+        idx[i] = 0;
+        const uint ctrMask = ballot_sync(f[i], mask);
+        if (f[i])
+            idx[i] = atomicAggInc(ctrs + i, ctrMask);
+    }
+    return vload8(0, idx);
+}
+#endif
+
+#endif
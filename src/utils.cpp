@@ -4,6 +4,20 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 std::string getAbsolutePath(std::string filename)
 {
@@ -144,4 +158,195 @@ std::string getCLErrorString(int code)
 
     const int ind = -code;
     return (ind >= 0 && ind < SIZE) ? errors[ind] : "unknown";
-}
\ No newline at end of file
+}
+
+size_t getPeakRSS()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS info;
+    GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info));
+    return (size_t)info.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss; // bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+#define IS_DIGIT(c) ((unsigned)((c) - '0') < 10u)
+
+// Exact for up to 15 significant digits and |exp| <= 22, falls back to strtod otherwise
+float stringToFloat(const char *s, const char *e)
+{
+    static const double pow10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *c = s;
+    bool negative = false;
+    if (c < e && (*c == '+' || *c == '-'))
+        negative = (*c++ == '-');
+
+    uint64_t mantissa = 0;
+    int digits = 0, exp10 = 0;
+    bool any = false;
+    for (; c < e && IS_DIGIT(*c); c++, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*c - '0');
+            digits += (mantissa > 0);
+        }
+        else
+            exp10++;
+    }
+
+    if (c < e && *c == '.')
+    {
+        for (c++; c < e && IS_DIGIT(*c); c++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*c - '0');
+                digits += (mantissa > 0);
+                exp10--;
+            }
+        }
+    }
+
+    if (!any) return 0.0f;
+
+    if (c < e && (*c == 'e' || *c == 'E'))
+    {
+        const char *expStart = c++;
+        bool expNegative = false;
+        if (c < e && (*c == '+' || *c == '-'))
+            expNegative = (*c++ == '-');
+
+        if (c < e && IS_DIGIT(*c))
+        {
+            int exponent = 0;
+            for (; c < e && IS_DIGIT(*c); c++)
+                exponent = std::min(exponent * 10 + (*c - '0'), 100000);
+            exp10 += (expNegative) ? -exponent : exponent;
+        }
+        else
+            c = expStart; // ignore malformed exponent
+    }
+
+    double value;
+    if (mantissa < (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        value = (double)mantissa;
+        value = (exp10 < 0) ? value / pow10[-exp10] : value * pow10[exp10];
+        if (negative) value = -value;
+    }
+    else
+    {
+        std::string str(s, c);
+        value = strtod(str.c_str(), nullptr);
+    }
+
+    return (float)value;
+}
+
+cl_half floatToHalf(float value)
+{
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t ax = x & 0x7fffffff;
+
+    if (ax > 0x7f800000) return (cl_half)(sign | 0x7e00); // NaN
+    if (ax >= 0x477ff000) return (cl_half)(sign | 0x7bff); // rounds to >= 65520, including inf
+
+    uint32_t h, rem, halfway;
+    if (ax < 0x38800000)
+    {
+        // Subnormal half, 2^-24 units
+        if (ax < 0x33000000) return (cl_half)sign;
+        const uint32_t m = (ax & 0x007fffff) | 0x00800000;
+        const uint32_t shift = 126 - (ax >> 23);
+        h = m >> shift;
+        rem = m & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        // Rebias exponent, drop 13 mantissa bits
+        h = (ax >> 13) - ((127 - 15) << 10);
+        rem = ax & 0x1fff;
+        halfway = 0x1000;
+    }
+
+    if (rem > halfway || (rem == halfway && (h & 1))) h++;
+    return (cl_half)(sign | h);
+}
+
+bool getFileStats(const std::string filename, uint64_t &size, uint64_t &mtime)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+
+    size = (uint64_t)st.st_size;
+    mtime = (uint64_t)st.st_mtime;
+    return true;
+}
+
+MappedFile::MappedFile(const std::string filename)
+{
+#ifdef _WIN32
+    fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        fileHandle = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+        return;
+
+    mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapHandle)
+        return;
+
+    ptr = MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+    length = (ptr) ? (size_t)fileSize.QuadPart : 0;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            ptr = p;
+            length = (size_t)st.st_size;
+        }
+    }
+
+    close(fd); // mapping stays valid
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mapHandle) CloseHandle(mapHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+#else
+    if (ptr) munmap(ptr, length);
+#endif
+}
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <stdlib.h>
+#include <cstdint>
 #include <glad/glad.h>
 #include <vector>
 #include "cl2.hpp"
@@ -73,5 +74,40 @@ std::string saveFileDialog(const std::string message, const std::string defaultP
 size_t computeHash(const void* buffer, size_t length);
 size_t fileHash(const std::string filename);
 
+// Decimal string to float, 0 if no digits. Stops at first invalid character.
+float stringToFloat(const char *begin, const char *end);
+
+// IEEE half with round to nearest even, overflow clamped to the largest finite value
+cl_half floatToHalf(float value);
+
+// Size and modification time of file, false if it doesn't exist
+bool getFileStats(const std::string filename, uint64_t &size, uint64_t &mtime);
+
+// Peak resident set size of process, in bytes
+size_t getPeakRSS();
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile(const std::string filename);
+    ~MappedFile();
+
+    bool valid() const { return ptr != nullptr; }
+    const char* data() const { return static_cast<const char*>(ptr); }
+    size_t size() const { return length; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void *ptr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mapHandle = nullptr;
+#endif
+};
+
 // Get define string used to compile only relevant material eval logic
 std::string getBxdfDefines(unsigned int typeBits);
\ No newline at end of file
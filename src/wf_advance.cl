@@ -0,0 +1,35 @@
+#include "geom.h"
+
+// Ends a wavefront iteration without host involvement:
+// records queue lengths, moves pixel pointer past new paths, clears queues.
+// Enqueued with a single work-item.
+kernel void advance(
+    global QueueCounters* queueLens,
+    global uint* currPixelIdx,
+    global RenderStats* statsRing,
+    global uint* statsHead,
+    global RenderParams* params,
+    uint countSamples
+)
+{
+    const QueueCounters cnt = *queueLens;
+
+    // Raygen queue used up pixels [currPixelIdx, currPixelIdx + raygenQueue)
+    uint numPixels = params->width * params->height;
+    *currPixelIdx = (*currPixelIdx + cnt.raygenQueue) % numPixels;
+
+    // Read by host about once per second
+    RenderStats stats;
+    stats.primaryRays = cnt.raygenQueue;
+    stats.extensionRays = cnt.extensionQueue;
+    stats.shadowRays = cnt.shadowQueue;
+    stats.samples = (countSamples) ? cnt.raygenQueue : 0;
+
+    uint head = *statsHead;
+    statsRing[head % WF_STATS_RING_SIZE] = stats;
+    *statsHead = head + 1;
+
+    // Empty queues for next iteration
+    const QueueCounters empty = { 0 };
+    *queueLens = empty;
+}
@@ -7,6 +7,8 @@ kernel void traceExtension(
     global QueueCounters* queueLens,
     global uint* extensionQueue,
     global Triangle* tris,
+    global Vertex* verts,
+    global LeafTriangle* leafTris,
     global GPUNode* nodes,
     global uint* indices,
     global RenderParams* params,
@@ -25,8 +27,16 @@ kernel void traceExtension(
 
     // Trace ray
     Hit hit = EMPTY_HIT(FLT_MAX);
-    bvh_intersect(&r, &hit, tris, nodes, indices);
+    bvh_intersect(&r, &hit, tris, verts, leafTris, nodes, indices);
     if (params->sampleImpl && params->useAreaLight) intersectLight(&hit, &r, params);
+
+    // Ray cone width at hit, texture footprint scaled accordingly
+    if (hit.i > -1)
+    {
+        const float coneWidth = ReadF32(coneWidth, tasks) + pixelSpreadAngle(params) * hit.t;
+        WriteF32(coneWidth, tasks, coneWidth);
+        hit.uvFootprint *= coneWidth;
+    }
     
     global uint *len = &ReadU32(pathLen, tasks);
     *len += 1;
@@ -3,12 +3,10 @@
 #include "utils.cl"
 #include "env_map.cl"
 
-void addToMaterialQueueLocalAtomics(const uint, const Material, global QueueCounters*,
-    global uint*, global uint*, global uint*, global uint*, global uint*);
-void addToMaterialQueueNaive(const uint, const Material, global QueueCounters*,
-    global uint*, global uint*, global uint*, global uint*, global uint*);
-void addToMaterialQueueWarpNVIDIA(const uint, const Material, global QueueCounters*,
-    global uint*, global uint*, global uint*, global uint*, global uint*);
+uint8 processPath(const uint, global GPUTaskState*, global float*, global float*, global float*,
+    global Triangle*, global Vertex*, read_only image2d_t, global float*, global int*, global float*,
+    global Material*, global uchar*, global TexDescriptor*, global RenderParams*, const uint);
+uint8 materialQueueFlags(const Material, const uint);
 
 // Logic kernel
 kernel void logic(
@@ -26,6 +24,7 @@ kernel void logic(
     global uint *ggxRefrQueue,
     global uint *deltaQueue,
     global Triangle *tris,
+    global Vertex *verts,
     global GPUNode *nodes,
     global uint *indices,
     read_only image2d_t envMap,
@@ -41,11 +40,52 @@ kernel void logic(
 )
 {
     uint gid = get_global_id(0);
-	uint lid = get_local_id(0);
     uint maxId = firstIteration ? min(params->width * params->height, numTasks) : numTasks;
 
-	if (gid >= maxId)
-		return;
+    // Queues the path goes to, in QueueCounters order
+    uint8 queues = (uint8)(0);
+    if (gid < maxId)
+        queues = processPath(gid, tasks, pixels, denoiserNormal, denoiserAlbedo, tris, verts, envMap,
+            probTable, aliasTable, pdfTable, materials, texData, textures, params, numTasks);
+
+    // Reserve queue slots, reached by all work-items
+#ifdef NVIDIA
+    const uint8 idx = warpAppend8(queues, (global uint*)queueLens);
+#else
+    local uint8 queueScratch[WF_COMPACT_GROUP_SIZE + 1];
+    const uint8 idx = groupAppend8(queues, (global uint*)queueLens, queueScratch);
+#endif
+
+    if (queues.s0) raygenQueue[idx.s0] = gid;
+    if (queues.s2) shadowQueue[idx.s2] = gid;
+    if (queues.s3) diffuseQueue[idx.s3] = gid;
+    if (queues.s4) glossyQueue[idx.s4] = gid;
+    if (queues.s5) ggxReflQueue[idx.s5] = gid;
+    if (queues.s6) ggxRefrQueue[idx.s6] = gid;
+    if (queues.s7) deltaQueue[idx.s7] = gid;
+}
+
+// Shading logic of single path
+inline uint8 processPath(
+    const uint gid,
+    global GPUTaskState *tasks,
+    global float *pixels,
+    global float *denoiserNormal,
+    global float *denoiserAlbedo,
+    global Triangle *tris,
+    global Vertex *verts,
+    read_only image2d_t envMap,
+    global float *probTable,
+    global int *aliasTable,
+    global float *pdfTable,
+    global Material *materials,
+    global uchar *texData,
+    global TexDescriptor *textures,
+    global RenderParams *params,
+    const uint numTasks
+)
+{
+    uint8 queues = (uint8)(0);
 
     uint seed = ReadU32(seed, tasks);
     uint len = ReadU32(pathLen, tasks);
@@ -94,7 +134,7 @@ kernel void logic(
         if (params->sampleImpl && params->sampleExpl && params->useEnvMap && len > 1 && !lastSpecular)
         {
             const float lightPickProb = ReadF32(lastLightPickProb, tasks);
-            int2 dims = get_image_dim(envMap);
+            int2 dims = envMapTableDims(envMap);
             float directPdfW = envMapPdf(dims.x, dims.y, pdfTable, rayDir);
             float actualPdfW = ReadF32(lastPdfW, tasks);
             weight = (actualPdfW * lightPickProb) / (actualPdfW * lightPickProb + directPdfW);
@@ -156,10 +196,6 @@ kernel void logic(
     }
 
     // Image accumulation
-    uint terminateMask = 0;
-#ifdef NVIDIA
-    terminateMask = ballot_sync(terminate, activemask());
-#endif
     if (terminate)
     {
         if (len > 0)
@@ -169,16 +205,16 @@ kernel void logic(
             add_float4(pixels + pixIdx * 4, color);
         }
 
-        uint idx = atomicIncMasked(&queueLens->raygenQueue, terminateMask);
-        raygenQueue[idx] = gid;
+        // Regenerate
+        queues.s0 = 1;
 
         WriteU32(seed, tasks, seed);
-        return;
+        return queues;
     }
 
     // Read hit material (to check if singular etc.)
     Material mat = materials[hit.matId];
-    hit.N = tangentSpaceNormal(hit, tris, mat, textures, texData);
+    hit.N = tangentSpaceNormal(hit, tris, verts, mat, textures, texData);
     bool backface = dot(hit.N, r.dir) > 0.0f;
     if (backface) hit.N *= -1.0f;
     float3 orig = hit.P - 1e-3f * r.dir;
@@ -203,7 +239,7 @@ kernel void logic(
     {
         *diffuseHit = 1;
         uint pixIdx = ReadU32(pixelIndex, tasks);
-        float3 albedo = matGetFloat3(mat.Kd, hit.uvTex, mat.map_Kd, textures, texData); // not gamma-corrected
+        float3 albedo = matGetFloat3(mat.Kd, hit.uvTex, hit.uvFootprint, mat.map_Kd, textures, texData); // not gamma-corrected
         add_float4(denoiserAlbedo + pixIdx * 4, (float4)(albedo, 1.0f));
     }
 #endif
@@ -229,10 +265,10 @@ kernel void logic(
 
             float3 L;
             float directPdfW = 0.0f;
-            int2 envMapDims = get_image_dim(envMap);
+            int2 envMapDims = envMapTableDims(envMap);
             const int width = envMapDims.x, height = envMapDims.y;
             EnvMapContext ctx = { width, height, pdfTable, probTable, aliasTable };
-            sampleEnvMapAlias(rand(&seed), &L, &directPdfW, ctx);
+            sampleEnvMapAlias(rand(&seed), (float2)(rand(&seed), rand(&seed)), &L, &directPdfW, ctx);
 
             // Shadow ray
             float lenL = 2.0f * params->worldRadius;
@@ -251,8 +287,7 @@ kernel void logic(
             WriteFloat3(lastEmission, tasks, envMapLi);
 
             // Add to shadow queue
-            uint idx = atomic_inc(&queueLens->shadowQueue);
-            shadowQueue[idx] = gid;
+            queues.s2 = 1;
         }
 #endif
 
@@ -290,8 +325,7 @@ kernel void logic(
                 WriteF32(lastLightPickProb, tasks, lightPickProb);
                 WriteFloat3(lastEmission, tasks, emission);
 
-                uint idx = atomic_inc(&queueLens->shadowQueue);
-                shadowQueue[idx] = gid;
+                queues.s2 = 1;
             }
             else // backface hit, don't even bother
             {
@@ -304,216 +338,41 @@ kernel void logic(
 
     WriteU32(seed, tasks, seed);
 
-#ifdef NVIDIA
-    addToMaterialQueueLocalAtomics(gid, mat, queueLens, diffuseQueue, glossyQueue, ggxReflQueue, ggxRefrQueue, deltaQueue);
-    //addToMaterialQueueWarpNVIDIA(gid, mat, queueLens, diffuseQueue, glossyQueue, ggxReflQueue, ggxRefrQueue, deltaQueue);
-#else
-    addToMaterialQueueNaive(gid, mat, queueLens, diffuseQueue, glossyQueue, ggxReflQueue, ggxRefrQueue, deltaQueue);
-#endif
-    
+    return queues | materialQueueFlags(mat, gid);
 }
 
-
-/*  Two different methods for enqueuing paths based on their material
-    Would ideally use warp/wavefront voting functions, but those don't work on OCL 1.2 */
-
-
-// Naive solution that uses global atomics
-inline void addToMaterialQueueNaive(
-    const uint gid,
-    const Material mat,
-    global QueueCounters *queueLens,
-    global uint* diffuseQueue,
-    global uint* glossyQueue,
-    global uint* ggxReflQueue,
-    global uint* ggxRefrQueue,
-    global uint* deltaQueue
-)
+// Material queue of path, in QueueCounters order
+inline uint8 materialQueueFlags(const Material mat, const uint gid)
 {
-    global uint *queue;
-    global uint *queueLen;
+    uint8 queues = (uint8)(0);
 
 #ifdef WF_SINGLE_MAT_QUEUE
     // Store all in 'diffuse' queue
-    queue = diffuseQueue;
-    queueLen = &queueLens->diffuseQueue;
+    queues.s3 = 1;
 #else
     switch (mat.type)
     {
         case BXDF_DIFFUSE:
-            queue = diffuseQueue;
-            queueLen = &queueLens->diffuseQueue;
+            queues.s3 = 1;
             break;
         case BXDF_GLOSSY:
-            queue = glossyQueue;
-            queueLen = &queueLens->glossyQueue;
+            queues.s4 = 1;
             break;
         case BXDF_GGX_ROUGH_REFLECTION:
-            queue = ggxReflQueue;
-            queueLen = &queueLens->ggxReflQueue;
+            queues.s5 = 1;
             break;
         case BXDF_GGX_ROUGH_DIELECTRIC:
-            queue = ggxRefrQueue;
-            queueLen = &queueLens->ggxRefrQueue;
+            queues.s6 = 1;
             break;
         case BXDF_IDEAL_REFLECTION:
         case BXDF_IDEAL_DIELECTRIC:
-            queue = deltaQueue;
-            queueLen = &queueLens->deltaQueue;
-            break;
-        default:
-            printf("WF_LOGIC: INCORRECT MATERIAL TYPE!\n");
-            return;
-    }
-#endif
-    
-    uint idx = atomic_inc(queueLen);
-    queue[idx] = gid;
-}
-
-// Minimize global atomics
-// No real performance gain on GTX 1060 3GB
-kernel void addToMaterialQueueLocalAtomics(
-    const uint gid,
-    const Material mat,
-    global QueueCounters *queueLens,
-    global uint* diffuseQueue,
-    global uint* glossyQueue,
-    global uint* ggxReflQueue,
-    global uint* ggxRefrQueue,
-    global uint* deltaQueue
-)
-{
-    local uint nDiffuse, nGlossy, nGGXRefl, nGGXRefr, nDelta;
-    nDiffuse = nGlossy = nGGXRefl = nGGXRefr = nDelta = 0;
-
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    global uint* queue;
-    global uint* queueLenGlobal;
-    local uint* queueLenLocal;
-
-#ifdef WF_SINGLE_MAT_QUEUE
-    queue = diffuseQueue;
-    queueLenGlobal = &queueLens->diffuseQueue;
-    queueLenLocal = &nDiffuse;
-#else
-    switch (mat.type)
-    {
-        case BXDF_DIFFUSE:
-            queue = diffuseQueue;
-            queueLenGlobal = &queueLens->diffuseQueue;
-            queueLenLocal = &nDiffuse;
-            break;
-        case BXDF_GLOSSY:
-            queue = glossyQueue;
-            queueLenGlobal = &queueLens->glossyQueue;
-            queueLenLocal = &nGlossy;
-            break;
-        case BXDF_GGX_ROUGH_REFLECTION:
-            queue = ggxReflQueue;
-            queueLenGlobal = &queueLens->ggxReflQueue;
-            queueLenLocal = &nGGXRefl;
-            break;
-        case BXDF_GGX_ROUGH_DIELECTRIC:
-            queue = ggxRefrQueue;
-            queueLenGlobal = &queueLens->ggxRefrQueue;
-            queueLenLocal = &nGGXRefr;
-            break;
-        case BXDF_IDEAL_REFLECTION:
-        case BXDF_IDEAL_DIELECTRIC:
-            queue = deltaQueue;
-            queueLenGlobal = &queueLens->deltaQueue;
-            queueLenLocal = &nDelta;
+            queues.s7 = 1;
             break;
         default:
             printf("WF_LOGIC: INCORRECT MATERIAL TYPE: %d (gid %u)!\n", mat.type, gid);
-            return;
+            break;
     }
 #endif
 
-    
-    // Count material types locally
-    uint posLocal = atomic_inc(queueLenLocal);
-    
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    // First in queue updates global counter
-    if (posLocal == 0)
-        *queueLenLocal = atomic_add(queueLenGlobal, *queueLenLocal);
-
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    // Add to queue
-    uint idx = *queueLenLocal + posLocal;
-    queue[idx] = gid;
+    return queues;
 }
-
-
-#ifdef NVIDIA
-// NVIDIA-only solution that uses warp-level voting
-#include "ptx_asm.cl"
-
-inline void addToMaterialQueueWarpNVIDIA(
-    const uint gid,
-    const Material mat,
-    global QueueCounters *queueLens,
-    global uint* diffuseQueue,
-    global uint* glossyQueue,
-    global uint* ggxReflQueue,
-    global uint* ggxRefrQueue,
-    global uint* deltaQueue
-)
-{
-    const uint mask_active = activemask();
-
-#ifdef WF_SINGLE_MAT_QUEUE
-    // Store all in 'diffuse' queue
-    uint idx = atomicAggInc(&queueLens->diffuseQueue, mask_active);
-    diffuseQueue[idx] = gid;
-#else
-    uint idx;
-    uint matMask;
-
-    const uint laneid = get_local_id(0) % 32;
-    const uint thmask = 1 << laneid;
-
-    matMask = ballot_sync(mat.type & BXDF_DIFFUSE, mask_active);
-    if (matMask & thmask)
-    {
-        idx = atomicAggInc(&queueLens->diffuseQueue, matMask);
-        diffuseQueue[idx] = gid;
-    }
-
-    matMask = ballot_sync(mat.type & BXDF_GLOSSY, mask_active);
-    if (matMask & thmask)
-    {
-        idx = atomicAggInc(&queueLens->glossyQueue, matMask);
-        glossyQueue[idx] = gid;
-    }
-
-    matMask = ballot_sync(mat.type & BXDF_GGX_ROUGH_REFLECTION, mask_active);
-    if (matMask & thmask)
-    {
-        idx = atomicAggInc(&queueLens->ggxReflQueue, matMask);
-        ggxReflQueue[idx] = gid;
-    }
-
-    matMask = ballot_sync(mat.type & BXDF_GGX_ROUGH_DIELECTRIC, mask_active);
-    if (matMask & thmask)
-    {
-        idx = atomicAggInc(&queueLens->ggxRefrQueue, matMask);
-        ggxRefrQueue[idx] = gid;
-    }
-
-    matMask = ballot_sync(mat.type & (BXDF_IDEAL_REFLECTION | BXDF_IDEAL_DIELECTRIC), mask_active);
-    if (matMask & thmask)
-    {
-        idx = atomicAggInc(&queueLens->deltaQueue, matMask);
-        deltaQueue[idx] = gid;
-    }
-
-#endif
-}
-
-#endif
\ No newline at end of file
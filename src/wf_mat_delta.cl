@@ -1,8 +1,11 @@
 #include "utils.cl"
 #include "bxdf_types.h"
 
+// Build options select the singular types present in scene
+#if !defined(BXDF_USE_IDEAL_REFLECTION) && !defined(BXDF_USE_IDEAL_DIELECTRIC)
 #define BXDF_USE_IDEAL_REFLECTION
 #define BXDF_USE_IDEAL_DIELECTRIC
+#endif
 #include "bxdf_partial.cl"
 
 kernel void wavefrontDelta(
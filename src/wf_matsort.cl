@@ -0,0 +1,120 @@
+#include "geom.h"
+#include "utils.cl"
+
+// Material queues are binned by matId (counting sort over all queues at once)
+// so that paths shaded together fetch the same material and texture data.
+// Sorted paths are written back in place, material kernels are unchanged.
+
+inline global uint* matQueue(
+    const uint q,
+    global uint* diffuseQueue,
+    global uint* glossyQueue,
+    global uint* ggxReflQueue,
+    global uint* ggxRefrQueue,
+    global uint* deltaQueue
+)
+{
+    switch (q)
+    {
+        case 0: return diffuseQueue;
+        case 1: return glossyQueue;
+        case 2: return ggxReflQueue;
+        case 3: return ggxRefrQueue;
+        default: return deltaQueue;
+    }
+}
+
+// Material queue lengths are adjacent in QueueCounters
+inline global uint* matQueueLens(global QueueCounters* queueLens)
+{
+    return &queueLens->diffuseQueue;
+}
+
+// Compute keys, count paths per bin (local histogram, one atomic per bin per group)
+kernel void materialKeys(
+    global GPUTaskState* tasks,
+    global QueueCounters* queueLens,
+    global uint* diffuseQueue,
+    global uint* glossyQueue,
+    global uint* ggxReflQueue,
+    global uint* ggxRefrQueue,
+    global uint* deltaQueue,
+    global uint* matSortPaths,
+    global uint* matSortKeys,
+    global uint* matBins,
+    uint numTasks
+)
+{
+    local uint hist[WF_MAT_SORT_BINS];
+    const uint lid = get_local_id(0);
+    const uint size = get_local_size(0);
+
+    for (uint i = lid; i < WF_MAT_SORT_BINS; i += size)
+        hist[i] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Queues treated as one concatenated list
+    global uint* lens = matQueueLens(queueLens);
+    const uint gid_direct = get_global_id(0);
+    uint q = 0;
+    uint start = 0;
+    while (q < WF_NUM_MAT_QUEUES && gid_direct >= start + lens[q])
+        start += lens[q++];
+
+    // All work-items reach barriers
+    if (q < WF_NUM_MAT_QUEUES)
+    {
+        const uint gid = matQueue(q, diffuseQueue, glossyQueue, ggxReflQueue, ggxRefrQueue, deltaQueue)[gid_direct - start];
+        const uint matId = (uint)ReadI32(matId, tasks);
+        const uint key = q * WF_MAT_SORT_BINS_PER_QUEUE + matId % WF_MAT_SORT_BINS_PER_QUEUE;
+        matSortPaths[gid_direct] = gid;
+        matSortKeys[gid_direct] = key;
+        atomic_inc(&hist[key]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint i = lid; i < WF_MAT_SORT_BINS; i += size)
+        if (hist[i] > 0)
+            atomic_add(&matBins[i], hist[i]);
+}
+
+// Bin counts => bin start offsets, single work-group of WF_COMPACT_GROUP_SIZE
+kernel void scanMaterialBins(
+    global uint* matBins
+)
+{
+    local uint scratch[WF_COMPACT_GROUP_SIZE];
+    scanBins(matBins, WF_MAT_SORT_BINS, scratch);
+}
+
+// Write paths back to their queue, bins of queue q start at the combined length of queues before it
+kernel void scatterMaterials(
+    global QueueCounters* queueLens,
+    global uint* diffuseQueue,
+    global uint* glossyQueue,
+    global uint* ggxReflQueue,
+    global uint* ggxRefrQueue,
+    global uint* deltaQueue,
+    global uint* matSortPaths,
+    global uint* matSortKeys,
+    global uint* matBins
+)
+{
+    global uint* lens = matQueueLens(queueLens);
+    uint total = 0;
+    for (uint i = 0; i < WF_NUM_MAT_QUEUES; i++)
+        total += lens[i];
+
+    const uint gid_direct = get_global_id(0);
+    if (gid_direct >= total)
+        return;
+
+    const uint key = matSortKeys[gid_direct];
+    const uint q = key / WF_MAT_SORT_BINS_PER_QUEUE;
+    uint start = 0;
+    for (uint i = 0; i < q; i++)
+        start += lens[i];
+
+    const uint pos = atomic_inc(&matBins[key]);
+    matQueue(q, diffuseQueue, glossyQueue, ggxReflQueue, ggxRefrQueue, deltaQueue)[pos - start] = matSortPaths[gid_direct];
+}
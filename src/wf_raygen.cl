@@ -13,8 +13,19 @@ kernel void genRays(
 {
     // Enqueued with 1D workgroups
     const uint gid_direct = get_global_id(0);
+
+#ifdef NVIDIA
     if (gid_direct >= queueLens->raygenQueue)
         return;
+    uint extIdx = atomicIncAll(&queueLens->extensionQueue);
+#else
+    // Extension queue slot reserved per work-group, before inactive items exit
+    local uint queueScratch[WF_COMPACT_GROUP_SIZE + 1];
+    const bool active = gid_direct < queueLens->raygenQueue;
+    uint extIdx = groupAppend(active, &queueLens->extensionQueue, queueScratch);
+    if (!active)
+        return;
+#endif
 
     // Get compacted index
     uint gid = raygenQueue[gid_direct]; // id of path
@@ -22,7 +33,7 @@ kernel void genRays(
     
     // Calculate pixel coordinates
     uint numPixels = params->width * params->height;
-    uint pixelIdx = (*currPixelIdx + gid_direct) % numPixels; // TODO: use gid_local + currentPixelIdx update on host
+    uint pixelIdx = (*currPixelIdx + gid_direct) % numPixels; // currPixelIdx moved by wf_advance
     WriteU32(pixelIndex, tasks, pixelIdx);
 
     // Camera plane is 1 unit away, by convention
@@ -64,14 +75,11 @@ kernel void genRays(
     // Construct camera ray
     WriteFloat3(orig, tasks, rayOrig);
     WriteFloat3(dir, tasks, rayDirection);
+    WriteF32(coneWidth, tasks, 0.0f);
 
     // Add paths to extension queue
-    uint extIdx = atomicIncAll(&queueLens->extensionQueue);
     extensionQueue[extIdx] = gid;
 
-    // TODO: pixel pointer has to be updated on HOST
-    // ALSO: reset queue sizes to zero
-
     WriteU32(seed, tasks, seed);
 
     // Reset path state
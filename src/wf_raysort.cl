@@ -0,0 +1,90 @@
+#include "geom.h"
+#include "utils.cl"
+
+// Extension rays are binned (counting sort) so that rays traced together
+// start from nearby points in similar directions => coherent BVH traversal.
+
+inline uint rayKey(const float3 orig, const float3 dir, global RenderParams *params)
+{
+    // Direction octant in top bits
+    uint octant = (uint)(dir.x < 0.0f) | ((uint)(dir.y < 0.0f) << 1) | ((uint)(dir.z < 0.0f) << 2);
+
+    // Origin cell within scene bounds
+    const float cells = (float)(1 << WF_RAY_SORT_GRID_BITS);
+    float3 extent = max(params->worldMax - params->worldMin, (float3)(1e-6f));
+    uint3 c = convert_uint3(clamp((orig - params->worldMin) / extent, 0.0f, 0.999f) * cells);
+
+    // Morton order
+    uint morton = 0;
+    for (uint b = 0; b < WF_RAY_SORT_GRID_BITS; b++)
+    {
+        morton |= ((c.x >> b) & 1) << (3 * b + 0);
+        morton |= ((c.y >> b) & 1) << (3 * b + 1);
+        morton |= ((c.z >> b) & 1) << (3 * b + 2);
+    }
+
+    return (octant << (3 * WF_RAY_SORT_GRID_BITS)) | morton;
+}
+
+// Compute keys, count rays per bin (local histogram, one atomic per bin per group)
+kernel void rayKeys(
+    global GPUTaskState* tasks,
+    global QueueCounters* queueLens,
+    global uint* extensionQueue,
+    global uint* rayKeys,
+    global uint* rayBins,
+    global RenderParams* params,
+    uint numTasks
+)
+{
+    local uint hist[WF_RAY_SORT_BINS];
+    const uint lid = get_local_id(0);
+    const uint size = get_local_size(0);
+
+    for (uint i = lid; i < WF_RAY_SORT_BINS; i += size)
+        hist[i] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // All work-items reach barriers
+    const uint gid_direct = get_global_id(0);
+    if (gid_direct < queueLens->extensionQueue)
+    {
+        const uint gid = extensionQueue[gid_direct];
+        const float3 rayOrig = ReadFloat3(orig, tasks);
+        const float3 rayDir = ReadFloat3(dir, tasks);
+        const uint key = rayKey(rayOrig, rayDir, params);
+        rayKeys[gid_direct] = key;
+        atomic_inc(&hist[key]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint i = lid; i < WF_RAY_SORT_BINS; i += size)
+        if (hist[i] > 0)
+            atomic_add(&rayBins[i], hist[i]);
+}
+
+// Bin counts => bin start offsets, single work-group of WF_COMPACT_GROUP_SIZE
+kernel void scanRayBins(
+    global uint* rayBins
+)
+{
+    local uint scratch[WF_COMPACT_GROUP_SIZE];
+    scanBins(rayBins, WF_RAY_SORT_BINS, scratch);
+}
+
+// Write paths to sorted queue, order within bin arbitrary
+kernel void scatterRays(
+    global QueueCounters* queueLens,
+    global uint* extensionQueue,
+    global uint* rayKeys,
+    global uint* rayBins,
+    global uint* sortedQueue
+)
+{
+    const uint gid_direct = get_global_id(0);
+    if (gid_direct >= queueLens->extensionQueue)
+        return;
+
+    const uint pos = atomic_inc(&rayBins[rayKeys[gid_direct]]);
+    sortedQueue[pos] = extensionQueue[gid_direct];
+}
@@ -7,9 +7,8 @@ kernel void traceShadow(
     global GPUTaskState* tasks,
     global QueueCounters* queueLens,
     global uint* shadowQueue,
-    global Triangle* tris,
+    global LeafTriangle* leafTris,
     global GPUNode* nodes,
-    global uint* indices,
     global RenderParams* params,
     uint numTasks
 )
@@ -30,7 +29,7 @@ kernel void traceShadow(
     
     // TEST: area light not occluding
     if (params->useAreaLight) intersectLight(&hitL, &r, params);
-    bool occluded = (hitL.i > -1) || bvh_occluded(&r, &lenL, tris, nodes, indices);
+    bool occluded = (hitL.i > -1) || bvh_occluded(&r, &lenL, leafTris, nodes);
 
     // Write hit to path state
     WriteU32(shadowRayBlocked, tasks, occluded);